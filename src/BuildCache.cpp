@@ -0,0 +1,154 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "BuildCache.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cstddef>
+
+#include <mutex>
+#include <utility>
+
+#include "BuildHistory.hpp"
+
+/**
+ * @brief Estimates memory used by a node of a tree or a hash table.
+ */
+static const std::size_t NodeOverhead = 4U*sizeof(void *);
+
+BuildCache::BuildCache(std::size_t budget) : budget(budget)
+{
+}
+
+void
+BuildCache::setBudget(std::size_t budget)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    this->budget = budget;
+    evict();
+}
+
+std::size_t
+BuildCache::getSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return size;
+}
+
+void
+BuildCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    paths.clear();
+    files.clear();
+    uses.clear();
+    size = 0U;
+}
+
+bool
+BuildCache::getPaths(int buildid, PathMap &paths)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto match = this->paths.find(buildid);
+    if (match == this->paths.end()) {
+        return false;
+    }
+
+    uses.splice(uses.begin(), uses, match->second.second);
+    paths = match->second.first;
+    return true;
+}
+
+void
+BuildCache::putPaths(int buildid, const PathMap &paths)
+{
+    // Interned paths are owned by the interner rather than by the cache.
+    const std::size_t entrySize = NodeOverhead
+                                + paths.size()*(NodeOverhead + sizeof(PathRef)
+                                              + sizeof(int));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (this->paths.find(buildid) != this->paths.end()) {
+        return;
+    }
+
+    Uses::iterator use = add(Kind::Paths, buildid, entrySize);
+    if (use != uses.end()) {
+        this->paths.emplace(buildid, std::make_pair(paths, use));
+    }
+}
+
+boost::optional<File>
+BuildCache::getFile(int fileid)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    const auto match = files.find(fileid);
+    if (match == files.end()) {
+        return {};
+    }
+
+    uses.splice(uses.begin(), uses, match->second.second);
+    return match->second.first;
+}
+
+void
+BuildCache::putFile(int fileid, const File &file)
+{
+    const std::size_t entrySize = NodeOverhead + file.getMemoryUsage();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (files.find(fileid) != files.end()) {
+        return;
+    }
+
+    Uses::iterator use = add(Kind::File, fileid, entrySize);
+    if (use != uses.end()) {
+        files.emplace(fileid, std::make_pair(file, use));
+    }
+}
+
+BuildCache::Uses::iterator
+BuildCache::add(Kind kind, int id, std::size_t size)
+{
+    // Entry that doesn't fit at all would just flush the cache.
+    if (size > budget) {
+        return uses.end();
+    }
+
+    this->size += size;
+    uses.push_front({ kind, id, size });
+    evict();
+    return uses.begin();
+}
+
+void
+BuildCache::evict()
+{
+    while (size > budget && !uses.empty()) {
+        const Use &use = uses.back();
+        if (use.kind == Kind::Paths) {
+            paths.erase(use.id);
+        } else {
+            files.erase(use.id);
+        }
+        size -= use.size;
+        uses.pop_back();
+    }
+}
@@ -0,0 +1,167 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef UNCOV_BUILDCACHE_HPP_
+#define UNCOV_BUILDCACHE_HPP_
+
+#include <boost/optional.hpp>
+
+#include <cstddef>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "BuildHistory.hpp"
+#include "PathInterner.hpp"
+
+/**
+ * @file BuildCache.hpp
+ *
+ * @brief This unit provides cache of data loaded from build history.
+ */
+
+/**
+ * @brief Memory-bounded cache of paths of builds and of decoded files.
+ *
+ * Paths are keyed by build id, files are keyed by file id.  Files are shared
+ * among builds and never change, so the same entry serves many builds.  When
+ * the budget is exceeded, least recently used entries are evicted.  All
+ * methods are thread-safe.
+ */
+class BuildCache
+{
+public:
+    /**
+     * @brief Constructs empty cache.
+     *
+     * @param budget Approximate limit on memory used by entries in bytes,
+     *               @c 0 disables caching.
+     */
+    explicit BuildCache(std::size_t budget);
+
+public:
+    /**
+     * @brief Changes memory budget evicting entries if necessary.
+     *
+     * @param budget Approximate limit on memory used by entries in bytes,
+     *               @c 0 disables caching.
+     */
+    void setBudget(std::size_t budget);
+
+    /**
+     * @brief Retrieves approximate amount of memory used by entries.
+     *
+     * @returns The size in bytes.
+     */
+    std::size_t getSize() const;
+
+    /**
+     * @brief Removes all entries.
+     */
+    void clear();
+
+    /**
+     * @brief Looks up paths of a build.
+     *
+     * @param buildid Build ID.
+     * @param paths   Receives mappings of file paths to file IDs on success.
+     *
+     * @returns @c true if paths were found, @c false otherwise.
+     */
+    bool getPaths(int buildid, PathMap &paths);
+
+    /**
+     * @brief Puts paths of a build into the cache.
+     *
+     * @param buildid Build ID.
+     * @param paths   Mappings of file paths to file IDs.
+     */
+    void putPaths(int buildid, const PathMap &paths);
+
+    /**
+     * @brief Looks up a file.
+     *
+     * @param fileid File ID.
+     *
+     * @returns Copy of the file or empty optional if it's not cached.
+     */
+    boost::optional<File> getFile(int fileid);
+
+    /**
+     * @brief Puts a file into the cache.
+     *
+     * @param fileid File ID.
+     * @param file   The file.
+     */
+    void putFile(int fileid, const File &file);
+
+private:
+    //! Kind of a cache entry.
+    enum class Kind
+    {
+        Paths, //!< Paths of a build.
+        File   //!< Single file.
+    };
+
+    //! Position of an entry in the order of uses.
+    struct Use
+    {
+        Kind kind;        //!< What is cached.
+        int id;           //!< Build ID or file ID.
+        std::size_t size; //!< Estimated size of the entry.
+    };
+
+    //! Order of uses, most recently used entries are at the front.
+    using Uses = std::list<Use>;
+
+    /**
+     * @brief Registers new entry evicting old entries if needed.
+     *
+     * Should be called with the mutex locked.
+     *
+     * @param kind What is cached.
+     * @param id   Build ID or file ID.
+     * @param size Estimated size of the entry.
+     *
+     * @returns Position of the entry in the order of uses.
+     */
+    Uses::iterator add(Kind kind, int id, std::size_t size);
+
+    /**
+     * @brief Evicts least recently used entries until budget is met.
+     *
+     * Should be called with the mutex locked.
+     */
+    void evict();
+
+private:
+    //! Approximate limit on memory used by entries in bytes.
+    std::size_t budget;
+    //! Approximate amount of memory used by entries in bytes.
+    std::size_t size = 0U;
+    //! Order in which entries were used.
+    Uses uses;
+    //! Cached paths along with their positions in the order of uses.
+    std::unordered_map<int, std::pair<PathMap, Uses::iterator>> paths;
+    //! Cached files along with their positions in the order of uses.
+    std::unordered_map<int, std::pair<File, Uses::iterator>> files;
+    //! Protects all of the above.
+    mutable std::mutex mutex;
+};
+
+#endif // UNCOV_BUILDCACHE_HPP_
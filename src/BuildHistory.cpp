@@ -16,69 +16,229 @@
 
 #include "BuildHistory.hpp"
 
+#include <boost/filesystem/operations.hpp>
 #include <boost/optional.hpp>
+#include <boost/scope_exit.hpp>
+
+#include <cstdint>
 
 #include <algorithm>
-#include <iterator>
-#include <sstream>
+#include <array>
+#include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
 #include <vector>
 #include <map>
 
-#include "utils/md5.hpp"
+#include "BuildCache.hpp"
+#include "CoveragePack.hpp"
 #include "DB.hpp"
+#include "PathIndex.hpp"
+#include "PathInterner.hpp"
+#include "coverage_codec.hpp"
 
-static std::string hashCoverage(const std::vector<int> &vec);
-static void updateDBSchema(DB &db, int fromVersion);
+static bool parseMd5(const std::string &hash,
+                     std::array<unsigned char, 16> &md5);
+static std::int64_t hashCoverage(const std::vector<int> &vec);
+static File unpackFile(PackedFile &&packed);
+static void updateDBSchema(DB &db);
+static void scheduleBackfill(DB &db, const std::string &name,
+                             const std::string &lastKeyQuery);
+static std::string lastFileId(const std::string &schema);
+static void updateLastFileId(DB &db, const std::string &schema);
+static bool finishFileMapMove(DB &db);
+static void moveFileMap(DB &db, int from, int to);
+static void moveCoverageOut(DB &db, int from, int to);
+static void backfillFileStats(DB &db, int from, int to);
+static void backfillDirStats(DB &db, int from, int to);
+static void recompressCoverage(DB &db, int from, int to);
 
 //! Current database scheme version.
-const int AppDBVersion = 2;
+const int AppDBVersion = 13;
 
-File::File(std::string path, std::string hash, std::vector<int> coverage)
-    : path(std::move(path)), hash(std::move(hash)),
-      coverage(std::move(coverage))
+//! Memory budget of cache of loaded data (in mebibytes) until configured.
+const int DefaultCacheSize = 64;
+
+//! Function that updates data of rows with keys in the (from, to] range.
+using BackfillFunc = void (*)(DB &db, int from, int to);
+
+/**
+ * @brief Description of a backfill.
+ */
+struct BackfillStep
+{
+    const char *name;  //!< Name under which progress is recorded.
+    BackfillFunc func; //!< Function that processes a batch.
+};
+
+//! Known backfills in the order in which they need to be done.
+static const BackfillStep backfillSteps[] = {
+    { "filemap", &moveFileMap },
+    { "coverage", &moveCoverageOut },
+    { "filestats", &backfillFileStats },
+    { "dirstats", &backfillDirStats },
+    { "recompress", &recompressCoverage },
+};
+
+DirStats::DirStats(int coveredCount, int missedCount,
+                   int ownCoveredCount, int ownMissedCount, int ownFileCount)
+    : coveredCount(coveredCount), missedCount(missedCount),
+      ownCoveredCount(ownCoveredCount), ownMissedCount(ownMissedCount),
+      ownFileCount(ownFileCount)
+{
+}
+
+int
+DirStats::getCoveredCount() const
+{
+    return coveredCount;
+}
+
+int
+DirStats::getMissedCount() const
+{
+    return missedCount;
+}
+
+int
+DirStats::getOwnCoveredCount() const
+{
+    return ownCoveredCount;
+}
+
+int
+DirStats::getOwnMissedCount() const
+{
+    return ownMissedCount;
+}
+
+int
+DirStats::getOwnFileCount() const
+{
+    return ownFileCount;
+}
+
+FileStats::FileStats(const std::vector<int> &coverage)
+    : coveredCount(0), missedCount(0), maxHits(0)
 {
-    coveredCount = 0;
-    missedCount = 0;
-    for (int hits : this->coverage) {
+    for (int hits : coverage) {
         if (hits == 0) {
             ++missedCount;
         } else if (hits > 0) {
             ++coveredCount;
+            maxHits = std::max(maxHits, hits);
         }
     }
 }
 
+FileStats::FileStats(int coveredCount, int missedCount, int maxHits)
+    : coveredCount(coveredCount), missedCount(missedCount), maxHits(maxHits)
+{
+}
+
+int
+FileStats::getCoveredCount() const
+{
+    return coveredCount;
+}
+
+int
+FileStats::getMissedCount() const
+{
+    return missedCount;
+}
+
+int
+FileStats::getMaxHits() const
+{
+    return maxHits;
+}
+
+File::File(std::string path, std::string hash, std::vector<int> coverage)
+    : File(std::move(path), std::move(hash), coverage, FileStats(coverage))
+{
+}
+
+File::File(std::string path, std::string hash, std::vector<int> coverage,
+           const FileStats &stats)
+    : path(internPath(path)), md5(),
+      coverage(std::make_shared<const CompactCoverage>(coverage)),
+      stats(stats)
+{
+    if (!parseMd5(hash, md5)) {
+        otherHash = std::make_shared<const std::string>(std::move(hash));
+    }
+}
+
 const std::string &
 File::getPath() const
+{
+    return *path;
+}
+
+PathRef
+File::getPathRef() const
 {
     return path;
 }
 
-const std::string &
+std::string
 File::getHash() const
 {
+    if (otherHash) {
+        return *otherHash;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    std::string hash;
+    hash.reserve(2U*md5.size());
+    for (unsigned char byte : md5) {
+        hash += digits[byte >> 4];
+        hash += digits[byte & 0xf];
+    }
     return hash;
 }
 
-const std::vector<int> &
+const CompactCoverage &
 File::getCoverage() const
 {
-    return coverage;
+    return *coverage;
 }
 
 int
 File::getCoveredCount() const
 {
-    return coveredCount;
+    return stats.getCoveredCount();
 }
 
 int
 File::getMissedCount() const
 {
-    return missedCount;
+    return stats.getMissedCount();
+}
+
+int
+File::getMaxHits() const
+{
+    return stats.getMaxHits();
+}
+
+const FileStats &
+File::getStats() const
+{
+    return stats;
+}
+
+std::size_t
+File::getMemoryUsage() const
+{
+    std::size_t size = sizeof(*this) + coverage->getMemoryUsage();
+    if (otherHash) {
+        size += otherHash->capacity();
+    }
+    return size;
 }
 
 BuildData::BuildData(std::string ref, std::string refName)
@@ -89,91 +249,227 @@ BuildData::BuildData(std::string ref, std::string refName)
 void
 BuildData::addFile(File file)
 {
-    files.emplace(file.getPath(), std::move(file));
+    files.emplace(file.getPathRef(), std::move(file));
 }
 
-int
-operator<<(DB &db, const BuildData &bd)
+/**
+ * @brief Converts hexadecimal form of MD5 hash into binary one.
+ *
+ * Only lowercase form is accepted, so that converting it back yields the
+ * same string.
+ *
+ * @param hash Hash to convert.
+ * @param md5  Receives binary form.
+ *
+ * @returns @c true on success, @c false if @p hash isn't of the right form.
+ */
+static bool
+parseMd5(const std::string &hash, std::array<unsigned char, 16> &md5)
 {
-    int coveredCount = 0;
-    int missedCount = 0;
-    for (auto entry : bd.files) {
-        File &file = entry.second;
-        coveredCount += file.getCoveredCount();
-        missedCount += file.getMissedCount();
+    if (hash.size() != 2U*md5.size()) {
+        return false;
     }
 
-    Transaction transaction = db.makeTransaction();
+    auto parseDigit = [](char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    };
 
-    db.execute("INSERT INTO builds (vcsref, vcsrefname, covered, missed) "
-               "VALUES (:ref, :refname, :covered, :missed)",
-               { ":ref"_b = bd.ref,
-                 ":refname"_b = bd.refName,
-                 ":covered"_b = coveredCount,
-                 ":missed"_b = missedCount });
+    for (std::size_t i = 0U; i < md5.size(); ++i) {
+        const int hi = parseDigit(hash[2U*i]);
+        const int lo = parseDigit(hash[2U*i + 1U]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        md5[i] = hi*16 + lo;
+    }
+    return true;
+}
 
-    const int buildid = db.getLastRowId();
+/**
+ * @brief Hashes coverage vector into an integer.
+ *
+ * Mixes in elements with multiply-rotate rounds and finishes with avalanche
+ * step of xxHash64.  The hash only narrows down candidates for deduplication,
+ * so it doesn't need to be cryptographic.
+ *
+ * @param vec Coverage to hash.
+ *
+ * @returns The hash.
+ */
+static std::int64_t
+hashCoverage(const std::vector<int> &vec)
+{
+    const std::uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const std::uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    const std::uint64_t prime3 = 0x165667B19E3779F9ULL;
 
-    for (auto entry : bd.files) {
-        File &file = entry.second;
+    std::uint64_t h = vec.size()*prime3;
+    for (int hits : vec) {
+        h ^= static_cast<std::uint32_t>(hits)*prime2;
+        h = ((h << 31) | (h >> 33))*prime1;
+    }
+
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return static_cast<std::int64_t>(h);
+}
 
-        const std::vector<int> &coverage = file.getCoverage();
-        const std::string covHash = hashCoverage(coverage);
+/**
+ * @brief Turns file read from coverage pack into a regular file.
+ *
+ * @param packed File from the pack.
+ *
+ * @returns The file.
+ */
+static File
+unpackFile(PackedFile &&packed)
+{
+    return File(std::move(packed.path), std::move(packed.hash),
+                std::move(packed.coverage),
+                FileStats(packed.coveredCount, packed.missedCount,
+                          packed.maxHits));
+}
 
-        int fileid = -1;
+/**
+ * @brief Retrieves path from a key of a map.
+ *
+ * @param path The key.
+ *
+ * @returns The path.
+ */
+static const std::string &
+keyPath(const std::string &path)
+{
+    return path;
+}
 
-        for (std::tuple<int> val :
-            db.queryAll("SELECT fileid FROM files "
-                        "WHERE path = :path AND hash = :hash AND "
-                              "covhash = :covhash",
-                        { ":path"_b = file.getPath(),
-                          ":hash"_b = file.getHash(),
-                          ":covhash"_b = covHash })) {
-            fileid = std::get<0>(val);
-        }
+/**
+ * @brief Retrieves path from a key of a map.
+ *
+ * @param path The key.
+ *
+ * @returns The path.
+ */
+static const std::string &
+keyPath(PathRef path)
+{
+    return *path;
+}
+
+/**
+ * @brief Computes statistics of directories of a build.
+ *
+ * Every file contributes to all directories on its path.
+ *
+ * @tparam T Type of map from path to object with coverage counts.
+ *
+ * @param files Files of the build.
+ *
+ * @returns Statistics of directories, root directory is an empty string.
+ */
+template <typename T>
+static std::map<std::string, DirStats>
+computeDirStats(const T &files)
+{
+    //! Statistics of a single directory.
+    struct Sums
+    {
+        int covered = 0;    //!< Number of covered lines in the subtree.
+        int missed = 0;     //!< Number of missed lines in the subtree.
+        int ownCovered = 0; //!< Number of covered lines in own files.
+        int ownMissed = 0;  //!< Number of missed lines in own files.
+        int ownFiles = 0;   //!< Number of own files.
+    };
 
-        if (fileid == -1) {
-            db.execute("INSERT INTO files (path, hash, covhash, coverage) "
-                       "VALUES (:path, :hash, :covhash, :coverage)",
-                       { ":path"_b = file.getPath(),
-                         ":hash"_b = file.getHash(),
-                         ":covhash"_b = covHash,
-                         ":coverage"_b = coverage });
-            fileid = db.getLastRowId();
+    // Strips last path component along with slashes that precede it.
+    auto parentOf = [](const std::string &path) {
+        std::string::size_type slash = path.rfind('/');
+        if (slash == std::string::npos) {
+            return std::string();
         }
+        while (slash != 0U && path[slash - 1U] == '/') {
+            --slash;
+        }
+        return path.substr(0U, slash);
+    };
 
-        db.execute("INSERT INTO filemap (buildid, fileid) "
-                   "VALUES (:buildid, :fileid)",
-                   { ":buildid"_b = buildid,
-                     ":fileid"_b = fileid });
-    }
+    std::map<std::string, Sums> dirs;
+    for (const auto &entry : files) {
+        const int covered = entry.second.getCoveredCount();
+        const int missed = entry.second.getMissedCount();
 
-    transaction.commit();
+        std::string dir = parentOf(keyPath(entry.first));
 
-    return buildid;
+        Sums &own = dirs[dir];
+        own.ownCovered += covered;
+        own.ownMissed += missed;
+        ++own.ownFiles;
+
+        while (true) {
+            Sums &sums = dirs[dir];
+            sums.covered += covered;
+            sums.missed += missed;
+            if (dir.empty()) {
+                break;
+            }
+            dir = parentOf(dir);
+        }
+    }
+
+    std::map<std::string, DirStats> stats;
+    for (const auto &entry : dirs) {
+        const Sums &sums = entry.second;
+        stats.emplace(entry.first,
+                      DirStats(sums.covered, sums.missed, sums.ownCovered,
+                               sums.ownMissed, sums.ownFiles));
+    }
+    return stats;
 }
 
 /**
- * @brief Hashes coverage vector into a string.
+ * @brief Computes and stores statistics of directories of a build.
  *
- * @param vec Coverage to hash.
+ * @tparam T Type of map from path to object with coverage counts.
  *
- * @returns String containing MD5 hash of the coverage.
+ * @param db      Database to update.
+ * @param buildid Build to compute statistics for.
+ * @param files   Files of the build.
  */
-static std::string
-hashCoverage(const std::vector<int> &vec)
+template <typename T>
+static void
+storeDirStats(DB &db, int buildid, const T &files)
 {
-    std::ostringstream oss;
-    std::copy(vec.cbegin(), vec.cend(), std::ostream_iterator<int>(oss, " "));
-    return md5(oss.str());
+    for (const auto &entry : computeDirStats(files)) {
+        const DirStats &stats = entry.second;
+        db.execute("INSERT INTO dirstats (buildid, dir, covered, missed, "
+                                         "owncovered, ownmissed, ownfiles) "
+                   "VALUES (:buildid, :dir, :covered, :missed, "
+                           ":owncovered, :ownmissed, :ownfiles)",
+                   { ":buildid"_b = buildid,
+                     ":dir"_b = entry.first,
+                     ":covered"_b = stats.getCoveredCount(),
+                     ":missed"_b = stats.getMissedCount(),
+                     ":owncovered"_b = stats.getOwnCoveredCount(),
+                     ":ownmissed"_b = stats.getOwnMissedCount(),
+                     ":ownfiles"_b = stats.getOwnFileCount() });
+    }
 }
 
 Build::Build(int id, std::string ref, std::string refName,
              int coveredCount, int missedCount, int timestamp,
-             DataLoader &loader)
+             bool hitCounts, DataLoader &loader)
     : id(id), ref(std::move(ref)), refName(std::move(refName)),
       coveredCount(coveredCount), missedCount(missedCount),
-      timestamp(timestamp), loader(&loader)
+      timestamp(timestamp), hitCounts(hitCounts), loader(&loader)
 {
 }
 
@@ -201,6 +497,12 @@ Build::getTimestamp() const
     return timestamp;
 }
 
+bool
+Build::hasHitCounts() const
+{
+    return hitCounts;
+}
+
 int
 Build::getCoveredCount() const
 {
@@ -216,48 +518,128 @@ Build::getMissedCount() const
 std::vector<std::string>
 Build::getPaths() const
 {
-    // Make sure file path to file id mapping is loaded.
-    if (pathMap.empty()) {
-        pathMap = loader->loadPaths(id);
-    }
+    return getPathIndex().getFiles();
+}
 
-    std::vector<std::string> paths;
-    paths.reserve(pathMap.size());
-    for (const auto &entry : pathMap) {
-        paths.push_back(entry.first);
+const PathIndex &
+Build::getPathIndex() const
+{
+    if (!pathIndex) {
+        pathIndex = std::make_shared<const PathIndex>(loader->loadPaths(id));
     }
-    return paths;
+    return *pathIndex;
+}
+
+bool
+Build::sharesFileIds(const Build &other) const
+{
+    return loader == other.loader;
 }
 
 boost::optional<File &>
 Build::getFile(const std::string &path) const
 {
+    // Requested file should be in the index.
+    const int fileid = getPathIndex().getFileId(path);
+    if (fileid == 0) {
+        return {};
+    }
+
     // Check if this file was already loaded.
-    const auto fileMatch = files.find(path);
+    const auto fileMatch = files.find(fileid);
     if (fileMatch != files.end()) {
         return fileMatch->second;
     }
 
-    // Make sure file path to file id mapping is loaded.
-    if (pathMap.empty()) {
-        pathMap = loader->loadPaths(id);
+    // Load the file and cache it.
+    if (boost::optional<File> file = loader->loadFile(fileid)) {
+        return files.emplace(fileid, std::move(*file)).first->second;
+    }
+
+    return {};
+}
+
+boost::optional<const FileStats &>
+Build::getFileStats(const std::string &path) const
+{
+    if (stats.empty()) {
+        stats = loader->loadFileStats(id);
+    }
+
+    // Path that was never interned can't be among paths of the build.
+    const PathRef ref = findPath(path);
+    if (ref == nullptr) {
+        return {};
     }
 
-    // Requested file should be in the map.
-    const auto pathMatch = pathMap.find(path);
-    if (pathMatch == pathMap.end()) {
+    const auto match = stats.find(ref);
+    if (match == stats.end()) {
         return {};
     }
+    return match->second;
+}
 
-    // Load the file and cache it.
-    if (boost::optional<File> file = loader->loadFile(pathMatch->second)) {
-        return files.emplace(path, std::move(*file)).first->second;
+std::map<std::string, DirStats>
+Build::getDirStats(const std::string &dirFilter) const
+{
+    return loader->loadDirStats(id, dirFilter);
+}
+
+void
+Build::prefetchFiles(const std::string &dirFilter) const
+{
+    std::vector<File> loaded;
+    try {
+        loaded = loader->loadFiles(id, dirFilter);
+    } catch (const std::runtime_error &) {
+        // This is just an optimization, files that fail to load in bulk will
+        // be loaded one by one.
+        return;
     }
 
-    return {};
+    const PathIndex &index = getPathIndex();
+    for (File &file : loaded) {
+        // Files that are already loaded are left intact as references to them
+        // might be in use.
+        if (const int fileid = index.getFileId(file.getPath())) {
+            files.emplace(fileid, std::move(file));
+        }
+    }
 }
 
-BuildHistory::BuildHistory(DB &db) : db(db)
+boost::optional<File>
+Build::loadFile(const std::string &path) const
+{
+    const int fileid = getPathIndex().getFileId(path);
+    if (fileid == 0) {
+        return {};
+    }
+
+    const auto fileMatch = files.find(fileid);
+    if (fileMatch != files.end()) {
+        return fileMatch->second;
+    }
+    return loader->loadFile(fileid);
+}
+
+void
+Build::forEachFile(const std::string &dirFilter,
+                   const std::function<void(const File &)> &visitor) const
+{
+    // Prefix of paths alone would also match siblings like "dir2" of "dir".
+    loader->streamFiles(id, dirFilter, [&](const File &file) {
+        const std::string &path = file.getPath();
+        if (path.size() == dirFilter.size() || dirFilter.empty() ||
+            path[dirFilter.size()] == '/') {
+            visitor(file);
+        }
+    });
+}
+
+BuildHistory::BuildHistory(DB &db)
+    : db(db),
+      cache(std::make_shared<BuildCache>(DefaultCacheSize*1024U*1024U)),
+      dictionaries([this](std::uint32_t id) { return loadDictionary(id); })
 {
     std::tuple<int> vals = db.queryOne("pragma user_version");
 
@@ -270,22 +652,69 @@ BuildHistory::BuildHistory(DB &db) : db(db)
     }
 
     if (fileDBVersion < AppDBVersion) {
-        updateDBSchema(db, fileDBVersion);
+        if (db.getMode() == DBMode::Snapshot) {
+            // Snapshot might reside on read-only storage and other processes
+            // don't expect it to change.
+            throw std::runtime_error("Database snapshot has outdated schema "
+                                     "(version " +
+                                     std::to_string(fileDBVersion) + "), "
+                                     "open it normally to update it");
+        }
+        if (db.isReadOnly()) {
+            // Schema is updated via a temporary writable connection.  Its
+            // changes are moved out of write-ahead log, because read-only
+            // connection can't do it on closing.
+            DB writableDB(db.getPath());
+            updateDBSchema(writableDB);
+            (void)writableDB.queryOne("pragma wal_checkpoint(TRUNCATE)");
+        } else {
+            updateDBSchema(db);
+        }
+    }
+
+    // Progress is a snapshot, which can only lag behind, so checks against it
+    // are conservative.
+    for (std::tuple<std::string, int, int> vals :
+         db.queryAll("SELECT name, position, last FROM backfills")) {
+        migrations.push_back({ std::move(std::get<0>(vals)),
+                               std::get<1>(vals), std::get<2>(vals) });
     }
+
+    std::tuple<int> legacy = db.queryOne("SELECT count(*) "
+                                         "FROM pragma_table_info('files') "
+                                         "WHERE name = 'coverage'");
+    legacyFiles = (std::get<0>(legacy) != 0);
+
+    db.setDictionaries(&dictionaries);
+    refreshDictionaries();
+}
+
+BuildHistory::~BuildHistory()
+{
+    db.setDictionaries(nullptr);
 }
 
 /**
  * @brief Performs update of database scheme to the latest version.
  *
- * This process might take some time.  Should either succeed or be no-op.
+ * Only schema is changed here, which is quick.  Rows that need to be updated
+ * are processed afterwards in batches by BuildHistory::migrate().  Should
+ * either succeed or be no-op.
  *
  * @param db Database to update.
- * @param fromVersion Current version of scheme.
  */
 static void
-updateDBSchema(DB &db, int fromVersion)
+updateDBSchema(DB &db)
 {
-    Transaction transaction = db.makeTransaction();
+    // Version is checked under write lock, so that of processes that open
+    // outdated database at the same time only the first one updates it.
+    Transaction transaction = db.makeWriteTransaction();
+
+    std::tuple<int> vals = db.queryOne("pragma user_version");
+    const int fromVersion = std::get<0>(vals);
+    if (fromVersion >= AppDBVersion) {
+        return;
+    }
 
     switch (fromVersion) {
         case 0:
@@ -328,23 +757,1170 @@ updateDBSchema(DB &db, int fromVersion)
                 CREATE INDEX files_idx ON files(path, hash, covhash)
             )");
             // Fall through.
-        case AppDBVersion:
-            break;
-    }
+        case 2:
+            // New coverage blobs are written in binary format, old ones stay
+            // as is and are recognized by absence of codec byte.  Nothing to
+            // do here, bumping the version prevents older versions from
+            // misreading new blobs.
+            // Fall through.
+        case 3:
+            // Values are filled in by "filestats" backfill.
+            db.execute("ALTER TABLE files "
+                       "ADD COLUMN covered INTEGER NOT NULL DEFAULT 0");
+            db.execute("ALTER TABLE files "
+                       "ADD COLUMN missed INTEGER NOT NULL DEFAULT 0");
+            db.execute("ALTER TABLE files "
+                       "ADD COLUMN maxhits INTEGER NOT NULL DEFAULT 0");
+            // Fall through.
+        case 4:
+            // Rows are added by "dirstats" backfill.
+            db.execute(R"(
+                CREATE TABLE dirstats (
+                    buildid INTEGER,
+                    dir TEXT NOT NULL,
+                    covered INTEGER NOT NULL,
+                    missed INTEGER NOT NULL,
+                    owncovered INTEGER NOT NULL,
+                    ownmissed INTEGER NOT NULL,
+                    ownfiles INTEGER NOT NULL,
 
-    db.execute("pragma user_version = " + std::to_string(AppDBVersion));
-    transaction.commit();
+                    PRIMARY KEY (buildid, dir),
+                    FOREIGN KEY (buildid) REFERENCES builds(buildid)
+                )
+            )");
+            // Fall through.
+        case 5:
+            db.execute(R"(
+                CREATE TABLE coverage (
+                    covid INTEGER,
+                    covhash INTEGER NOT NULL,
+                    data BLOB NOT NULL,
 
-    // Compact database after migration by defragmenting it.
-    db.execute("VACUUM");
-}
+                    PRIMARY KEY (covid)
+                )
+            )");
+            db.execute(R"(
+                CREATE INDEX coverage_idx ON coverage(covhash)
+            )");
+            // Coverage is moved out by "coverage" backfill, which leaves
+            // covhash and coverage columns of files empty.  SQLite can't drop
+            // them without rebuilding the table.
+            db.execute("ALTER TABLE files "
+                       "ADD COLUMN covid INTEGER REFERENCES coverage(covid)");
+            db.execute("DROP INDEX files_idx");
+            db.execute(R"(
+                CREATE INDEX files_idx ON files(path, hash, covid)
+            )");
+            // Fall through.
+        case 6:
+            db.execute("ALTER TABLE coverage "
+                       "ADD COLUMN base INTEGER REFERENCES coverage(covid)");
+            db.execute("ALTER TABLE coverage "
+                       "ADD COLUMN depth INTEGER NOT NULL DEFAULT 0");
+            // Fall through.
+        case 7:
+            // These make looking for unreferenced rows cheap.
+            db.execute("CREATE INDEX filemap_fileid_idx ON filemap(fileid)");
+            db.execute("CREATE INDEX files_covid_idx ON files(covid)");
+            db.execute("CREATE INDEX coverage_base_idx ON coverage(base) "
+                       "WHERE base IS NOT NULL");
+            // Fall through.
+        case 8:
+            db.execute(R"(
+                CREATE TABLE backfills (
+                    name TEXT NOT NULL,
+                    position INTEGER NOT NULL,
+                    last INTEGER NOT NULL,
 
-Build
-BuildHistory::addBuild(const BuildData &buildData)
-{
-    const int buildid = (db << buildData);
-    return *getBuild(buildid);
-}
+                    PRIMARY KEY (name)
+                )
+            )");
+            // Fall through.
+        case 9:
+            db.execute(R"(
+                CREATE TABLE dictionaries (
+                    dictid INTEGER,
+                    data BLOB NOT NULL,
+                    active INTEGER NOT NULL DEFAULT 0,
+
+                    PRIMARY KEY (dictid)
+                )
+            )");
+            // Fall through.
+        case 10:
+            // Clustering by build keeps files of a build together, they are
+            // found without a separate index or lookups into the table.
+            // Rows are moved into the new table by "filemap" backfill, until
+            // then both tables are accessed through a view.  Old table keeps
+            // its index, so the new one gets a different name.
+            db.execute("ALTER TABLE filemap RENAME TO oldfilemap");
+            db.execute(R"(
+                CREATE TABLE newfilemap (
+                    buildid INTEGER NOT NULL,
+                    fileid INTEGER NOT NULL,
+
+                    PRIMARY KEY (buildid, fileid),
+                    FOREIGN KEY (buildid) REFERENCES builds(buildid),
+                    FOREIGN KEY (fileid) REFERENCES files(fileid)
+                ) WITHOUT ROWID
+            )");
+            db.execute("CREATE INDEX filemap_file_idx ON newfilemap(fileid)");
+            db.execute(R"(
+                CREATE VIEW filemap AS
+                SELECT buildid, fileid FROM newfilemap
+                UNION ALL
+                SELECT buildid, fileid FROM oldfilemap
+            )");
+            db.execute(R"(
+                CREATE TRIGGER filemap_insert INSTEAD OF INSERT ON filemap
+                BEGIN
+                    INSERT INTO newfilemap (buildid, fileid)
+                    VALUES (new.buildid, new.fileid);
+                END
+            )");
+            db.execute(R"(
+                CREATE TRIGGER filemap_delete INSTEAD OF DELETE ON filemap
+                BEGIN
+                    DELETE FROM newfilemap
+                    WHERE buildid = old.buildid AND fileid = old.fileid;
+                    DELETE FROM oldfilemap
+                    WHERE fileid = old.fileid AND buildid = old.buildid;
+                END
+            )");
+            db.execute("CREATE INDEX builds_refname_idx "
+                       "ON builds(vcsrefname)");
+            // Fall through.
+        case 11:
+            // Coverage of builds without hit counts is stored in a new
+            // format, which older versions can't read.
+            db.execute("ALTER TABLE builds "
+                       "ADD COLUMN hitcounts INTEGER NOT NULL DEFAULT 1");
+            // Fall through.
+        case 12:
+            // Files are cached by their ids, possibly by another process, so
+            // ids of removed files must never be given to new ones.  New
+            // files get ids past the largest one ever used, which is stored
+            // here, as making fileid AUTOINCREMENT requires rebuilding the
+            // table.
+            db.execute(R"(
+                CREATE TABLE lastids (
+                    name TEXT NOT NULL,
+                    lastid INTEGER NOT NULL,
+
+                    PRIMARY KEY (name)
+                )
+            )");
+            db.execute("INSERT INTO lastids (name, lastid) "
+                       "SELECT 'files', ifnull(max(fileid), 0) FROM files");
+            // Fall through.
+        case AppDBVersion:
+            break;
+    }
+
+    // Rows that existed before the update are fixed up later, new rows are
+    // written in the new format right away.
+    const std::string lastFile = "SELECT ifnull(max(fileid), 0) FROM files";
+    const std::string lastBuild = "SELECT ifnull(max(buildid), 0) "
+                                  "FROM builds";
+    if (fromVersion <= 10 && !finishFileMapMove(db)) {
+        scheduleBackfill(db, "filemap",
+                         "SELECT ifnull(max(rowid), 0) FROM oldfilemap");
+    }
+    if (fromVersion <= 5) {
+        scheduleBackfill(db, "coverage", lastFile);
+    }
+    if (fromVersion <= 3) {
+        scheduleBackfill(db, "filestats", lastFile);
+    }
+    if (fromVersion <= 4) {
+        scheduleBackfill(db, "dirstats", lastBuild);
+    }
+
+    db.execute("pragma user_version = " + std::to_string(AppDBVersion));
+    transaction.commit();
+}
+
+/**
+ * @brief Builds expression that yields the largest id ever given to a file.
+ *
+ * @param schema Name of the database that stores the files.
+ *
+ * @returns SQL expression.
+ */
+static std::string
+lastFileId(const std::string &schema)
+{
+    return "(SELECT lastid FROM " + schema + ".lastids "
+            "WHERE name = 'files')";
+}
+
+/**
+ * @brief Records that ids of files up to the largest one are used.
+ *
+ * @param db     Database connection.
+ * @param schema Name of the database that stores the files.
+ */
+static void
+updateLastFileId(DB &db, const std::string &schema)
+{
+    db.execute("UPDATE " + schema + ".lastids "
+               "SET lastid = max(lastid, (SELECT ifnull(max(fileid), 0) "
+                                         "FROM " + schema + ".files)) "
+               "WHERE name = 'files'");
+}
+
+/**
+ * @brief Records that rows up to the current last one need to be updated.
+ *
+ * @param db           Database to update.
+ * @param name         Name of the backfill.
+ * @param lastKeyQuery Query that yields key of the last row.
+ */
+static void
+scheduleBackfill(DB &db, const std::string &name,
+                 const std::string &lastKeyQuery)
+{
+    std::tuple<int> vals = db.queryOne(lastKeyQuery);
+    if (std::get<0>(vals) != 0) {
+        db.execute("INSERT INTO backfills (name, position, last) "
+                   "VALUES (:name, 0, :last)",
+                   { ":name"_b = name, ":last"_b = std::get<0>(vals) });
+    }
+}
+
+/**
+ * @brief Replaces view over old and new mapping of builds to files with the
+ *        new table once the old one is empty.
+ *
+ * @param db Database to update.
+ *
+ * @returns @c true if the new table is in place, @c false otherwise.
+ */
+static bool
+finishFileMapMove(DB &db)
+{
+    std::tuple<int> vals = db.queryOne("SELECT EXISTS (SELECT 1 "
+                                                      "FROM oldfilemap)");
+    if (std::get<0>(vals) != 0) {
+        return false;
+    }
+
+    // Triggers go away along with the view.
+    db.execute("DROP VIEW filemap");
+    db.execute("DROP TABLE oldfilemap");
+    db.execute("ALTER TABLE newfilemap RENAME TO filemap");
+    return true;
+}
+
+/**
+ * @brief Moves mapping of builds to files into the table clustered by build.
+ *
+ * @param db   Database to update.
+ * @param from Rows of the old table with larger rowids are processed.
+ * @param to   Rows of the old table with rowids up to this one are processed.
+ */
+static void
+moveFileMap(DB &db, int from, int to)
+{
+    // Old table is gone early if builds at the end of it were removed.
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM sqlite_master "
+                                       "WHERE name = 'oldfilemap'");
+    if (std::get<0>(vals) == 0) {
+        return;
+    }
+
+    db.execute("INSERT OR IGNORE INTO newfilemap (buildid, fileid) "
+               "SELECT buildid, fileid FROM oldfilemap "
+               "WHERE rowid > :from AND rowid <= :to",
+               { ":from"_b = from, ":to"_b = to });
+    db.execute("DELETE FROM oldfilemap WHERE rowid > :from AND rowid <= :to",
+               { ":from"_b = from, ":to"_b = to });
+    (void)finishFileMapMove(db);
+}
+
+/**
+ * @brief Moves coverage of files into a separate table deduplicating it.
+ *
+ * Coverage is re-encoded in the process.  Coverage that can't be decoded is
+ * moved as is and never matches any new coverage.
+ *
+ * @param db   Database to update.
+ * @param from Files with larger ids are processed.
+ * @param to   Files with ids up to this one are processed.
+ */
+static void
+moveCoverageOut(DB &db, int from, int to)
+{
+    // Identifiers are collected first to not modify the table while reading
+    // it.
+    std::vector<int> fileids;
+    for (std::tuple<int> vals : db.queryAll("SELECT fileid FROM files "
+                                            "WHERE fileid > :from AND "
+                                                  "fileid <= :to AND "
+                                                  "covid IS NULL",
+                                            { ":from"_b = from,
+                                              ":to"_b = to })) {
+        fileids.push_back(std::get<0>(vals));
+    }
+
+    for (int fileid : fileids) {
+        int covid = -1;
+        try {
+            std::tuple<std::vector<int>> vals =
+                db.queryOne("SELECT coverage FROM files "
+                            "WHERE fileid = :fileid",
+                            { ":fileid"_b = fileid });
+            const std::vector<int> &coverage = std::get<0>(vals);
+            const std::int64_t covHash = hashCoverage(coverage);
+
+            for (std::tuple<int> val :
+                 db.queryAll("SELECT covid FROM coverage "
+                             "WHERE covhash = :covhash AND data = :data AND "
+                                   "base IS NULL",
+                             { ":covhash"_b = covHash,
+                               ":data"_b = coverage })) {
+                covid = std::get<0>(val);
+            }
+
+            if (covid == -1) {
+                db.execute("INSERT INTO coverage (covhash, data) "
+                           "VALUES (:covhash, :data)",
+                           { ":covhash"_b = covHash, ":data"_b = coverage });
+                covid = db.getLastRowId();
+            }
+        } catch (const std::runtime_error &) {
+            db.execute("INSERT INTO coverage (covhash, data) "
+                       "SELECT 0, coverage FROM files WHERE fileid = :fileid",
+                       { ":fileid"_b = fileid });
+            covid = db.getLastRowId();
+        }
+
+        db.execute("UPDATE files "
+                   "SET covid = :covid, covhash = '', coverage = x'' "
+                   "WHERE fileid = :fileid",
+                   { ":covid"_b = covid, ":fileid"_b = fileid });
+    }
+}
+
+/**
+ * @brief Fills in coverage statistics of files stored before they had them.
+ *
+ * @param db   Database to update.
+ * @param from Files with larger ids are processed.
+ * @param to   Files with ids up to this one are processed.
+ */
+static void
+backfillFileStats(DB &db, int from, int to)
+{
+    // Coverage is read first to not modify the table while reading it.
+    // Files stored before coverage differences were introduced have no
+    // base.
+    std::vector<std::pair<int, FileStats>> stats;
+    for (std::tuple<int, int> vals : db.queryAll("SELECT fileid, covid "
+                                                 "FROM files "
+                                                 "WHERE fileid > :from AND "
+                                                       "fileid <= :to",
+                                                 { ":from"_b = from,
+                                                   ":to"_b = to })) {
+        try {
+            std::tuple<std::vector<int>> cov =
+                db.queryOne("SELECT data FROM coverage WHERE covid = :covid",
+                            { ":covid"_b = std::get<1>(vals) });
+            stats.emplace_back(std::get<0>(vals),
+                               FileStats(std::get<0>(cov)));
+        } catch (const std::runtime_error &) {
+            // Statistics of unreadable coverage remain zero.
+        }
+    }
+
+    for (const auto &entry : stats) {
+        const FileStats &fileStats = entry.second;
+        db.execute("UPDATE files "
+                   "SET covered = :covered, missed = :missed, "
+                       "maxhits = :maxhits "
+                   "WHERE fileid = :fileid",
+                   { ":covered"_b = fileStats.getCoveredCount(),
+                     ":missed"_b = fileStats.getMissedCount(),
+                     ":maxhits"_b = fileStats.getMaxHits(),
+                     ":fileid"_b = entry.first });
+    }
+}
+
+/**
+ * @brief Computes and stores statistics of directories of builds.
+ *
+ * @param db   Database to update.
+ * @param from Builds with larger ids are processed.
+ * @param to   Builds with ids up to this one are processed.
+ */
+static void
+backfillDirStats(DB &db, int from, int to)
+{
+    std::vector<int> buildids;
+    for (std::tuple<int> vals : db.queryAll("SELECT buildid FROM builds "
+                                            "WHERE buildid > :from AND "
+                                                  "buildid <= :to",
+                                            { ":from"_b = from,
+                                              ":to"_b = to })) {
+        buildids.push_back(std::get<0>(vals));
+    }
+
+    for (int buildid : buildids) {
+        std::map<std::string, FileStats> files;
+        for (std::tuple<std::string, int, int> vals : db.queryAll(
+                "SELECT path, covered, missed "
+                "FROM files NATURAL JOIN filemap "
+                "WHERE buildid = :buildid",
+                { ":buildid"_b = buildid })) {
+            files.emplace(std::move(std::get<0>(vals)),
+                          FileStats(std::get<1>(vals), std::get<2>(vals), 0));
+        }
+        storeDirStats(db, buildid, files);
+    }
+}
+
+/**
+ * @brief Re-encodes coverage with the dictionary that is in use.
+ *
+ * Coverage that can't be decoded is left as is.
+ *
+ * @param db   Database to update.
+ * @param from Coverage with larger ids is processed.
+ * @param to   Coverage with ids up to this one is processed.
+ */
+static void
+recompressCoverage(DB &db, int from, int to)
+{
+    std::vector<int> covids;
+    for (std::tuple<int> vals : db.queryAll("SELECT covid FROM coverage "
+                                            "WHERE covid > :from AND "
+                                                  "covid <= :to",
+                                            { ":from"_b = from,
+                                              ":to"_b = to })) {
+        covids.push_back(std::get<0>(vals));
+    }
+
+    for (int covid : covids) {
+        std::vector<int> data;
+        try {
+            std::tuple<std::vector<int>> vals =
+                db.queryOne("SELECT data FROM coverage WHERE covid = :covid",
+                            { ":covid"_b = covid });
+            data = std::move(std::get<0>(vals));
+        } catch (const std::runtime_error &) {
+            continue;
+        }
+
+        db.execute("UPDATE coverage SET data = :data WHERE covid = :covid",
+                   { ":data"_b = data, ":covid"_b = covid });
+    }
+}
+
+std::vector<MigrationProgress>
+BuildHistory::getMigrations()
+{
+    std::vector<MigrationProgress> progress;
+    for (const BackfillStep &step : backfillSteps) {
+        for (std::tuple<int, int> vals :
+             db.queryAll("SELECT position, last FROM backfills "
+                         "WHERE name = :name",
+                         { ":name"_b = std::string(step.name) })) {
+            progress.push_back({ step.name, std::get<0>(vals),
+                                 std::get<1>(vals) });
+        }
+    }
+    return progress;
+}
+
+bool
+BuildHistory::migrate(int batchSize)
+{
+    Transaction transaction = db.makeTransaction();
+    refreshDictionaries();
+
+    // State is queried anew as another process might have advanced it.
+    std::vector<MigrationProgress> pending = getMigrations();
+    if (pending.empty()) {
+        migrations.clear();
+        return false;
+    }
+
+    // Backfills depend on results of preceding ones, so they are done one
+    // after another.
+    MigrationProgress &current = pending.front();
+    const int to = (current.last - current.position > batchSize)
+                 ? current.position + batchSize
+                 : current.last;
+
+    for (const BackfillStep &step : backfillSteps) {
+        if (current.name == step.name) {
+            step.func(db, current.position, to);
+        }
+    }
+
+    if (to == current.last) {
+        db.execute("DELETE FROM backfills WHERE name = :name",
+                   { ":name"_b = current.name });
+    } else {
+        db.execute("UPDATE backfills SET position = :position "
+                   "WHERE name = :name",
+                   { ":position"_b = to, ":name"_b = current.name });
+    }
+
+    transaction.commit();
+
+    current.position = to;
+    if (to == current.last) {
+        pending.erase(pending.begin());
+    }
+    migrations = std::move(pending);
+    return true;
+}
+
+void
+BuildHistory::compact()
+{
+    db.execute("pragma auto_vacuum = INCREMENTAL");
+    db.execute("VACUUM");
+}
+
+std::uint32_t
+BuildHistory::trainDictionary(int sampleCount, int maxSize)
+{
+    // Recent coverage is the most representative of what's to come.
+    std::vector<std::vector<int>> samples;
+    for (std::tuple<int> vals : db.queryAll("SELECT covid FROM coverage "
+                                            "ORDER BY covid DESC "
+                                            "LIMIT :count",
+                                            { ":count"_b = sampleCount })) {
+        try {
+            samples.push_back(loadCoverage(std::get<0>(vals)));
+        } catch (const std::runtime_error &) {
+            // Broken coverage is of no use.
+        }
+    }
+
+    const std::vector<unsigned char> dict =
+        CoverageDictionaries::train(samples, maxSize);
+    const std::uint32_t id = CoverageDictionaries::getId(dict);
+
+    db.execute("INSERT INTO dictionaries (dictid, data) VALUES (:id, :data)",
+               { ":id"_b = std::int64_t(id), ":data"_b = dict });
+    return id;
+}
+
+void
+BuildHistory::useDictionary(std::uint32_t id)
+{
+    Transaction transaction = db.makeTransaction();
+
+    if (id != 0U) {
+        std::tuple<int> vals = db.queryOne("SELECT count(*) "
+                                           "FROM dictionaries "
+                                           "WHERE dictid = :id",
+                                           { ":id"_b = std::int64_t(id) });
+        if (std::get<0>(vals) == 0) {
+            throw std::runtime_error("No such dictionary: " +
+                                     std::to_string(id));
+        }
+    }
+
+    db.execute("UPDATE dictionaries SET active = (dictid = :id)",
+               { ":id"_b = std::int64_t(id) });
+
+    // Restarts recompression if it's in progress.
+    db.execute("DELETE FROM backfills WHERE name = 'recompress'");
+    scheduleBackfill(db, "recompress",
+                     "SELECT ifnull(max(covid), 0) FROM coverage");
+
+    transaction.commit();
+
+    migrations = getMigrations();
+    dictionaries.setActive(id);
+}
+
+int
+BuildHistory::removeUnusedDictionaries()
+{
+    Transaction transaction = db.makeTransaction();
+
+    std::vector<std::uint32_t> unused;
+    for (std::tuple<std::int64_t> vals :
+         db.queryAll("SELECT dictid FROM dictionaries WHERE NOT active")) {
+        const std::uint32_t id = std::get<0>(vals);
+        const std::vector<unsigned char> prefix = getCoveragePrefix(id);
+        std::tuple<int> uses = db.queryOne("SELECT count(*) FROM coverage "
+                                           "WHERE substr(data, 1, :size) = "
+                                                 ":prefix",
+                                           { ":size"_b = int(prefix.size()),
+                                             ":prefix"_b = prefix });
+        if (std::get<0>(uses) == 0) {
+            unused.push_back(id);
+        }
+    }
+
+    for (std::uint32_t id : unused) {
+        db.execute("DELETE FROM dictionaries WHERE dictid = :id",
+                   { ":id"_b = std::int64_t(id) });
+    }
+
+    transaction.commit();
+    return unused.size();
+}
+
+std::vector<unsigned char>
+BuildHistory::loadDictionary(std::uint32_t id)
+{
+    for (std::tuple<std::vector<unsigned char>> vals :
+         db.queryAll("SELECT data FROM dictionaries WHERE dictid = :id",
+                     { ":id"_b = std::int64_t(id) })) {
+        return std::get<0>(vals);
+    }
+    return {};
+}
+
+void
+BuildHistory::refreshDictionaries()
+{
+    std::uint32_t active = 0U;
+    for (std::tuple<std::int64_t> vals :
+         db.queryAll("SELECT dictid FROM dictionaries WHERE active")) {
+        active = std::get<0>(vals);
+    }
+    dictionaries.setActive(active);
+}
+
+bool
+BuildHistory::isMigrated(const std::string &name) const
+{
+    for (const MigrationProgress &migration : migrations) {
+        if (migration.name == name) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool
+BuildHistory::isMigrated(const std::string &name, int key) const
+{
+    for (const MigrationProgress &migration : migrations) {
+        if (migration.name == name) {
+            return key <= migration.position || key > migration.last;
+        }
+    }
+    return true;
+}
+
+std::string
+BuildHistory::legacyColumns() const
+{
+    return legacyFiles ? "covhash, coverage, " : "";
+}
+
+std::string
+BuildHistory::legacyValues() const
+{
+    return legacyFiles ? "'', x'', " : "";
+}
+
+void
+BuildHistory::configure(const BuildHistorySettings &settings)
+{
+    maxDeltaChain = settings.getCoverageDeltaChain();
+    packEnabled = settings.isCoveragePackEnabled();
+    storeHits = settings.isHitCountStored();
+    cache->setBudget(settings.getBuildCacheSize()*1024U*1024U);
+}
+
+void
+BuildHistory::setArchivePath(const std::string &path)
+{
+    archivePath = path;
+    archive.reset();
+    archiveDB.reset();
+}
+
+void
+BuildHistory::setPackPath(const std::string &path)
+{
+    packPath = path;
+    pack.reset();
+}
+
+void
+BuildHistory::setCache(std::shared_ptr<BuildCache> cache)
+{
+    this->cache = std::move(cache);
+}
+
+int
+BuildHistory::archiveBuilds(int before)
+{
+    if (archivePath.empty()) {
+        throw std::runtime_error("Archive location isn't set");
+    }
+
+    // Rows that weren't migrated yet can't be copied correctly.
+    if (!getMigrations().empty()) {
+        throw std::runtime_error("Can't archive builds while migration of "
+                                 "the database is in progress");
+    }
+
+    // The last build is left in place for its id to not be reused.
+    before = std::min(before, getLastBuildId());
+
+    // Creates archive if it doesn't exist yet and brings its schema up to
+    // date.
+    BuildHistory *const archive = getArchive(true);
+
+    db.execute("ATTACH DATABASE :path AS archive",
+               { ":path"_b = archivePath });
+    BOOST_SCOPE_EXIT_ALL(this) {
+        try {
+            db.execute("DETACH DATABASE archive");
+        } catch (const std::runtime_error &) {
+            // Connection is closed eventually anyway.
+        }
+    };
+
+    // Commit of a transaction that spans several databases in WAL mode isn't
+    // atomic, so builds are first copied into the archive and only then
+    // removed from the main database.  Builds that are already in the
+    // archive (because previous run was interrupted) aren't copied again.
+    Transaction copyTransaction = db.makeTransaction();
+    refreshDictionaries();
+
+    // Coverage is re-encoded on copying, which might compress it.
+    db.execute("INSERT OR IGNORE INTO archive.dictionaries (dictid, data) "
+               "SELECT dictid, data FROM main.dictionaries WHERE active");
+
+    db.execute("CREATE TEMP TABLE movedbuilds AS "
+               "SELECT buildid FROM main.builds "
+               "WHERE buildid < :before AND "
+                     "buildid NOT IN (SELECT buildid FROM archive.builds)",
+               { ":before"_b = before });
+
+    db.execute(R"(
+        INSERT INTO archive.builds (buildid, vcsref, vcsrefname,
+                                    covered, missed, timestamp, hitcounts)
+        SELECT buildid, vcsref, vcsrefname, covered, missed, timestamp,
+               hitcounts
+        FROM main.builds
+        WHERE buildid IN temp.movedbuilds
+    )");
+    db.execute(R"(
+        INSERT INTO archive.dirstats (buildid, dir, covered, missed,
+                                      owncovered, ownmissed, ownfiles)
+        SELECT buildid, dir, covered, missed, owncovered, ownmissed, ownfiles
+        FROM main.dirstats
+        WHERE buildid IN temp.movedbuilds
+    )");
+
+    // Identifiers of files and coverage are local to a database, so they are
+    // mapped while being copied.  Coverage is visited from older to newer
+    // rows, which makes bases of differences processed before them.
+    db.execute("CREATE TEMP TABLE covmap (oldid INTEGER PRIMARY KEY, "
+                                         "newid INTEGER NOT NULL)");
+    std::vector<std::tuple<int, std::int64_t, std::vector<int>, int, int>>
+        coverage;
+    for (std::tuple<int, std::int64_t, std::vector<int>, int, int> vals :
+         db.queryAll(R"(
+            WITH RECURSIVE needed(covid) AS (
+                SELECT covid FROM main.files
+                WHERE fileid IN (SELECT fileid FROM main.filemap
+                                 WHERE buildid IN temp.movedbuilds)
+                UNION
+                SELECT base FROM main.coverage NATURAL JOIN needed
+                WHERE base IS NOT NULL
+            )
+            SELECT covid, covhash, data, ifnull(base, 0), depth
+            FROM main.coverage
+            WHERE covid IN needed
+            ORDER BY covid
+         )")) {
+        coverage.push_back(std::move(vals));
+    }
+    for (const auto &entry : coverage) {
+        const int base = std::get<3>(entry);
+        int newid = 0;
+        if (base == 0) {
+            for (std::tuple<int> vals : db.queryAll(
+                    "SELECT covid FROM archive.coverage "
+                    "WHERE covhash = :covhash AND data = :data AND "
+                          "base IS NULL",
+                    { ":covhash"_b = std::get<1>(entry),
+                      ":data"_b = std::get<2>(entry) })) {
+                newid = std::get<0>(vals);
+            }
+        }
+        if (newid == 0) {
+            db.execute("INSERT INTO archive.coverage (covhash, data, base, "
+                                                     "depth) "
+                       "VALUES (:covhash, :data, "
+                               "(SELECT newid FROM temp.covmap "
+                                "WHERE oldid = :base), "
+                               ":depth)",
+                       { ":covhash"_b = std::get<1>(entry),
+                         ":data"_b = std::get<2>(entry),
+                         ":base"_b = base,
+                         ":depth"_b = std::get<4>(entry) });
+            newid = db.getLastRowId();
+        }
+        db.execute("INSERT INTO temp.covmap (oldid, newid) "
+                   "VALUES (:oldid, :newid)",
+                   { ":oldid"_b = std::get<0>(entry), ":newid"_b = newid });
+    }
+
+    // Files are staged to number them for assigning ids.
+    db.execute(R"(
+        CREATE TEMP TABLE archivedfiles AS
+        SELECT f.path AS path, f.hash AS hash, m.newid AS covid,
+               f.covered AS covered, f.missed AS missed, f.maxhits AS maxhits
+        FROM main.files AS f JOIN temp.covmap AS m ON m.oldid = f.covid
+        WHERE f.fileid IN (SELECT fileid FROM main.filemap
+                           WHERE buildid IN temp.movedbuilds) AND
+              NOT EXISTS (SELECT 1 FROM archive.files AS a
+                          WHERE a.path = f.path AND a.hash = f.hash AND
+                                a.covid = m.newid)
+    )");
+    db.execute("INSERT INTO archive.files (fileid, path, hash, " +
+                                              archive->legacyColumns() +
+                                              "covid, covered, missed, "
+                                              "maxhits) "
+               "SELECT " + lastFileId("archive") + " + rowid, "
+                      "path, hash, " + archive->legacyValues() +
+                      "covid, covered, missed, maxhits "
+               "FROM temp.archivedfiles");
+    updateLastFileId(db, "archive");
+    db.execute(R"(
+        INSERT INTO archive.filemap (buildid, fileid)
+        SELECT fm.buildid, (SELECT max(a.fileid) FROM archive.files AS a
+                            WHERE a.path = f.path AND a.hash = f.hash AND
+                                  a.covid = m.newid)
+        FROM main.filemap AS fm
+        JOIN main.files AS f ON f.fileid = fm.fileid
+        JOIN temp.covmap AS m ON m.oldid = f.covid
+        WHERE fm.buildid IN temp.movedbuilds
+    )");
+
+    db.execute("DROP TABLE temp.archivedfiles");
+    db.execute("DROP TABLE temp.covmap");
+    db.execute("DROP TABLE temp.movedbuilds");
+
+    copyTransaction.commit();
+
+    Transaction deleteTransaction = db.makeTransaction();
+    const std::string archived = "buildid < :before AND "
+                                 "buildid IN (SELECT buildid "
+                                             "FROM archive.builds)";
+    db.execute("DELETE FROM main.dirstats WHERE " + archived,
+               { ":before"_b = before });
+    db.execute("DELETE FROM main.filemap WHERE " + archived,
+               { ":before"_b = before });
+    db.execute("DELETE FROM main.builds WHERE " + archived,
+               { ":before"_b = before });
+    const int nMoved = db.getChanges();
+    deleteTransaction.commit();
+
+    // Files and coverage that were used only by moved builds.
+    (void)collectGarbage();
+
+    return nMoved;
+}
+
+BuildHistory *
+BuildHistory::getArchive(bool create)
+{
+    if (archive) {
+        return archive.get();
+    }
+
+    if (archivePath.empty()) {
+        return nullptr;
+    }
+    if (!create && !boost::filesystem::exists(archivePath)) {
+        return nullptr;
+    }
+
+    archiveDB.reset(new DB(archivePath, db.getMode()));
+    archive.reset(new BuildHistory(*archiveDB));
+    return archive.get();
+}
+
+CoveragePack *
+BuildHistory::getPack(int buildid)
+{
+    if (packPath.empty()) {
+        return nullptr;
+    }
+
+    try {
+        if (!pack) {
+            if (!boost::filesystem::exists(packPath)) {
+                return nullptr;
+            }
+            pack.reset(new CoveragePack(packPath));
+        } else {
+            // Pack might have been extended or removed by another process.
+            pack->refresh();
+        }
+    } catch (const std::runtime_error &) {
+        pack.reset();
+        return nullptr;
+    }
+
+    if (buildid != 0 && !pack->hasBuild(buildid)) {
+        return nullptr;
+    }
+    return pack.get();
+}
+
+void
+BuildHistory::updatePack()
+{
+    // Files that weren't migrated yet lack data that goes into the pack.
+    if (packPath.empty() ||
+        !isMigrated("coverage") || !isMigrated("filestats")) {
+        return;
+    }
+
+    const int lastBuildId = getLastBuildId();
+    CoveragePack *const current = getPack(0);
+    const int from = (current != nullptr)
+                   ? current->getLastBuildId()
+                   : getPreviousBuildId(lastBuildId);
+
+    std::vector<int> buildids;
+    for (std::tuple<int> vals :
+         db.queryAll("SELECT buildid FROM builds "
+                     "WHERE buildid > :from AND buildid <= :last "
+                     "ORDER BY buildid",
+                     { ":from"_b = from, ":last"_b = lastBuildId })) {
+        buildids.push_back(std::get<0>(vals));
+    }
+
+    for (int buildid : buildids) {
+        std::vector<PackedFile> files;
+        for (std::tuple<int, std::string, std::string, int, int, int, int,
+                        std::int64_t> vals :
+             db.queryAll("SELECT fileid, path, hash, covid, covered, missed, "
+                                "maxhits, coverage.covhash "
+                         "FROM filemap NATURAL JOIN files "
+                                     "JOIN coverage USING (covid) "
+                         "WHERE buildid = :buildid",
+                         { ":buildid"_b = buildid })) {
+            files.push_back({ std::get<0>(vals), std::move(std::get<1>(vals)),
+                              std::move(std::get<2>(vals)), std::get<4>(vals),
+                              std::get<5>(vals), std::get<6>(vals),
+                              std::get<7>(vals),
+                              loadCoverage(std::get<3>(vals)) });
+        }
+        CoveragePack::append(packPath, buildid, files);
+    }
+}
+
+void
+BuildHistory::dropPack()
+{
+    pack.reset();
+    if (!packPath.empty()) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(packPath, ec);
+    }
+}
+
+Build
+BuildHistory::addBuild(const BuildData &buildData)
+{
+    const int buildid = storeBuild(buildData);
+
+    if (packEnabled) {
+        try {
+            updatePack();
+        } catch (const std::runtime_error &) {
+            // Pack is only a cache, builds missing in it are read from the
+            // database.
+        }
+    }
+
+    return *getBuild(buildid);
+}
+
+int
+BuildHistory::storeBuild(const BuildData &bd)
+{
+    int coveredCount = 0;
+    int missedCount = 0;
+    for (const auto &entry : bd.files) {
+        const File &file = entry.second;
+        coveredCount += file.getCoveredCount();
+        missedCount += file.getMissedCount();
+    }
+
+    Transaction transaction = db.makeTransaction();
+    refreshDictionaries();
+
+    // Coverage of files in the last build serves as a base for differences.
+    // Paths of new files are interned, others can't match and are skipped.
+    PathMap prevCovids;
+    if (maxDeltaChain > 0) {
+        for (std::tuple<std::string, int> vals : db.queryAll(
+                "SELECT path, ifnull(covid, 0) "
+                "FROM files NATURAL JOIN filemap "
+                "WHERE buildid = (SELECT max(buildid) FROM builds)")) {
+            if (const PathRef path = findPath(std::get<0>(vals))) {
+                prevCovids.emplace(path, std::get<1>(vals));
+            }
+        }
+    }
+
+    db.execute("INSERT INTO builds (vcsref, vcsrefname, covered, missed, "
+                                   "hitcounts) "
+               "VALUES (:ref, :refname, :covered, :missed, :hitcounts)",
+               { ":ref"_b = bd.ref,
+                 ":refname"_b = bd.refName,
+                 ":covered"_b = coveredCount,
+                 ":missed"_b = missedCount,
+                 ":hitcounts"_b = (storeHits ? 1 : 0) });
+
+    const int buildid = db.getLastRowId();
+
+    // Files are collected in a staging table to match them against already
+    // stored ones all at once instead of one by one.
+    db.execute(R"(
+        CREATE TEMP TABLE stagedfiles (
+            path TEXT NOT NULL,
+            hash TEXT NOT NULL,
+            covid INTEGER NOT NULL,
+            covered INTEGER NOT NULL,
+            missed INTEGER NOT NULL,
+            maxhits INTEGER NOT NULL
+        )
+    )");
+
+    for (const auto &entry : bd.files) {
+        const File &file = entry.second;
+
+        const auto prev = prevCovids.find(file.getPathRef());
+        std::vector<int> coverage = file.getCoverage().toVector();
+        const int covid = storeCoverage(storeHits
+                                        ? coverage
+                                        : dropHitCounts(std::move(coverage)),
+                                        prev == prevCovids.end()
+                                        ? 0
+                                        : prev->second);
+
+        db.execute("INSERT INTO stagedfiles (path, hash, covid, "
+                                            "covered, missed, maxhits) "
+                   "VALUES (:path, :hash, :covid, "
+                           ":covered, :missed, :maxhits)",
+                   { ":path"_b = file.getPath(),
+                     ":hash"_b = file.getHash(),
+                     ":covid"_b = covid,
+                     ":covered"_b = file.getCoveredCount(),
+                     ":missed"_b = file.getMissedCount(),
+                     ":maxhits"_b = storeHits
+                                  ? file.getMaxHits()
+                                  : std::min(1, file.getMaxHits()) });
+    }
+
+    // Ids past the last used one are derived from unique rowids of staged
+    // files, gaps left by files that are already stored are fine.
+    db.execute("INSERT INTO files (fileid, path, hash, " + legacyColumns() +
+                                      "covid, covered, missed, maxhits) "
+               "SELECT " + lastFileId("main") + " + s.rowid, "
+                      "path, hash, " + legacyValues() +
+                      "covid, covered, missed, maxhits " + R"(
+        FROM stagedfiles AS s
+        WHERE NOT EXISTS (SELECT 1 FROM files AS f
+                          WHERE f.path = s.path AND f.hash = s.hash AND
+                                f.covid = s.covid)
+    )");
+    updateLastFileId(db, "main");
+    db.execute(R"(
+        INSERT INTO filemap (buildid, fileid)
+        SELECT :buildid, (SELECT max(fileid) FROM files AS f
+                          WHERE f.path = s.path AND f.hash = s.hash AND
+                                f.covid = s.covid)
+        FROM stagedfiles AS s
+    )", { ":buildid"_b = buildid });
+
+    db.execute("DROP TABLE temp.stagedfiles");
+
+    storeDirStats(db, buildid, bd.files);
+
+    transaction.commit();
+
+    return buildid;
+}
+
+int
+BuildHistory::storeCoverage(const std::vector<int> &coverage, int prev)
+{
+    const std::int64_t covHash = hashCoverage(coverage);
+
+    // Full copies are compared by the database, differences have to be
+    // resolved first.  Comparing data rules out hash collisions.
+    std::vector<std::pair<int, int>> candidates;
+    for (std::tuple<int, int> vals :
+         db.queryAll("SELECT covid, ifnull(base, 0) FROM coverage "
+                     "WHERE covhash = :covhash AND "
+                           "(base IS NOT NULL OR data = :data)",
+                     { ":covhash"_b = covHash, ":data"_b = coverage })) {
+        candidates.emplace_back(std::get<0>(vals), std::get<1>(vals));
+    }
+    for (const std::pair<int, int> &candidate : candidates) {
+        if (candidate.second == 0) {
+            return candidate.first;
+        }
+        try {
+            if (loadCoverage(candidate.first) == coverage) {
+                return candidate.first;
+            }
+        } catch (const std::runtime_error &) {
+            // Broken coverage doesn't match anything.
+        }
+    }
+
+    std::vector<int> data = coverage;
+    int base = 0;
+    int depth = 0;
+
+    if (prev != 0) {
+        try {
+            std::tuple<int> vals =
+                db.queryOne("SELECT depth FROM coverage WHERE covid = :covid",
+                            { ":covid"_b = prev });
+            const int prevDepth = std::get<0>(vals);
+
+            if (prevDepth < maxDeltaChain) {
+                std::vector<int> delta = diffCoverage(loadCoverage(prev),
+                                                      coverage);
+                // Difference takes two numbers per changed line.
+                if (delta.size() < coverage.size()/2U) {
+                    data = std::move(delta);
+                    base = prev;
+                    depth = prevDepth + 1;
+                }
+            }
+        } catch (const std::runtime_error &) {
+            // Can't use broken coverage as a base, store full copy instead.
+        }
+    }
+
+    if (base == 0) {
+        db.execute("INSERT INTO coverage (covhash, data) "
+                   "VALUES (:covhash, :data)",
+                   { ":covhash"_b = covHash, ":data"_b = data });
+    } else {
+        db.execute("INSERT INTO coverage (covhash, data, base, depth) "
+                   "VALUES (:covhash, :data, :base, :depth)",
+                   { ":covhash"_b = covHash, ":data"_b = data,
+                     ":base"_b = base, ":depth"_b = depth });
+    }
+    return db.getLastRowId();
+}
 
 int
 BuildHistory::getLastBuildId()
@@ -376,7 +1952,123 @@ int
 BuildHistory::getPreviousBuildId(int id)
 {
     // TODO: try looking for closest build in terms of commits.
-    return id - 1;
+    // Builds might have been removed, so there can be gaps in identifiers.
+    std::tuple<int> vals = db.queryOne("SELECT ifnull(max(buildid), 0) "
+                                       "FROM builds WHERE buildid < :buildid",
+                                       { ":buildid"_b = id });
+    if (std::get<0>(vals) == 0) {
+        if (BuildHistory *archived = getArchive(false)) {
+            return archived->getPreviousBuildId(id);
+        }
+    }
+    return std::get<0>(vals);
+}
+
+void
+BuildHistory::removeBuilds(const std::vector<int> &ids)
+{
+    const int lastBuildId = getLastBuildId();
+
+    Transaction transaction = db.makeTransaction();
+
+    for (int id : ids) {
+        // Identifier of the last build would be given to the next one.
+        if (id == lastBuildId) {
+            throw std::runtime_error("Can't remove the last build: #" +
+                                     std::to_string(id));
+        }
+
+        db.execute("DELETE FROM dirstats WHERE buildid = :buildid",
+                   { ":buildid"_b = id });
+        db.execute("DELETE FROM filemap WHERE buildid = :buildid",
+                   { ":buildid"_b = id });
+        db.execute("DELETE FROM builds WHERE buildid = :buildid",
+                   { ":buildid"_b = id });
+    }
+
+    transaction.commit();
+}
+
+GarbageStats
+BuildHistory::collectGarbage(int batchSize)
+{
+    GarbageStats stats = { };
+
+    // Candidates are collected upfront and checked again on removal, this way
+    // batches don't hold the database locked for long and builds added in
+    // between can pick up rows that looked unused.
+    std::vector<int> fileids;
+    for (std::tuple<int> vals : db.queryAll(R"(
+            SELECT fileid FROM files
+            WHERE NOT EXISTS (SELECT 1 FROM filemap
+                              WHERE filemap.fileid = files.fileid)
+         )")) {
+        fileids.push_back(std::get<0>(vals));
+    }
+
+    for (std::size_t i = 0U; i < fileids.size(); i += batchSize) {
+        Transaction transaction = db.makeTransaction();
+        const std::size_t end = std::min(fileids.size(), i + batchSize);
+        for (std::size_t j = i; j < end; ++j) {
+            db.execute("DELETE FROM files "
+                       "WHERE fileid = :fileid AND "
+                             "NOT EXISTS (SELECT 1 FROM filemap "
+                                         "WHERE fileid = :fileid)",
+                       { ":fileid"_b = fileids[j] });
+            stats.files += db.getChanges();
+        }
+        transaction.commit();
+    }
+
+    // Pack is only appended to and would keep removed files forever, so it's
+    // dropped to be built anew from the remaining builds.  Cached files are
+    // left intact, as ids of removed files are never given to new ones.
+    if (stats.files != 0) {
+        dropPack();
+    }
+
+    // Coverage is alive if it's used by a file or serves as a base of alive
+    // coverage.
+    std::vector<int> covids;
+    for (std::tuple<int> vals : db.queryAll(R"(
+            WITH RECURSIVE alive(covid) AS (
+                SELECT covid FROM files WHERE covid IS NOT NULL
+                UNION
+                SELECT base FROM coverage NATURAL JOIN alive
+                WHERE base IS NOT NULL
+            )
+            SELECT covid FROM coverage
+            WHERE covid NOT IN alive
+            ORDER BY covid DESC
+         )")) {
+        covids.push_back(std::get<0>(vals));
+    }
+
+    // Differences are newer than their bases, going from newer to older rows
+    // releases bases before they are visited.
+    for (std::size_t i = 0U; i < covids.size(); i += batchSize) {
+        Transaction transaction = db.makeTransaction();
+        const std::size_t end = std::min(covids.size(), i + batchSize);
+        for (std::size_t j = i; j < end; ++j) {
+            db.execute("DELETE FROM coverage "
+                       "WHERE covid = :covid AND "
+                             "NOT EXISTS (SELECT 1 FROM files "
+                                         "WHERE covid = :covid) AND "
+                             "NOT EXISTS (SELECT 1 FROM coverage "
+                                         "WHERE base = :covid)",
+                       { ":covid"_b = covids[j] });
+            stats.coverage += db.getChanges();
+        }
+        transaction.commit();
+    }
+
+    // Freed pages are returned to the file system one at a time.
+    for (std::tuple<> page : db.queryAll("pragma incremental_vacuum")) {
+        static_cast<void>(page);
+        ++stats.pages;
+    }
+
+    return stats;
 }
 
 boost::optional<Build>
@@ -384,14 +2076,19 @@ BuildHistory::getBuild(int id)
 {
     try {
         DataLoader &loader = *this;
-        std::tuple<std::string, std::string, int, int, int> vals =
-            db.queryOne("SELECT vcsref, vcsrefname, covered, missed, timestamp "
+        std::tuple<std::string, std::string, int, int, int, int> vals =
+            db.queryOne("SELECT vcsref, vcsrefname, covered, missed, "
+                               "timestamp, hitcounts "
                         "FROM builds WHERE buildid = :buildid",
                         { ":buildid"_b = id } );
         return Build(id, std::get<0>(vals), std::get<1>(vals),
                      std::get<2>(vals), std::get<3>(vals), std::get<4>(vals),
-                     loader);
+                     std::get<5>(vals) != 0, loader);
     } catch (const std::runtime_error &) {
+        // Archived builds are served by history of the archive.
+        if (BuildHistory *archived = getArchive(false)) {
+            return archived->getBuild(id);
+        }
         return {};
     }
 }
@@ -411,10 +2108,12 @@ std::vector<Build>
 listBuilds(T &&rows, DataLoader &loader)
 {
     std::vector<Build> builds;
-    for (std::tuple<int, std::string, std::string, int, int, int> vals : rows) {
+    for (std::tuple<int, std::string, std::string, int, int, int, int> vals :
+         rows) {
         builds.emplace_back(std::get<0>(vals), std::get<1>(vals),
                             std::get<2>(vals), std::get<3>(vals),
-                            std::get<4>(vals), std::get<5>(vals), loader);
+                            std::get<4>(vals), std::get<5>(vals),
+                            std::get<6>(vals) != 0, loader);
     }
     return builds;
 }
@@ -423,7 +2122,8 @@ std::vector<Build>
 BuildHistory::getBuilds()
 {
     return listBuilds(db.queryAll("SELECT buildid, vcsref, vcsrefname, "
-                                         "covered, missed, timestamp "
+                                         "covered, missed, timestamp, "
+                                         "hitcounts "
                                   "FROM builds"),
                       *this);
 }
@@ -432,22 +2132,44 @@ std::vector<Build>
 BuildHistory::getBuildsOn(const std::string &refName)
 {
     return listBuilds(db.queryAll("SELECT buildid, vcsref, vcsrefname, "
-                                         "covered, missed, timestamp "
+                                         "covered, missed, timestamp, "
+                                         "hitcounts "
                                   "FROM builds "
                                   "WHERE vcsrefname = :refname",
                                   { ":refname"_b = refName }),
                       *this);
 }
 
-std::map<std::string, int>
+PathMap
 BuildHistory::loadPaths(int buildid)
 {
-    std::map<std::string, int> paths;
+    PathMap paths;
+    if (cache->getPaths(buildid, paths)) {
+        return paths;
+    }
+
+    paths = queryPaths(buildid, getPack(buildid));
+    cache->putPaths(buildid, paths);
+    return paths;
+}
+
+PathMap
+BuildHistory::queryPaths(int buildid, CoveragePack *cached)
+{
+    if (cached != nullptr && cached->hasBuild(buildid)) {
+        try {
+            return cached->loadPaths(buildid);
+        } catch (const std::runtime_error &) {
+            // Fall back to reading from the database.
+        }
+    }
+
+    PathMap paths;
     for (std::tuple<std::string, int> vals : db.queryAll(
             "SELECT path, fileid FROM files NATURAL JOIN filemap "
             "WHERE buildid = :buildid",
             { ":buildid"_b = buildid })) {
-        paths.emplace(std::move(std::get<0>(vals)), std::get<1>(vals));
+        paths.emplace(internPath(std::get<0>(vals)), std::get<1>(vals));
     }
     return paths;
 }
@@ -455,15 +2177,315 @@ BuildHistory::loadPaths(int buildid)
 boost::optional<File>
 BuildHistory::loadFile(int fileid)
 {
+    if (boost::optional<File> file = cache->getFile(fileid)) {
+        return file;
+    }
+
+    boost::optional<File> file = readFile(fileid, getPack(0));
+    if (file) {
+        cache->putFile(fileid, *file);
+    }
+    return file;
+}
+
+boost::optional<File>
+BuildHistory::readFile(int fileid, CoveragePack *cached)
+{
+    if (cached != nullptr) {
+        try {
+            PackedFile packed;
+            if (cached->loadFile(fileid, packed)) {
+                return unpackFile(std::move(packed));
+            }
+        } catch (const std::runtime_error &) {
+            // Fall back to reading from the database.
+        }
+    }
+
     try {
-        std::tuple<std::string, std::string, std::vector<int>> vals =
-            db.queryOne("SELECT path, hash, coverage FROM files "
+        std::tuple<std::string, std::string, std::vector<int>, int,
+                   int, int, int> vals =
+            db.queryOne("SELECT path, hash, " + coverageSource() + ", "
+                               "ifnull(base, 0), covered, missed, maxhits "
+                        "FROM " + filesWithCoverage() + " "
                         "WHERE fileid = :fileid",
                         { ":fileid"_b = fileid });
 
-        return File(std::move(std::get<0>(vals)), std::move(std::get<1>(vals)),
-                    std::move(std::get<2>(vals)));
+        return makeFile(fileid, std::move(std::get<0>(vals)),
+                        std::move(std::get<1>(vals)),
+                        resolveCoverage(std::move(std::get<2>(vals)),
+                                        std::get<3>(vals)),
+                        FileStats(std::get<4>(vals), std::get<5>(vals),
+                                  std::get<6>(vals)));
     } catch (const std::runtime_error &) {
         return {};
     }
 }
+
+std::vector<File>
+BuildHistory::loadFiles(int buildid, const std::string &prefix)
+{
+    std::vector<File> files;
+
+    // Pack is checked for changes once for the whole request.
+    CoveragePack *const cached = getPack(0);
+
+    PathMap paths;
+    if (!cache->getPaths(buildid, paths)) {
+        paths = queryPaths(buildid, cached);
+        cache->putPaths(buildid, paths);
+    }
+
+    // Consecutive builds share most of their files, so when only a few of
+    // them aren't cached, loading those one by one is cheaper than loading
+    // everything.
+    std::vector<int> missing;
+    for (const auto &entry : paths) {
+        if (entry.first->compare(0, prefix.size(), prefix) != 0) {
+            continue;
+        }
+        if (boost::optional<File> file = cache->getFile(entry.second)) {
+            files.push_back(std::move(*file));
+        } else {
+            missing.push_back(entry.second);
+        }
+    }
+    if (missing.size()*4U <= files.size() + missing.size()) {
+        for (int fileid : missing) {
+            if (boost::optional<File> file = readFile(fileid, cached)) {
+                cache->putFile(fileid, *file);
+                files.push_back(std::move(*file));
+            }
+        }
+        return files;
+    }
+    files.clear();
+
+    if (cached != nullptr && cached->hasBuild(buildid)) {
+        try {
+            for (PackedFile &packed : cached->loadFiles(buildid, prefix,
+                                                         true)) {
+                const int fileid = packed.fileid;
+                files.push_back(unpackFile(std::move(packed)));
+                cache->putFile(fileid, files.back());
+            }
+            return files;
+        } catch (const std::runtime_error &) {
+            // Fall back to reading from the database.
+            files.clear();
+        }
+    }
+
+    for (std::tuple<int, std::string, std::string, std::vector<int>, int,
+                    int, int, int> vals :
+         db.queryAll("SELECT fileid, path, hash, " + coverageSource() + ", "
+                            "ifnull(base, 0), covered, missed, maxhits "
+                     "FROM filemap NATURAL JOIN " + filesWithCoverage() + " "
+                     "WHERE buildid = :buildid AND "
+                           "substr(path, 1, length(:prefix)) = :prefix",
+                     { ":buildid"_b = buildid, ":prefix"_b = prefix })) {
+        files.push_back(makeFile(std::get<0>(vals),
+                                 std::move(std::get<1>(vals)),
+                                 std::move(std::get<2>(vals)),
+                                 resolveCoverage(std::move(std::get<3>(vals)),
+                                                 std::get<4>(vals)),
+                                 FileStats(std::get<5>(vals),
+                                           std::get<6>(vals),
+                                           std::get<7>(vals))));
+        cache->putFile(std::get<0>(vals), files.back());
+    }
+    return files;
+}
+
+void
+BuildHistory::streamFiles(int buildid, const std::string &prefix,
+                          const std::function<void(const File &)> &visitor)
+{
+    // Streamed files aren't put into the cache to not evict everything else
+    // from it while going through a large build.
+
+    if (CoveragePack *cached = getPack(buildid)) {
+        // Pack is checked for changes only once and is kept alive even if
+        // visitor causes it to be reopened.
+        const std::shared_ptr<CoveragePack> held = pack;
+
+        std::vector<PackedFile> entries;
+        bool listed = false;
+        try {
+            // Only the list of files, coverage is loaded file by file.
+            entries = cached->loadFiles(buildid, prefix, false);
+            listed = true;
+        } catch (const std::runtime_error &) {
+            // Fall back to reading from the database.
+        }
+
+        if (listed) {
+            for (const PackedFile &entry : entries) {
+                boost::optional<File> file = cache->getFile(entry.fileid);
+                if (!file) {
+                    file = readFile(entry.fileid, cached);
+                }
+                if (file) {
+                    visitor(*file);
+                }
+            }
+            return;
+        }
+    }
+
+    for (std::tuple<int, std::string, std::string, std::vector<int>, int,
+                    int, int, int> vals :
+         db.queryAll("SELECT fileid, path, hash, " + coverageSource() + ", "
+                            "ifnull(base, 0), covered, missed, maxhits "
+                     "FROM filemap NATURAL JOIN " + filesWithCoverage() + " "
+                     "WHERE buildid = :buildid AND "
+                           "substr(path, 1, length(:prefix)) = :prefix "
+                     "ORDER BY path",
+                     { ":buildid"_b = buildid, ":prefix"_b = prefix })) {
+        visitor(makeFile(std::get<0>(vals), std::move(std::get<1>(vals)),
+                         std::move(std::get<2>(vals)),
+                         resolveCoverage(std::move(std::get<3>(vals)),
+                                         std::get<4>(vals)),
+                         FileStats(std::get<5>(vals), std::get<6>(vals),
+                                   std::get<7>(vals))));
+    }
+}
+
+std::string
+BuildHistory::coverageSource() const
+{
+    // Coverage which wasn't moved out yet is still in files table.
+    return isMigrated("coverage") ? "data" : "ifnull(data, files.coverage)";
+}
+
+std::string
+BuildHistory::filesWithCoverage() const
+{
+    return isMigrated("coverage") ? "files JOIN coverage USING (covid)"
+                                  : "files LEFT JOIN coverage USING (covid)";
+}
+
+File
+BuildHistory::makeFile(int fileid, std::string path, std::string hash,
+                       std::vector<int> coverage, const FileStats &stats)
+{
+    // Statistics are computed if they weren't filled in yet.
+    if (!isMigrated("filestats", fileid)) {
+        return File(std::move(path), std::move(hash), std::move(coverage));
+    }
+    return File(std::move(path), std::move(hash), std::move(coverage), stats);
+}
+
+std::vector<int>
+BuildHistory::loadCoverage(int covid)
+{
+    std::tuple<std::vector<int>, int> vals =
+        db.queryOne("SELECT data, ifnull(base, 0) FROM coverage "
+                    "WHERE covid = :covid",
+                    { ":covid"_b = covid });
+    return resolveCoverage(std::move(std::get<0>(vals)), std::get<1>(vals));
+}
+
+std::vector<int>
+BuildHistory::resolveCoverage(std::vector<int> data, int base)
+{
+    if (base == 0) {
+        return data;
+    }
+
+    // Walk chain of differences down to the full copy it starts with.
+    std::vector<std::vector<int>> deltas;
+    deltas.push_back(std::move(data));
+    while (base != 0) {
+        std::tuple<std::vector<int>, int> vals =
+            db.queryOne("SELECT data, ifnull(base, 0) FROM coverage "
+                        "WHERE covid = :covid",
+                        { ":covid"_b = base });
+        deltas.push_back(std::move(std::get<0>(vals)));
+
+        // Bases are always older, which also rules out cycles.
+        if (std::get<1>(vals) >= base) {
+            throw std::runtime_error("Broken chain of coverage differences");
+        }
+        base = std::get<1>(vals);
+    }
+
+    std::vector<int> coverage = std::move(deltas.back());
+    deltas.pop_back();
+    while (!deltas.empty()) {
+        coverage = patchCoverage(coverage, deltas.back());
+        deltas.pop_back();
+    }
+    return coverage;
+}
+
+std::unordered_map<PathRef, FileStats>
+BuildHistory::loadFileStats(int buildid)
+{
+    std::unordered_map<PathRef, FileStats> stats;
+
+    if (CoveragePack *cached = getPack(buildid)) {
+        try {
+            for (PackedFile &packed : cached->loadFiles(buildid, "", false)) {
+                stats.emplace(internPath(packed.path),
+                              FileStats(packed.coveredCount,
+                                        packed.missedCount, packed.maxHits));
+            }
+            return stats;
+        } catch (const std::runtime_error &) {
+            // Fall back to reading from the database.
+            stats.clear();
+        }
+    }
+
+    for (std::tuple<int, std::string, int, int, int> vals : db.queryAll(
+            "SELECT fileid, path, covered, missed, maxhits "
+            "FROM files NATURAL JOIN filemap "
+            "WHERE buildid = :buildid",
+            { ":buildid"_b = buildid })) {
+        const int fileid = std::get<0>(vals);
+        const PathRef path = internPath(std::get<1>(vals));
+        if (isMigrated("filestats", fileid)) {
+            stats.emplace(path, FileStats(std::get<2>(vals), std::get<3>(vals),
+                                          std::get<4>(vals)));
+        } else if (boost::optional<File> file = loadFile(fileid)) {
+            stats.emplace(path, file->getStats());
+        } else {
+            stats.emplace(path, FileStats(0, 0, 0));
+        }
+    }
+    return stats;
+}
+
+std::map<std::string, DirStats>
+BuildHistory::loadDirStats(int buildid, const std::string &dirFilter)
+{
+    std::map<std::string, DirStats> stats;
+
+    if (!isMigrated("dirstats", buildid)) {
+        const std::string prefix = dirFilter + '/';
+        for (auto &entry : computeDirStats(loadFileStats(buildid))) {
+            const std::string &dir = entry.first;
+            if (dirFilter.empty() || dir == dirFilter ||
+                dir.compare(0U, prefix.size(), prefix) == 0) {
+                stats.emplace(dir, entry.second);
+            }
+        }
+        return stats;
+    }
+
+    // Range condition selects subdirectories and makes use of the index.
+    for (std::tuple<std::string, int, int, int, int, int> vals : db.queryAll(
+            "SELECT dir, covered, missed, owncovered, ownmissed, ownfiles "
+            "FROM dirstats "
+            "WHERE buildid = :buildid AND "
+                  "(:dir = '' OR dir = :dir OR "
+                  "(dir > :dir || '/' AND dir < :dir || '0'))",
+            { ":buildid"_b = buildid, ":dir"_b = dirFilter })) {
+        stats.emplace(std::move(std::get<0>(vals)),
+                      DirStats(std::get<1>(vals), std::get<2>(vals),
+                               std::get<3>(vals), std::get<4>(vals),
+                               std::get<5>(vals)));
+    }
+    return stats;
+}
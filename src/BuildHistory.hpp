@@ -19,13 +19,20 @@
 
 #include <boost/optional/optional_fwd.hpp>
 
+#include <array>
+#include <cstdint>
 #include <ctime>
 
 #include <map>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "CompactCoverage.hpp"
+#include "PathInterner.hpp"
+#include "coverage_codec.hpp"
+
 /**
  * @file BuildHistory.hpp
  *
@@ -33,9 +40,82 @@
  */
 
 class Build;
+class BuildCache;
 class BuildData;
+class CoveragePack;
 class DB;
+class DirStats;
 class File;
+class FileStats;
+class PathIndex;
+
+/**
+ * @brief Settings that affect how builds are stored.
+ */
+class BuildHistorySettings
+{
+public:
+    //! Make destructor virtual.
+    virtual ~BuildHistorySettings() = default;
+
+public:
+    /**
+     * @brief Retrieves maximum number of consecutive coverage differences.
+     *
+     * New coverage of a file can be stored as a difference against coverage
+     * of the same file in previous build.  Full copy is stored once chain of
+     * differences reaches this length.
+     *
+     * @returns The length, @c 0 means always storing full copies.
+     */
+    virtual int getCoverageDeltaChain() const = 0;
+
+    /**
+     * @brief Checks whether coverage pack is updated on adding builds.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    virtual bool isCoveragePackEnabled() const = 0;
+
+    /**
+     * @brief Checks whether hit counts of new builds are stored.
+     *
+     * Otherwise only state of lines (covered, missed or irrelevant) is kept,
+     * which takes much less space.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    virtual bool isHitCountStored() const = 0;
+
+    /**
+     * @brief Retrieves memory budget of cache of loaded paths and files.
+     *
+     * @returns The budget in mebibytes, @c 0 disables caching.
+     */
+    virtual int getBuildCacheSize() const = 0;
+};
+
+/**
+ * @brief Results of garbage collection.
+ */
+struct GarbageStats
+{
+    int files;    //!< Number of removed file entries.
+    int coverage; //!< Number of removed coverage entries.
+    int pages;    //!< Number of database pages given back to file system.
+};
+
+/**
+ * @brief Progress of updating rows that were stored by older versions.
+ *
+ * Rows are processed in the order of their keys.
+ */
+struct MigrationProgress
+{
+    std::string name; //!< Name of the update.
+    int position;     //!< Key of the last processed row.
+    int last;         //!< Key of the last row to process.
+};
 
 /**
  * @brief Interface used by Build class to load data lazily.
@@ -52,9 +132,9 @@ public:
      *
      * @param buildid Build ID.
      *
-     * @returns Mappings of file paths to file IDs.
+     * @returns Mappings of interned file paths to file IDs.
      */
-    virtual std::map<std::string, int> loadPaths(int buildid) = 0;
+    virtual PathMap loadPaths(int buildid) = 0;
     /**
      * @brief Loads file.
      *
@@ -63,6 +143,48 @@ public:
      * @returns File on success, empty optional otherwise.
      */
     virtual boost::optional<File> loadFile(int fileid) = 0;
+    /**
+     * @brief Loads files of a specific build at once.
+     *
+     * @param buildid Build ID.
+     * @param prefix  Only files with paths that start with it are loaded.
+     *
+     * @returns The files.
+     */
+    virtual std::vector<File> loadFiles(int buildid,
+                                        const std::string &prefix) = 0;
+    /**
+     * @brief Loads files of a specific build one at a time in order of their
+     *        paths.
+     *
+     * Files aren't kept after they were passed to the visitor.
+     *
+     * @param buildid Build ID.
+     * @param prefix  Only files with paths that start with it are loaded.
+     * @param visitor Function to call for every file.
+     */
+    virtual void
+    streamFiles(int buildid, const std::string &prefix,
+                const std::function<void(const File &)> &visitor) = 0;
+    /**
+     * @brief Queries coverage statistics of files of a specific build.
+     *
+     * @param buildid Build ID.
+     *
+     * @returns Mappings of interned file paths to their statistics.
+     */
+    virtual std::unordered_map<PathRef, FileStats>
+    loadFileStats(int buildid) = 0;
+    /**
+     * @brief Queries coverage statistics of directories of a specific build.
+     *
+     * @param buildid   Build ID.
+     * @param dirFilter Directory whose subtree is of interest.
+     *
+     * @returns Mappings of directory paths to their statistics.
+     */
+    virtual std::map<std::string, DirStats>
+    loadDirStats(int buildid, const std::string &dirFilter) = 0;
 };
 
 /**
@@ -74,15 +196,81 @@ public:
     /**
      * @brief Creates an instance with the database.
      *
-     * Updates database schema if necessary.
+     * Updates database schema if necessary, which isn't done for snapshots.
      *
      * @param db Database used as a storage.
      *
-     * @throws std::runtime_error on database with too new schema.
+     * @throws std::runtime_error on database with too new schema or snapshot
+     *                            with outdated one.
      */
     explicit BuildHistory(DB &db);
 
+    //! Not copyable, owns connection to the archive.
+    BuildHistory(const BuildHistory &rhs) = delete;
+    //! Not copy-assignable.
+    BuildHistory & operator=(const BuildHistory &rhs) = delete;
+
+    /**
+     * @brief Closes connection to the archive if it was opened.
+     */
+    ~BuildHistory();
+
 public:
+    /**
+     * @brief Applies settings to storing of new builds.
+     *
+     * @param settings Settings to apply.
+     */
+    void configure(const BuildHistorySettings &settings);
+
+    /**
+     * @brief Sets location of archive of old builds.
+     *
+     * The archive is opened only on a request of a build that is missing in
+     * the main database.
+     *
+     * @param path Path to the archive database or empty string for none.
+     */
+    void setArchivePath(const std::string &path);
+
+    /**
+     * @brief Sets location of coverage pack.
+     *
+     * Data of builds is read from the pack when it contains them and the
+     * pack is extended after adding a build if it's enabled by settings.
+     *
+     * @param path Path to the pack or empty string for none.
+     */
+    void setPackPath(const std::string &path);
+
+    /**
+     * @brief Replaces cache of loaded paths and files.
+     *
+     * The cache can be shared by several instances that use the same
+     * database.
+     *
+     * @param cache The cache.
+     */
+    void setCache(std::shared_ptr<BuildCache> cache);
+
+    /**
+     * @brief Moves builds older than the specified one to the archive.
+     *
+     * Files and coverage which aren't used by remaining builds are removed
+     * from the main database afterwards.  The last build is never moved,
+     * identifiers of builds don't change.  Builds are removed only after
+     * they were committed to the archive, so an interrupted run can be
+     * repeated.
+     *
+     * @param before Id of the first build to leave in place.
+     *
+     * @returns Number of moved builds.
+     *
+     * @throws std::runtime_error if archive path isn't set or on failure to
+     *                            update databases.
+     */
+    int archiveBuilds(int before);
+
     /**
      * @brief Makes and stores new build in the database.
      *
@@ -117,6 +305,97 @@ public:
      */
     int getPreviousBuildId(int id);
 
+    /**
+     * @brief Removes builds leaving files and coverage they used in place.
+     *
+     * Identifiers of remaining builds are not affected.
+     *
+     * @param ids Builds to remove.
+     *
+     * @throws std::runtime_error if asked to remove the last build, whose
+     *                            identifier would be reused otherwise.
+     */
+    void removeBuilds(const std::vector<int> &ids);
+
+    /**
+     * @brief Removes files and coverage not used by any of the builds.
+     *
+     * Removal is done in several transactions and is followed by incremental
+     * vacuum.
+     *
+     * @param batchSize Number of rows to remove per transaction.
+     *
+     * @returns Numbers of removed entities.
+     */
+    GarbageStats collectGarbage(int batchSize = 1000);
+
+    /**
+     * @brief Retrieves state of unfinished updates of stored data.
+     *
+     * Schema of the database is updated right away, while rows stored by
+     * older versions are updated in batches afterwards.  Data can be read and
+     * written in the meantime.
+     *
+     * @returns Progress of every update that is not yet complete.
+     */
+    std::vector<MigrationProgress> getMigrations();
+
+    /**
+     * @brief Performs a single batch of updating stored data.
+     *
+     * Each batch is a separate transaction, so the process can be interrupted
+     * and resumed at any point.
+     *
+     * @param batchSize Maximum number of rows to process.
+     *
+     * @returns @c true if a batch was processed, @c false if there is nothing
+     *          left to do.
+     */
+    bool migrate(int batchSize = 1000);
+
+    /**
+     * @brief Rewrites the database to minimize its size.
+     *
+     * Also enables incremental vacuum used by garbage collection.  Blocks
+     * all other accesses to the database while running.
+     */
+    void compact();
+
+    /**
+     * @brief Makes zstd dictionary out of recently stored coverage.
+     *
+     * The dictionary is stored, but isn't used until useDictionary() is
+     * called.
+     *
+     * @param sampleCount Maximum number of coverage entries to learn from.
+     * @param maxSize     Upper limit on size of the dictionary in bytes.
+     *
+     * @returns Id of the dictionary.
+     *
+     * @throws std::runtime_error if zstd isn't supported or on failure to
+     *                            train a dictionary.
+     */
+    std::uint32_t trainDictionary(int sampleCount, int maxSize);
+
+    /**
+     * @brief Picks dictionary for compressing coverage.
+     *
+     * New coverage is compressed with the dictionary right away, stored
+     * coverage is recompressed by migrate().
+     *
+     * @param id Id of a stored dictionary or @c 0 to not compress coverage.
+     *
+     * @throws std::runtime_error if there is no such dictionary.
+     */
+    void useDictionary(std::uint32_t id);
+
+    /**
+     * @brief Removes dictionaries that aren't used by any coverage.
+     *
+     * @returns Number of removed dictionaries.
+     */
+    int removeUnusedDictionaries();
+
     /**
      * @brief Retrieves build by its ID.
      *
@@ -143,15 +422,338 @@ public:
     std::vector<Build> getBuildsOn(const std::string &refName);
 
 private:
-    virtual std::map<std::string, int> loadPaths(int buildid) override;
+    /**
+     * @brief Writes build data into the database.
+     *
+     * @param bd Build data to write.
+     *
+     * @returns ID of build that was created.
+     */
+    int storeBuild(const BuildData &bd);
+
+    /**
+     * @brief Stores coverage unless identical one is already stored.
+     *
+     * @param coverage Coverage to store.
+     * @param prev     Id of coverage of the same file in previous build or
+     *                 @c 0.
+     *
+     * @returns Id of the coverage.
+     */
+    int storeCoverage(const std::vector<int> &coverage, int prev);
+
+    /**
+     * @brief Loads coverage by its id applying differences.
+     *
+     * @param covid Id of the coverage.
+     *
+     * @returns The coverage.
+     *
+     * @throws std::runtime_error if coverage can't be loaded.
+     */
+    std::vector<int> loadCoverage(int covid);
+
+    /**
+     * @brief Turns stored coverage data into coverage.
+     *
+     * @param data Stored data, which is either coverage or a difference.
+     * @param base Id of coverage which @p data is relative to or @c 0.
+     *
+     * @returns The coverage.
+     *
+     * @throws std::runtime_error if coverage can't be reconstructed.
+     */
+    std::vector<int> resolveCoverage(std::vector<int> data, int base);
+
+    /**
+     * @brief Retrieves contents of a stored dictionary.
+     *
+     * @param id Id of the dictionary.
+     *
+     * @returns The dictionary or empty vector if there is no such dictionary.
+     */
+    std::vector<unsigned char> loadDictionary(std::uint32_t id);
+
+    /**
+     * @brief Picks up dictionary that is currently in use.
+     *
+     * Should be done inside a transaction that writes coverage, so that
+     * dictionary can't be removed meanwhile.
+     */
+    void refreshDictionaries();
+
+    /**
+     * @brief Retrieves build history of the archive opening it if needed.
+     *
+     * @param create Whether missing archive should be created.
+     *
+     * @returns The history or @c nullptr if there is no archive.
+     */
+    BuildHistory * getArchive(bool create);
+
+    /**
+     * @brief Retrieves coverage pack opening it if needed.
+     *
+     * @param buildid Build that should be in the pack or @c 0 to accept pack
+     *                with any contents.
+     *
+     * @returns The pack or @c nullptr if it's missing or lacks the build.
+     */
+    CoveragePack * getPack(int buildid);
+
+    /**
+     * @brief Appends to coverage pack builds that are missing in it.
+     *
+     * Only the last build is written into a pack that doesn't exist yet.
+     *
+     * @throws std::runtime_error on failure to update the pack.
+     */
+    void updatePack();
+
+    /**
+     * @brief Removes coverage pack, which becomes out of date.
+     */
+    void dropPack();
+
+    /**
+     * @brief Checks whether an update of stored data has been completed.
+     *
+     * @param name Name of the update.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool isMigrated(const std::string &name) const;
+
+    /**
+     * @brief Checks whether an update of stored data has processed a row.
+     *
+     * @param name Name of the update.
+     * @param key  Key of the row.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool isMigrated(const std::string &name, int key) const;
+
+    /**
+     * @brief Lists obsolete columns of files table that need values.
+     *
+     * @returns Comma-terminated list of columns or an empty string.
+     */
+    std::string legacyColumns() const;
+
+    /**
+     * @brief Lists values of obsolete columns of files table.
+     *
+     * @returns Comma-terminated list of values or an empty string.
+     */
+    std::string legacyValues() const;
+
+    /**
+     * @brief Retrieves expression that yields coverage data of a file.
+     *
+     * @returns The expression.
+     */
+    std::string coverageSource() const;
+
+    /**
+     * @brief Retrieves join of files and their coverage.
+     *
+     * @returns Table expression.
+     */
+    std::string filesWithCoverage() const;
+
+    /**
+     * @brief Constructs a file computing its statistics if they aren't set.
+     *
+     * @param fileid   Id of the file.
+     * @param path     Path of the file.
+     * @param hash     Hash of the file.
+     * @param coverage Coverage of the file.
+     * @param stats    Stored statistics of the file.
+     *
+     * @returns The file.
+     */
+    File makeFile(int fileid, std::string path, std::string hash,
+                  std::vector<int> coverage, const FileStats &stats);
+
+    /**
+     * @brief Queries paths of a build bypassing the cache.
+     *
+     * @param buildid Build ID.
+     * @param cached  Coverage pack that was already retrieved or @c nullptr.
+     *
+     * @returns Mappings of interned file paths to file IDs.
+     */
+    PathMap queryPaths(int buildid, CoveragePack *cached);
+
+    /**
+     * @brief Reads file from coverage pack or database bypassing the cache.
+     *
+     * Pack is taken as an argument to not check it for changes on every file
+     * when many of them are read.
+     *
+     * @param fileid File ID.
+     * @param cached Coverage pack that was already retrieved or @c nullptr.
+     *
+     * @returns File on success, empty optional otherwise.
+     */
+    boost::optional<File> readFile(int fileid, CoveragePack *cached);
+
+private:
+    virtual PathMap loadPaths(int buildid) override;
     virtual boost::optional<File> loadFile(int fileid) override;
+    virtual std::vector<File> loadFiles(int buildid,
+                                        const std::string &prefix) override;
+    virtual void
+    streamFiles(int buildid, const std::string &prefix,
+                const std::function<void(const File &)> &visitor) override;
+    virtual std::unordered_map<PathRef, FileStats>
+    loadFileStats(int buildid) override;
+    virtual std::map<std::string, DirStats>
+    loadDirStats(int buildid, const std::string &dirFilter) override;
 
 private:
     DB &db; //!< Reference to database, which stores build history.
+    //! Maximum number of consecutive coverage differences.
+    int maxDeltaChain = 0;
+    //! Whether coverage pack is updated on adding builds.
+    bool packEnabled = false;
+    //! Whether hit counts of new builds are stored.
+    bool storeHits = true;
+    //! Path to the coverage pack or empty string.
+    std::string packPath;
+    //! Coverage pack, opened on first use.
+    std::shared_ptr<CoveragePack> pack;
+    //! Cache of loaded paths and files.
+    std::shared_ptr<BuildCache> cache;
+    //! Path to the archive database or empty string.
+    std::string archivePath;
+    //! Connection to the archive, opened on first use.
+    std::unique_ptr<DB> archiveDB;
+    //! Build history of the archive, created on first use.
+    std::unique_ptr<BuildHistory> archive;
+    //! Updates of stored data that weren't complete on opening.
+    std::vector<MigrationProgress> migrations;
+    //! Whether files table has obsolete columns for coverage.
+    bool legacyFiles;
+    //! Dictionaries for compressing coverage.
+    CoverageDictionaries dictionaries;
+};
+
+/**
+ * @brief Summary of coverage of a file, which is available without loading it.
+ */
+class FileStats
+{
+public:
+    /**
+     * @brief Computes statistics of coverage.
+     *
+     * @param coverage Per-line coverage information.
+     */
+    explicit FileStats(const std::vector<int> &coverage);
+
+    /**
+     * @brief Constructs statistics from precomputed values.
+     *
+     * @param coveredCount @copybrief coveredCount
+     * @param missedCount  @copybrief missedCount
+     * @param maxHits      @copybrief maxHits
+     */
+    FileStats(int coveredCount, int missedCount, int maxHits);
+
+public:
+    /**
+     * @brief Retrieves number of covered lines.
+     *
+     * @returns The number.
+     */
+    int getCoveredCount() const;
+    /**
+     * @brief Retrieves number of lines that weren't covered.
+     *
+     * @returns The number.
+     */
+    int getMissedCount() const;
+    /**
+     * @brief Retrieves largest number of hits of a line.
+     *
+     * @returns The number.
+     */
+    int getMaxHits() const;
+
+private:
+    int coveredCount; //!< Number of covered lines.
+    int missedCount;  //!< Number of missed lines.
+    int maxHits;      //!< Largest number of hits of a line.
+};
+
+/**
+ * @brief Summary of coverage of a directory.
+ *
+ * Covers all files in the directory, including those in its subdirectories.
+ * Files that reside directly in the directory are also accounted separately.
+ */
+class DirStats
+{
+public:
+    /**
+     * @brief Constructs statistics from precomputed values.
+     *
+     * @param coveredCount    @copybrief coveredCount
+     * @param missedCount     @copybrief missedCount
+     * @param ownCoveredCount @copybrief ownCoveredCount
+     * @param ownMissedCount  @copybrief ownMissedCount
+     * @param ownFileCount    @copybrief ownFileCount
+     */
+    DirStats(int coveredCount, int missedCount,
+             int ownCoveredCount, int ownMissedCount, int ownFileCount);
+
+public:
+    /**
+     * @brief Retrieves number of covered lines in the subtree.
+     *
+     * @returns The number.
+     */
+    int getCoveredCount() const;
+    /**
+     * @brief Retrieves number of lines in the subtree that weren't covered.
+     *
+     * @returns The number.
+     */
+    int getMissedCount() const;
+    /**
+     * @brief Retrieves number of covered lines in files of the directory.
+     *
+     * @returns The number.
+     */
+    int getOwnCoveredCount() const;
+    /**
+     * @brief Retrieves number of missed lines in files of the directory.
+     *
+     * @returns The number.
+     */
+    int getOwnMissedCount() const;
+    /**
+     * @brief Retrieves number of files directly in the directory.
+     *
+     * @returns The number.
+     */
+    int getOwnFileCount() const;
+
+private:
+    int coveredCount;    //!< Number of covered lines in the subtree.
+    int missedCount;     //!< Number of missed lines in the subtree.
+    int ownCoveredCount; //!< Number of covered lines in own files.
+    int ownMissedCount;  //!< Number of missed lines in own files.
+    int ownFileCount;    //!< Number of files directly in the directory.
 };
 
 /**
  * @brief Represents information about a single file.
+ *
+ * Path is interned and coverage is shared by copies of the file, coverage is
+ * stored in compact form and MD5 hash in binary form.
  */
 class File
 {
@@ -165,6 +767,17 @@ public:
      */
     File(std::string path, std::string hash, std::vector<int> coverage);
 
+    /**
+     * @brief Constructs file from its data and precomputed statistics.
+     *
+     * @param path     Path to the file.
+     * @param hash     MD5 hash of contents of the file.
+     * @param coverage Per-line coverage information.
+     * @param stats    Statistics that match @p coverage.
+     */
+    File(std::string path, std::string hash, std::vector<int> coverage,
+         const FileStats &stats);
+
 public:
     /**
      * @brief Retrieves path to the file within repository.
@@ -172,12 +785,18 @@ public:
      * @returns The path.
      */
     const std::string & getPath() const;
+    /**
+     * @brief Retrieves interned path to the file within repository.
+     *
+     * @returns Reference to the path.
+     */
+    PathRef getPathRef() const;
     /**
      * @brief Retrieves MD5 hash of contents of the file.
      *
      * @returns The hash.
      */
-    const std::string & getHash() const;
+    std::string getHash() const;
     /**
      * @brief Retrieves per-line coverage information.
      *
@@ -186,7 +805,7 @@ public:
      *
      * @returns The coverage information.
      */
-    const std::vector<int> & getCoverage() const;
+    const CompactCoverage & getCoverage() const;
     /**
      * @brief Retrieves number of covered lines.
      *
@@ -199,13 +818,39 @@ public:
      * @returns The number.
      */
     int getMissedCount() const;
+    /**
+     * @brief Retrieves largest number of hits of a line.
+     *
+     * @returns The number.
+     */
+    int getMaxHits() const;
+    /**
+     * @brief Retrieves statistics of the file.
+     *
+     * @returns The statistics.
+     */
+    const FileStats & getStats() const;
+    /**
+     * @brief Estimates amount of memory used by the file.
+     *
+     * Shared data is accounted as if it's not shared, except for the path
+     * which belongs to the global table.
+     *
+     * @returns The estimate in bytes.
+     */
+    std::size_t getMemoryUsage() const;
 
 private:
-    std::string path;          //!< Path to the file in repository.
-    std::string hash;          //!< MD5 hash of the file.
-    std::vector<int> coverage; //!< Per-line number of hits.
-    int coveredCount;          //!< Number of covered lines.
-    int missedCount;           //!< Number of missed lines.
+    //! Interned path to the file in repository.
+    PathRef path;
+    //! MD5 hash of the file in binary form.
+    std::array<unsigned char, 16> md5;
+    //! Hash of the file if it's not a lowercase hexadecimal MD5 or nullptr.
+    std::shared_ptr<const std::string> otherHash;
+    //! Per-line number of hits.
+    std::shared_ptr<const CompactCoverage> coverage;
+    //! Summary of the coverage.
+    FileStats stats;
 };
 
 /**
@@ -215,15 +860,8 @@ private:
  */
 class BuildData
 {
-    /**
-     * @brief Writes build data into the database.
-     *
-     * @param db Reference to the database, which acts as a storage.
-     * @param bd Build data to write.
-     *
-     * @returns ID of build that was created.
-     */
-    friend int operator<<(DB &db, const BuildData &bd);
+    //! Build history writes build data into the database.
+    friend class BuildHistory;
 
 public:
     /**
@@ -245,7 +883,7 @@ public:
 private:
     const std::string ref;                       //!< Ref name as an ID.
     const std::string refName;                   //!< Symbolic ref name.
-    std::unordered_map<std::string, File> files; //!< Files of the build.
+    std::unordered_map<PathRef, File> files;     //!< Files of the build.
 };
 
 /**
@@ -263,10 +901,12 @@ public:
      * @param coveredCount @copybrief coveredCount
      * @param missedCount  @copybrief missedCount
      * @param timestamp    @copybrief timestamp
+     * @param hitCounts    @copybrief hitCounts
      * @param loader       @copybrief loader
      */
     Build(int id, std::string ref, std::string refName,
-          int coveredCount, int missedCount, int timestamp, DataLoader &loader);
+          int coveredCount, int missedCount, int timestamp, bool hitCounts,
+          DataLoader &loader);
 
 public:
     /**
@@ -293,6 +933,14 @@ public:
      * @returns The timestamp.
      */
     std::time_t getTimestamp() const;
+    /**
+     * @brief Checks whether coverage of the build has hit counts.
+     *
+     * Coverage of builds without hit counts has @c 1 for covered lines.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool hasHitCounts() const;
     /**
      * @brief Retrieves total number of covered lines.
      *
@@ -311,6 +959,26 @@ public:
      * @returns The paths.
      */
     std::vector<std::string> getPaths() const;
+    /**
+     * @brief Retrieves index of paths of the build.
+     *
+     * The index is shared by copies of the build.
+     *
+     * @returns The index.
+     */
+    const PathIndex & getPathIndex() const;
+    /**
+     * @brief Checks whether ids of files of two builds come from the same
+     *        database.
+     *
+     * Archived files get new ids, so only when this holds equal ids of files
+     * mean the same file.
+     *
+     * @param other The other build.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool sharesFileIds(const Build &other) const;
     /**
      * @brief Retrieves file by its path.
      *
@@ -319,6 +987,57 @@ public:
      * @returns Object with information about the file or nothing on error.
      */
     boost::optional<File &> getFile(const std::string &path) const;
+    /**
+     * @brief Loads files of the build in bulk to avoid querying them one by
+     *        one when most of them are about to be accessed.
+     *
+     * @param dirFilter Files outside of this directory might not be loaded.
+     */
+    void prefetchFiles(const std::string &dirFilter = std::string()) const;
+    /**
+     * @brief Loads file by its path without keeping it in the build.
+     *
+     * Unlike getFile(), this doesn't accumulate files when many of them are
+     * processed one after another.
+     *
+     * @param path Path to look up.
+     *
+     * @returns The file or nothing on error.
+     */
+    boost::optional<File> loadFile(const std::string &path) const;
+    /**
+     * @brief Visits files of a directory in order of their paths.
+     *
+     * Files are read from a single query one at a time and aren't kept by the
+     * build, so memory use is bounded by the largest file rather than by the
+     * whole build.
+     *
+     * @param dirFilter Directory whose subtree is of interest, empty string
+     *                  means the whole build.
+     * @param visitor   Function to call for every file.
+     */
+    void forEachFile(const std::string &dirFilter,
+                     const std::function<void(const File &)> &visitor) const;
+    /**
+     * @brief Retrieves statistics of a file without loading the file.
+     *
+     * @param path Path to look up.
+     *
+     * @returns The statistics or nothing if there is no such file.
+     */
+    boost::optional<const FileStats &>
+    getFileStats(const std::string &path) const;
+    /**
+     * @brief Retrieves statistics of directories of the build.
+     *
+     * Root directory is represented by an empty string.
+     *
+     * @param dirFilter Directory whose subtree is of interest.
+     *
+     * @returns Mappings of directory paths to their statistics.
+     */
+    std::map<std::string, DirStats>
+    getDirStats(const std::string &dirFilter = std::string()) const;
 
 private:
     int id;                //!< Build ID.
@@ -327,9 +1046,12 @@ private:
     int coveredCount;      //!< Total number of covered lines.
     int missedCount;       //!< Total number of missed lines.
     std::time_t timestamp; //!< When the build was performed.
+    bool hitCounts;        //!< Whether coverage has hit counts.
     DataLoader *loader;    //!< Reference to loader of file and path data.
-    mutable std::map<std::string, int> pathMap;          //!< Cached paths.
-    mutable std::unordered_map<std::string, File> files; //!< Cached files.
+    mutable std::shared_ptr<const PathIndex> pathIndex;  //!< Cached paths.
+    mutable std::unordered_map<int, File> files;         //!< Cached files.
+    //! Cached statistics.
+    mutable std::unordered_map<PathRef, FileStats> stats;
 };
 
 #endif // UNCOV_BUILDHISTORY_HPP_
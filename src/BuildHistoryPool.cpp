@@ -0,0 +1,142 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "BuildHistoryPool.hpp"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "BuildCache.hpp"
+#include "BuildHistory.hpp"
+#include "DB.hpp"
+
+/**
+ * @brief Database connection along with build history that uses it.
+ */
+class BuildHistoryPool::Connection
+{
+public:
+    /**
+     * @brief Opens database in read-only mode.
+     *
+     * @param dbPath      Path to the database.
+     * @param archivePath Path to the archive of old builds or empty string.
+     * @param packPath    Path to the coverage pack or empty string.
+     * @param settings    Settings for database connection.
+     * @param cache       Cache of loaded paths and files.
+     * @param profile     Profile to record statements into or @c nullptr.
+     */
+    Connection(const std::string &dbPath, const std::string &archivePath,
+               const std::string &packPath, const DBSettings &settings,
+               std::shared_ptr<BuildCache> cache, DBProfile *profile)
+        : db(dbPath, DBMode::ReadOnly), bh(db)
+    {
+        db.configure(settings);
+        db.setProfile(profile);
+        bh.setArchivePath(archivePath);
+        bh.setPackPath(packPath);
+        bh.setCache(std::move(cache));
+    }
+
+public:
+    DB db;           //!< Database connection.
+    BuildHistory bh; //!< Build history that uses the connection.
+};
+
+BuildHistoryPool::BuildHistoryPool(const std::string &dbPath,
+                                   const std::string &archivePath,
+                                   const std::string &packPath,
+                                   const DBSettings &settings, int size,
+                                   DBProfile *profile)
+{
+    if (size <= 0) {
+        throw std::invalid_argument("Size of connection pool must be "
+                                    "positive, got: " + std::to_string(size));
+    }
+
+    // Budget is set by configure().
+    cache = std::make_shared<BuildCache>(0U);
+
+    connections.reserve(size);
+    idle.reserve(size);
+    for (int i = 0; i < size; ++i) {
+        connections.emplace_back(new Connection(dbPath, archivePath, packPath,
+                                                settings, cache, profile));
+        idle.push_back(connections.back().get());
+    }
+}
+
+BuildHistoryPool::~BuildHistoryPool() = default;
+
+void
+BuildHistoryPool::configure(const BuildHistorySettings &settings)
+{
+    for (const std::unique_ptr<Connection> &connection : connections) {
+        connection->bh.configure(settings);
+    }
+}
+
+BuildHistoryPool::Handle
+BuildHistoryPool::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    available.wait(lock, [this]() { return !idle.empty(); });
+
+    Connection *const connection = idle.back();
+    idle.pop_back();
+    return Handle(*this, *connection);
+}
+
+void
+BuildHistoryPool::release(Connection *connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(connection);
+    }
+    available.notify_one();
+}
+
+BuildHistoryPool::Handle::Handle(BuildHistoryPool &pool,
+                                 Connection &connection)
+    : pool(&pool), connection(&connection)
+{
+}
+
+BuildHistoryPool::Handle::Handle(Handle &&rhs)
+    : pool(rhs.pool), connection(rhs.connection)
+{
+    rhs.connection = nullptr;
+}
+
+BuildHistoryPool::Handle::~Handle()
+{
+    if (connection != nullptr) {
+        pool->release(connection);
+    }
+}
+
+BuildHistory *
+BuildHistoryPool::Handle::get() const
+{
+    return &connection->bh;
+}
@@ -0,0 +1,183 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef UNCOV_BUILDHISTORYPOOL_HPP_
+#define UNCOV_BUILDHISTORYPOOL_HPP_
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @file BuildHistoryPool.hpp
+ *
+ * @brief This unit provides pool of read-only build histories.
+ */
+
+class BuildCache;
+class BuildHistory;
+class BuildHistorySettings;
+class DBProfile;
+class DBSettings;
+
+/**
+ * @brief Fixed-size pool of build histories backed by separate connections.
+ *
+ * Allows concurrent threads to query the same database without sharing
+ * connection objects between them.  Loaded paths and files are cached once
+ * for all connections.
+ */
+class BuildHistoryPool
+{
+    class Connection;
+
+public:
+    class Handle;
+
+public:
+    /**
+     * @brief Opens database the specified number of times in read-only mode.
+     *
+     * @param dbPath      Path to the database.
+     * @param archivePath Path to the archive of old builds or empty string.
+     * @param packPath    Path to the coverage pack or empty string.
+     * @param settings    Settings for database connections.
+     * @param size        Number of connections.
+     * @param profile     Profile shared by all connections, which must
+     *                    outlive the pool, or @c nullptr to disable
+     *                    profiling.
+     *
+     * @throws std::invalid_argument if @p size isn't positive.
+     * @throws std::runtime_error on failure to open the database.
+     */
+    BuildHistoryPool(const std::string &dbPath,
+                     const std::string &archivePath,
+                     const std::string &packPath,
+                     const DBSettings &settings, int size,
+                     DBProfile *profile = nullptr);
+
+    //! Not copyable, handles refer back to the pool.
+    BuildHistoryPool(const BuildHistoryPool &rhs) = delete;
+    //! Not copy-assignable.
+    BuildHistoryPool & operator=(const BuildHistoryPool &rhs) = delete;
+
+    /**
+     * @brief Closes all connections.
+     *
+     * No handles should be alive at this point.
+     */
+    ~BuildHistoryPool();
+
+public:
+    /**
+     * @brief Applies settings to all build histories of the pool.
+     *
+     * Should be done before any of them is acquired.
+     *
+     * @param settings Settings to apply.
+     */
+    void configure(const BuildHistorySettings &settings);
+
+    /**
+     * @brief Takes build history out of the pool.
+     *
+     * Blocks until one becomes available if all of them are in use.
+     *
+     * @returns Handle that puts build history back on destruction.
+     */
+    Handle acquire();
+
+private:
+    /**
+     * @brief Puts connection back into the pool and wakes up a waiter.
+     *
+     * @param connection Connection that is no longer in use.
+     */
+    void release(Connection *connection);
+
+private:
+    //! Cache shared by all connections.
+    std::shared_ptr<BuildCache> cache;
+    //! All connections owned by the pool.
+    std::vector<std::unique_ptr<Connection>> connections;
+    //! Connections that aren't in use at the moment.
+    std::vector<Connection *> idle;
+    //! Protects list of idle connections.
+    std::mutex mutex;
+    //! Signaled when a connection is returned to the pool.
+    std::condition_variable available;
+};
+
+/**
+ * @brief RAII handle to build history taken out of the pool.
+ */
+class BuildHistoryPool::Handle
+{
+    friend class BuildHistoryPool;
+
+    /**
+     * @brief Initializes handle.
+     *
+     * @param pool       @copybrief pool
+     * @param connection @copybrief connection
+     */
+    Handle(BuildHistoryPool &pool, Connection &connection);
+
+public:
+    /**
+     * @brief Takes ownership of connection from another handle.
+     *
+     * @param rhs Handle to move from.
+     */
+    Handle(Handle &&rhs);
+
+    //! Not copyable.
+    Handle(const Handle &rhs) = delete;
+    //! Not assignable.
+    Handle & operator=(const Handle &rhs) = delete;
+
+    /**
+     * @brief Returns build history back to the pool.
+     */
+    ~Handle();
+
+public:
+    /**
+     * @brief Retrieves build history.
+     *
+     * @returns Pointer to build history.
+     */
+    BuildHistory * get() const;
+
+    /**
+     * @brief Accesses build history.
+     *
+     * @returns Pointer to build history.
+     */
+    BuildHistory * operator->() const
+    {
+        return get();
+    }
+
+private:
+    BuildHistoryPool *pool; //!< Pool that owns the connection.
+    Connection *connection; //!< Connection in use or @c nullptr.
+};
+
+#endif // UNCOV_BUILDHISTORYPOOL_HPP_
@@ -0,0 +1,175 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "CompactCoverage.hpp"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+
+#include <initializer_list>
+#include <vector>
+
+//! Number of lines described by a single word of states.
+static const std::size_t LinesPerWord = 32U;
+//! Number of words of states per element of ranks.
+static const std::size_t WordsPerRank = 4U;
+
+//! State of irrelevant line.
+static const unsigned IrrelevantState = 0U;
+//! State of missed line.
+static const unsigned MissedState = 1U;
+//! State of line that was hit once.
+static const unsigned HitOnceState = 2U;
+//! State of line whose value is stored separately.
+static const unsigned OtherState = 3U;
+
+/**
+ * @brief Marks lines of other state within a word of states.
+ *
+ * @param bits Word of states.
+ *
+ * @returns Word with lower bit of each pair of bits set for such lines.
+ */
+static std::uint64_t
+getOtherLines(std::uint64_t bits)
+{
+    return bits & (bits >> 1U) & UINT64_C(0x5555555555555555);
+}
+
+CompactCoverage::CompactCoverage() : lineCount(0U)
+{
+}
+
+CompactCoverage::CompactCoverage(const std::vector<int> &coverage)
+    : lineCount(0U)
+{
+    states.reserve((coverage.size() + LinesPerWord - 1U)/LinesPerWord);
+    for (int hits : coverage) {
+        append(hits);
+    }
+
+    // Ranks aren't needed if there is nothing to look up.
+    if (others.empty()) {
+        ranks.clear();
+    }
+
+    states.shrink_to_fit();
+    ranks.shrink_to_fit();
+    others.shrink_to_fit();
+}
+
+CompactCoverage::CompactCoverage(std::initializer_list<int> coverage)
+    : CompactCoverage(std::vector<int>(coverage))
+{
+}
+
+void
+CompactCoverage::append(int hits)
+{
+    if (lineCount%LinesPerWord == 0U) {
+        if (states.size()%WordsPerRank == 0U) {
+            ranks.push_back(others.size());
+        }
+        states.push_back(0U);
+    }
+
+    unsigned state;
+    switch (hits) {
+        case -1: state = IrrelevantState; break;
+        case 0:  state = MissedState; break;
+        case 1:  state = HitOnceState; break;
+        default:
+            state = OtherState;
+            others.push_back(hits);
+            break;
+    }
+
+    states.back() |= std::uint64_t(state) << 2U*(lineCount%LinesPerWord);
+    ++lineCount;
+}
+
+bool
+CompactCoverage::operator==(const CompactCoverage &rhs) const
+{
+    return lineCount == rhs.lineCount
+        && states == rhs.states
+        && others == rhs.others;
+}
+
+int
+CompactCoverage::operator[](std::size_t line) const
+{
+    const std::size_t word = line/LinesPerWord;
+    const std::size_t shift = 2U*(line%LinesPerWord);
+    const std::uint64_t bits = states[word];
+
+    switch ((bits >> shift) & 3U) {
+        case IrrelevantState: return -1;
+        case MissedState:     return 0;
+        case HitOnceState:    return 1;
+    }
+
+    // Rank accounts for several words, lines of other state in words in
+    // between and then in this word before the line are counted explicitly.
+    std::size_t idx = ranks[word/WordsPerRank];
+    for (std::size_t i = word - word%WordsPerRank; i < word; ++i) {
+        idx += std::bitset<64>(getOtherLines(states[i])).count();
+    }
+    const std::uint64_t before = (UINT64_C(1) << shift) - 1U;
+    idx += std::bitset<64>(getOtherLines(bits) & before).count();
+    return others[idx];
+}
+
+CompactCoverage::const_iterator
+CompactCoverage::begin() const
+{
+    return const_iterator(this, 0U);
+}
+
+CompactCoverage::const_iterator
+CompactCoverage::end() const
+{
+    return const_iterator(this, lineCount);
+}
+
+CompactCoverage::const_iterator
+CompactCoverage::cbegin() const
+{
+    return begin();
+}
+
+CompactCoverage::const_iterator
+CompactCoverage::cend() const
+{
+    return end();
+}
+
+std::vector<int>
+CompactCoverage::toVector() const
+{
+    return std::vector<int>(begin(), end());
+}
+
+std::size_t
+CompactCoverage::getMemoryUsage() const
+{
+    return sizeof(*this)
+         + states.capacity()*sizeof(states[0])
+         + ranks.capacity()*sizeof(ranks[0])
+         + others.capacity()*sizeof(others[0]);
+}
@@ -0,0 +1,265 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef UNCOV_COMPACTCOVERAGE_HPP_
+#define UNCOV_COMPACTCOVERAGE_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+/**
+ * @file CompactCoverage.hpp
+ *
+ * @brief This unit provides memory-efficient storage of coverage of a file.
+ */
+
+/**
+ * @brief Read-only per-line coverage that takes a bit more than two bits per
+ *        line.
+ *
+ * Each line is stored as one of four states: irrelevant (@c -1), missed
+ * (@c 0), hit once (@c 1) or having some other value.  Values of the last
+ * kind are kept aside and found via number of such lines that precede every
+ * 128 lines, so random access takes constant time.
+ *
+ * Conversions from vectors are implicit to allow passing plain coverage
+ * wherever compact one is expected.
+ */
+class CompactCoverage
+{
+public:
+    class const_iterator;
+    //! Iterator type, elements can't be modified.
+    using iterator = const_iterator;
+
+public:
+    /**
+     * @brief Constructs empty coverage.
+     */
+    CompactCoverage();
+
+    /**
+     * @brief Constructs coverage from a vector.
+     *
+     * @param coverage Per-line coverage.
+     */
+    CompactCoverage(const std::vector<int> &coverage);
+
+    /**
+     * @brief Constructs coverage from a list of values.
+     *
+     * @param coverage Per-line coverage.
+     */
+    CompactCoverage(std::initializer_list<int> coverage);
+
+public:
+    /**
+     * @brief Compares two coverages for equality.
+     *
+     * @param rhs Other coverage.
+     *
+     * @returns @c true if they are equal, @c false otherwise.
+     */
+    bool operator==(const CompactCoverage &rhs) const;
+
+    /**
+     * @brief Compares two coverages for inequality.
+     *
+     * @param rhs Other coverage.
+     *
+     * @returns @c true if they differ, @c false otherwise.
+     */
+    bool operator!=(const CompactCoverage &rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+    /**
+     * @brief Retrieves coverage of a line.
+     *
+     * @param line Zero-based line number, must be less than size().
+     *
+     * @returns Number of hits or negative number for irrelevant line.
+     */
+    int operator[](std::size_t line) const;
+
+    /**
+     * @brief Retrieves number of lines.
+     *
+     * @returns The number.
+     */
+    std::size_t size() const
+    {
+        return lineCount;
+    }
+
+    /**
+     * @brief Checks whether there are no lines.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool empty() const
+    {
+        return lineCount == 0U;
+    }
+
+    /**
+     * @brief Retrieves iterator to the first line.
+     *
+     * @returns The iterator.
+     */
+    const_iterator begin() const;
+    /**
+     * @brief Retrieves iterator past the last line.
+     *
+     * @returns The iterator.
+     */
+    const_iterator end() const;
+    /**
+     * @brief Retrieves iterator to the first line.
+     *
+     * @returns The iterator.
+     */
+    const_iterator cbegin() const;
+    /**
+     * @brief Retrieves iterator past the last line.
+     *
+     * @returns The iterator.
+     */
+    const_iterator cend() const;
+
+    /**
+     * @brief Converts coverage back to a vector.
+     *
+     * @returns Per-line coverage.
+     */
+    std::vector<int> toVector() const;
+
+    /**
+     * @brief Estimates amount of memory used by the object.
+     *
+     * @returns The estimate in bytes.
+     */
+    std::size_t getMemoryUsage() const;
+
+private:
+    /**
+     * @brief Appends coverage of a line.
+     *
+     * @param hits Coverage of the line.
+     */
+    void append(int hits);
+
+private:
+    std::size_t lineCount;              //!< Number of lines.
+    std::vector<std::uint64_t> states;  //!< Two bits per line.
+    std::vector<std::uint32_t> ranks;   //!< Number of other values before
+                                        //!< every four words of states.
+    std::vector<int> others;            //!< Other values in order of lines.
+};
+
+/**
+ * @brief Iterator over lines of compact coverage.
+ */
+class CompactCoverage::const_iterator
+{
+public:
+    //! Category of the iterator.
+    using iterator_category = std::random_access_iterator_tag;
+    //! Type of elements.
+    using value_type = int;
+    //! Type of difference between iterators.
+    using difference_type = std::ptrdiff_t;
+    //! Type of pointer to an element.
+    using pointer = const int *;
+    //! Elements are produced on dereferencing.
+    using reference = int;
+
+public:
+    /**
+     * @brief Constructs iterator.
+     *
+     * @param coverage @copybrief coverage
+     * @param line     @copybrief line
+     */
+    const_iterator(const CompactCoverage *coverage, std::size_t line)
+        : coverage(coverage), line(line)
+    {
+    }
+
+public:
+    //! Retrieves coverage of current line.
+    int operator*() const { return (*coverage)[line]; }
+    //! Retrieves coverage of a line relative to current one.
+    int operator[](difference_type n) const { return (*coverage)[line + n]; }
+
+    //! Advances to the next line.
+    const_iterator & operator++() { ++line; return *this; }
+    //! Advances to the next line.
+    const_iterator operator++(int) { return { coverage, line++ }; }
+    //! Moves to the previous line.
+    const_iterator & operator--() { --line; return *this; }
+    //! Moves to the previous line.
+    const_iterator operator--(int) { return { coverage, line-- }; }
+    //! Advances by several lines.
+    const_iterator & operator+=(difference_type n) { line += n; return *this; }
+    //! Moves back by several lines.
+    const_iterator & operator-=(difference_type n) { line -= n; return *this; }
+
+    //! Retrieves iterator advanced by several lines.
+    const_iterator operator+(difference_type n) const
+    {
+        return { coverage, line + n };
+    }
+    //! Retrieves iterator moved back by several lines.
+    const_iterator operator-(difference_type n) const
+    {
+        return { coverage, line - n };
+    }
+    //! Computes distance between two iterators.
+    difference_type operator-(const const_iterator &rhs) const
+    {
+        return static_cast<difference_type>(line)
+             - static_cast<difference_type>(rhs.line);
+    }
+
+    //! Checks whether iterators point to the same line.
+    bool operator==(const const_iterator &rhs) const
+    {
+        return line == rhs.line;
+    }
+    //! Checks whether iterators point to different lines.
+    bool operator!=(const const_iterator &rhs) const
+    {
+        return line != rhs.line;
+    }
+    //! Checks whether this iterator precedes the other one.
+    bool operator<(const const_iterator &rhs) const
+    {
+        return line < rhs.line;
+    }
+
+private:
+    const CompactCoverage *coverage; //!< Coverage being iterated over.
+    std::size_t line;                //!< Current line.
+};
+
+#endif // UNCOV_COMPACTCOVERAGE_HPP_
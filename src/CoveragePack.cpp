@@ -0,0 +1,534 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "CoveragePack.hpp"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace ip = boost::interprocess;
+
+namespace {
+
+//! Identifies pack files.
+const char PackMagic[8] = { 'U', 'N', 'C', 'O', 'V', 'P', 'A', 'K' };
+//! Version of layout of the file.
+const std::uint32_t PackVersion = 1U;
+//! Value that reads differently on machines with different byte order.
+const std::uint32_t ByteOrderMark = 0x01020304U;
+//! Marks start of a segment.
+const std::uint32_t SegmentMagic = 0x53564f43U;
+
+/**
+ * @brief Header at the beginning of the file.
+ */
+struct PackHeader
+{
+    char magic[8];           //!< Equals to PackMagic.
+    std::uint32_t version;   //!< Equals to PackVersion.
+    std::uint32_t byteOrder; //!< Equals to ByteOrderMark.
+};
+
+/**
+ * @brief Header of a segment, which holds files of a single build.
+ *
+ * It's followed by array of file records ordered by path, array of indexes of
+ * those records ordered by id of a file, paths with hashes and coverage.
+ */
+struct SegmentHeader
+{
+    std::uint32_t magic;    //!< Equals to SegmentMagic.
+    std::int32_t buildid;   //!< Id of the build.
+    std::uint32_t nFiles;   //!< Number of file records.
+    std::int32_t minFileid; //!< Smallest file id in the segment.
+    std::int32_t maxFileid; //!< Largest file id in the segment.
+    std::uint32_t padding;  //!< Keeps the size aligned.
+    std::uint64_t size;     //!< Size of the whole segment.
+};
+
+/**
+ * @brief Fixed-size description of a file.
+ *
+ * Offsets are relative to the beginning of the file.
+ */
+struct FileRecord
+{
+    std::uint64_t strings;  //!< Offset of path, which is followed by hash.
+    std::uint64_t coverage; //!< Offset of array of hits.
+    std::int64_t covHash;   //!< Hash of coverage in the database.
+    std::uint32_t pathLen;  //!< Length of the path.
+    std::uint32_t hashLen;  //!< Length of the hash.
+    std::uint32_t lines;    //!< Number of elements in coverage array.
+    std::int32_t fileid;    //!< Id of the file in the database.
+    std::int32_t covered;   //!< Number of covered lines.
+    std::int32_t missed;    //!< Number of lines that weren't covered.
+    std::int32_t maxHits;   //!< Largest number of hits of a line.
+    std::uint32_t padding;  //!< Keeps the size aligned.
+};
+
+static_assert(sizeof(int) == sizeof(std::int32_t),
+              "Coverage is stored as an array of 32-bit integers.");
+static_assert(sizeof(PackHeader) == 16U, "Pack header has wrong size.");
+static_assert(sizeof(SegmentHeader) == 32U, "Segment header has wrong size.");
+static_assert(sizeof(FileRecord) == 56U, "File record has wrong size.");
+
+/**
+ * @brief Previously stored coverage that can be referenced.
+ */
+struct StoredCoverage
+{
+    std::uint64_t offset; //!< Offset of coverage in the file.
+    const char *data;     //!< Contents of the coverage.
+    std::uint32_t lines;  //!< Number of lines in the coverage.
+};
+
+}
+
+/**
+ * @brief Reads possibly unaligned value of a trivial type.
+ *
+ * @tparam T Type of the value.
+ *
+ * @param data   Beginning of the data.
+ * @param offset Offset of the value.
+ *
+ * @returns The value.
+ */
+template <typename T>
+static T
+readAt(const char *data, std::uint64_t offset)
+{
+    T value;
+    std::memcpy(&value, data + offset, sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Appends bytes of a trivial value to a buffer.
+ *
+ * @tparam T Type of the value.
+ *
+ * @param buf   Buffer to append to.
+ * @param value The value.
+ */
+template <typename T>
+static void
+putRaw(std::string &buf, const T &value)
+{
+    buf.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+CoveragePack::CoveragePack(std::string path) : path(std::move(path))
+{
+    map();
+}
+
+void
+CoveragePack::append(const std::string &path, int buildid,
+                     const std::vector<PackedFile> &files)
+{
+    // Make sure there is a file to lock.
+    if (!std::ofstream(path, std::ios::binary | std::ios::app)) {
+        throw std::runtime_error("Failed to create coverage pack: " + path);
+    }
+
+    ip::file_lock lock;
+    try {
+        ip::file_lock(path.c_str()).swap(lock);
+    } catch (const ip::interprocess_exception &e) {
+        throw std::runtime_error("Failed to lock coverage pack " + path +
+                                 ": " + e.what());
+    }
+    ip::scoped_lock<ip::file_lock> guard(lock);
+
+    std::unique_ptr<CoveragePack> pack;
+    try {
+        pack.reset(new CoveragePack(path));
+    } catch (const std::runtime_error &) {
+        // The file is empty or has unsupported format, it's written anew.
+    }
+
+    if (pack && pack->hasBuild(buildid)) {
+        return;
+    }
+
+    const std::uint64_t start = (pack ? pack->validSize : 0U);
+
+    std::string buf;
+    if (!pack) {
+        PackHeader header = { };
+        std::memcpy(header.magic, PackMagic, sizeof(header.magic));
+        header.version = PackVersion;
+        header.byteOrder = ByteOrderMark;
+        putRaw(buf, header);
+    }
+
+    // Coverage rarely changes between consecutive builds, so files of the
+    // previous one are good enough for deduplication.
+    std::unordered_map<std::int64_t, std::vector<StoredCoverage>> known;
+    if (pack && !pack->segments.empty()) {
+        const char *const data = pack->file.data();
+        const Segment &seg = pack->segments.back();
+        for (std::uint32_t i = 0U; i < seg.nFiles; ++i) {
+            const FileRecord rec = readAt<FileRecord>(data, seg.offset +
+                sizeof(SegmentHeader) + i*sizeof(FileRecord));
+            const std::uint64_t size = std::uint64_t(rec.lines)*sizeof(int);
+            if (rec.coverage <= pack->validSize &&
+                size <= pack->validSize - rec.coverage) {
+                known[rec.covHash].push_back({ rec.coverage,
+                                               data + rec.coverage,
+                                               rec.lines });
+            }
+        }
+    }
+
+    std::vector<const PackedFile *> sorted;
+    sorted.reserve(files.size());
+    for (const PackedFile &file : files) {
+        sorted.push_back(&file);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](const PackedFile *a, const PackedFile *b) {
+                  return a->path < b->path;
+              });
+
+    const std::uint32_t nFiles = sorted.size();
+    const std::uint64_t segStart = start + buf.size();
+    const std::uint64_t tablesSize = sizeof(SegmentHeader)
+        + std::uint64_t(nFiles)*(sizeof(FileRecord) + sizeof(std::uint32_t));
+
+    std::vector<FileRecord> records;
+    records.reserve(nFiles);
+    std::string strings;
+    for (const PackedFile *file : sorted) {
+        FileRecord rec = { };
+        rec.strings = segStart + tablesSize + strings.size();
+        rec.covHash = file->covHash;
+        rec.pathLen = file->path.size();
+        rec.hashLen = file->hash.size();
+        rec.lines = file->coverage.size();
+        rec.fileid = file->fileid;
+        rec.covered = file->coveredCount;
+        rec.missed = file->missedCount;
+        rec.maxHits = file->maxHits;
+        records.push_back(rec);
+
+        strings += file->path;
+        strings += file->hash;
+    }
+    strings.resize((strings.size() + 3U) & ~std::size_t(3U), '\0');
+
+    const std::uint64_t coverageStart = segStart + tablesSize + strings.size();
+    std::string coverage;
+    for (std::uint32_t i = 0U; i < nFiles; ++i) {
+        const std::vector<int> &hits = sorted[i]->coverage;
+        const std::size_t size = hits.size()*sizeof(int);
+        const char *const data = reinterpret_cast<const char *>(hits.data());
+
+        std::vector<StoredCoverage> &candidates = known[records[i].covHash];
+        auto match = std::find_if(candidates.cbegin(), candidates.cend(),
+                                  [&](const StoredCoverage &c) {
+                                      return c.lines == hits.size()
+                                          && std::memcmp(c.data, data,
+                                                         size) == 0;
+                                  });
+        if (match != candidates.cend()) {
+            records[i].coverage = match->offset;
+            continue;
+        }
+
+        records[i].coverage = coverageStart + coverage.size();
+        candidates.push_back({ records[i].coverage, data, records[i].lines });
+        coverage.append(data, size);
+    }
+
+    std::vector<std::uint32_t> byFileid(nFiles);
+    std::iota(byFileid.begin(), byFileid.end(), 0U);
+    std::sort(byFileid.begin(), byFileid.end(),
+              [&records](std::uint32_t a, std::uint32_t b) {
+                  return records[a].fileid < records[b].fileid;
+              });
+
+    SegmentHeader header = { };
+    header.magic = SegmentMagic;
+    header.buildid = buildid;
+    header.nFiles = nFiles;
+    if (nFiles != 0U) {
+        header.minFileid = records[byFileid.front()].fileid;
+        header.maxFileid = records[byFileid.back()].fileid;
+    }
+    header.size = tablesSize + strings.size() + coverage.size();
+
+    putRaw(buf, header);
+    for (const FileRecord &rec : records) {
+        putRaw(buf, rec);
+    }
+    for (std::uint32_t idx : byFileid) {
+        putRaw(buf, idx);
+    }
+    buf += strings;
+    buf += coverage;
+
+    // Unmap the file before cutting off data of an interrupted append.
+    pack.reset();
+
+    boost::system::error_code ec;
+    fs::resize_file(path, start, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to truncate coverage pack " + path +
+                                 ": " + ec.message());
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::app);
+    out.write(buf.data(), buf.size());
+    out.flush();
+    if (!out) {
+        throw std::runtime_error("Failed to write coverage pack: " + path);
+    }
+}
+
+bool
+CoveragePack::refresh()
+{
+    boost::system::error_code ec;
+    const std::uint64_t size = fs::file_size(path, ec);
+    const std::time_t mtime = fs::last_write_time(path, ec);
+    if (ec) {
+        // Pack is removed when it gets out of date.
+        throw std::runtime_error("Coverage pack was removed: " + path);
+    }
+    if (size == mappedSize && mtime == mappedTime) {
+        return false;
+    }
+
+    map();
+    return true;
+}
+
+int
+CoveragePack::getLastBuildId() const
+{
+    return builds.empty() ? 0 : builds.rbegin()->first;
+}
+
+bool
+CoveragePack::hasBuild(int buildid) const
+{
+    return builds.find(buildid) != builds.end();
+}
+
+PathMap
+CoveragePack::loadPaths(int buildid) const
+{
+    const Segment &seg = segments[builds.at(buildid)];
+
+    PathMap paths;
+    paths.reserve(seg.nFiles);
+    for (std::uint32_t i = 0U; i < seg.nFiles; ++i) {
+        const FileRecord rec = readAt<FileRecord>(file.data(), seg.offset +
+            sizeof(SegmentHeader) + i*sizeof(FileRecord));
+        checkRange(rec.strings, rec.pathLen);
+        paths.emplace(internPath(std::string(file.data() + rec.strings,
+                                             rec.pathLen)),
+                      rec.fileid);
+    }
+    return paths;
+}
+
+bool
+CoveragePack::loadFile(int fileid, PackedFile &packed) const
+{
+    // Files of newer builds are more likely to be requested.
+    for (auto it = segments.crbegin(); it != segments.crend(); ++it) {
+        const Segment &seg = *it;
+        if (seg.nFiles == 0U ||
+            fileid < seg.minFileid || fileid > seg.maxFileid) {
+            continue;
+        }
+
+        const std::uint64_t index = seg.offset + sizeof(SegmentHeader)
+                                  + seg.nFiles*sizeof(FileRecord);
+        std::uint32_t lo = 0U, hi = seg.nFiles;
+        while (lo < hi) {
+            const std::uint32_t mid = lo + (hi - lo)/2U;
+            const std::uint32_t idx = readAt<std::uint32_t>(file.data(),
+                index + mid*sizeof(std::uint32_t));
+            if (idx >= seg.nFiles) {
+                throw std::runtime_error("Corrupted coverage pack: " + path);
+            }
+
+            const FileRecord rec = readAt<FileRecord>(file.data(), seg.offset +
+                sizeof(SegmentHeader) + idx*sizeof(FileRecord));
+            if (rec.fileid == fileid) {
+                packed = readFile(seg, idx, true);
+                return true;
+            }
+            if (rec.fileid < fileid) {
+                lo = mid + 1U;
+            } else {
+                hi = mid;
+            }
+        }
+    }
+    return false;
+}
+
+std::vector<PackedFile>
+CoveragePack::loadFiles(int buildid, const std::string &prefix,
+                        bool withCoverage) const
+{
+    const Segment &seg = segments[builds.at(buildid)];
+
+    // Paths with the prefix form a contiguous range of records.
+    std::uint32_t lo = 0U, hi = seg.nFiles;
+    while (lo < hi) {
+        const std::uint32_t mid = lo + (hi - lo)/2U;
+        if (readPath(seg, mid) < prefix) {
+            lo = mid + 1U;
+        } else {
+            hi = mid;
+        }
+    }
+
+    std::vector<PackedFile> files;
+    for (std::uint32_t i = lo; i < seg.nFiles; ++i) {
+        PackedFile packed = readFile(seg, i, withCoverage);
+        if (packed.path.compare(0U, prefix.size(), prefix) != 0) {
+            break;
+        }
+        files.push_back(std::move(packed));
+    }
+    return files;
+}
+
+void
+CoveragePack::map()
+{
+    file.close();
+    segments.clear();
+    builds.clear();
+
+    boost::system::error_code ec;
+    mappedTime = fs::last_write_time(path, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to open coverage pack " + path +
+                                 ": " + ec.message());
+    }
+    const std::uint64_t size = fs::file_size(path, ec);
+    if (ec || size < sizeof(PackHeader)) {
+        throw std::runtime_error("Not a coverage pack: " + path);
+    }
+
+    try {
+        file.open(path);
+    } catch (const std::exception &e) {
+        throw std::runtime_error("Failed to map coverage pack " + path +
+                                 ": " + e.what());
+    }
+    mappedSize = file.size();
+
+    const char *const data = file.data();
+    const PackHeader header = readAt<PackHeader>(data, 0U);
+    if (std::memcmp(header.magic, PackMagic, sizeof(header.magic)) != 0 ||
+        header.version != PackVersion || header.byteOrder != ByteOrderMark) {
+        file.close();
+        throw std::runtime_error("Unsupported coverage pack: " + path);
+    }
+
+    // Scanning stops at incomplete segment of an interrupted or ongoing
+    // append.
+    std::uint64_t pos = sizeof(PackHeader);
+    while (mappedSize - pos >= sizeof(SegmentHeader)) {
+        const SegmentHeader seg = readAt<SegmentHeader>(data, pos);
+        const std::uint64_t tablesSize = sizeof(SegmentHeader)
+                                       + std::uint64_t(seg.nFiles)
+                                       *(sizeof(FileRecord) +
+                                         sizeof(std::uint32_t));
+        if (seg.magic != SegmentMagic || seg.size < tablesSize ||
+            seg.size > mappedSize - pos) {
+            break;
+        }
+
+        segments.push_back({ pos, seg.buildid, seg.nFiles, seg.minFileid,
+                             seg.maxFileid });
+        builds[seg.buildid] = segments.size() - 1U;
+        pos += seg.size;
+    }
+    validSize = pos;
+}
+
+PackedFile
+CoveragePack::readFile(const Segment &seg, std::uint32_t idx,
+                       bool withCoverage) const
+{
+    const char *const data = file.data();
+    const FileRecord rec = readAt<FileRecord>(data, seg.offset +
+        sizeof(SegmentHeader) + idx*sizeof(FileRecord));
+    checkRange(rec.strings, std::uint64_t(rec.pathLen) + rec.hashLen);
+
+    PackedFile packed;
+    packed.fileid = rec.fileid;
+    packed.path.assign(data + rec.strings, rec.pathLen);
+    packed.hash.assign(data + rec.strings + rec.pathLen, rec.hashLen);
+    packed.coveredCount = rec.covered;
+    packed.missedCount = rec.missed;
+    packed.maxHits = rec.maxHits;
+    packed.covHash = rec.covHash;
+
+    if (withCoverage) {
+        const std::uint64_t size = std::uint64_t(rec.lines)*sizeof(int);
+        checkRange(rec.coverage, size);
+        packed.coverage.resize(rec.lines);
+        std::memcpy(packed.coverage.data(), data + rec.coverage, size);
+    }
+
+    return packed;
+}
+
+std::string
+CoveragePack::readPath(const Segment &seg, std::uint32_t idx) const
+{
+    const FileRecord rec = readAt<FileRecord>(file.data(), seg.offset +
+        sizeof(SegmentHeader) + idx*sizeof(FileRecord));
+    checkRange(rec.strings, rec.pathLen);
+    return std::string(file.data() + rec.strings, rec.pathLen);
+}
+
+void
+CoveragePack::checkRange(std::uint64_t offset, std::uint64_t size) const
+{
+    if (offset > validSize || size > validSize - offset) {
+        throw std::runtime_error("Corrupted coverage pack: " + path);
+    }
+}
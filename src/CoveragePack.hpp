@@ -0,0 +1,215 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef UNCOV_COVERAGEPACK_HPP_
+#define UNCOV_COVERAGEPACK_HPP_
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <cstdint>
+#include <ctime>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PathInterner.hpp"
+
+/**
+ * @file CoveragePack.hpp
+ *
+ * @brief Sidecar file with coverage of builds in a memory-mappable form.
+ *
+ * The file is a cache of database contents, which can be removed at any time.
+ * Builds are appended as segments, which are never modified afterwards, so
+ * concurrent readers only need to remap the file to see new builds.
+ */
+
+/**
+ * @brief Single file of a build as stored in a pack.
+ */
+struct PackedFile
+{
+    int fileid;                //!< Id of the file in the database.
+    std::string path;          //!< Path to the file in repository.
+    std::string hash;          //!< MD5 hash of the file.
+    int coveredCount;          //!< Number of covered lines.
+    int missedCount;           //!< Number of lines that weren't covered.
+    int maxHits;               //!< Largest number of hits of a line.
+    std::int64_t covHash;      //!< Hash of coverage in the database.
+    std::vector<int> coverage; //!< Per-line number of hits.
+};
+
+/**
+ * @brief Read-only view of a coverage pack.
+ */
+class CoveragePack
+{
+public:
+    /**
+     * @brief Maps pack file into memory.
+     *
+     * @param path Path to the pack.
+     *
+     * @throws std::runtime_error if file is missing or isn't a valid pack.
+     */
+    explicit CoveragePack(std::string path);
+
+public:
+    /**
+     * @brief Appends build to a pack creating the pack if necessary.
+     *
+     * Does nothing if the pack already contains the build.  Incomplete data
+     * left by an interrupted append is discarded.  Coverage that's already in
+     * the pack is referenced instead of being stored again.
+     *
+     * @param path    Path to the pack.
+     * @param buildid Id of the build.
+     * @param files   Files of the build.
+     *
+     * @throws std::runtime_error on failure to update the file.
+     */
+    static void append(const std::string &path, int buildid,
+                       const std::vector<PackedFile> &files);
+
+public:
+    /**
+     * @brief Remaps the file if it has changed since it was mapped.
+     *
+     * @returns @c true if pack was remapped, @c false otherwise.
+     *
+     * @throws std::runtime_error if file was removed or became invalid.
+     */
+    bool refresh();
+
+    /**
+     * @brief Retrieves id of the last build in the pack.
+     *
+     * @returns The id or @c 0 if there are no builds.
+     */
+    int getLastBuildId() const;
+
+    /**
+     * @brief Checks whether the pack contains a build.
+     *
+     * @param buildid Id of the build.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool hasBuild(int buildid) const;
+
+    /**
+     * @brief Retrieves mapping of paths of a build to ids of its files.
+     *
+     * @param buildid Id of the build, which must be in the pack.
+     *
+     * @returns The mapping with interned paths.
+     */
+    PathMap loadPaths(int buildid) const;
+
+    /**
+     * @brief Looks up file by its id among all builds of the pack.
+     *
+     * @param fileid Id of the file.
+     * @param file   Output parameter for the file.
+     *
+     * @returns @c true if file was found, @c false otherwise.
+     *
+     * @throws std::runtime_error if file data is corrupted.
+     */
+    bool loadFile(int fileid, PackedFile &file) const;
+
+    /**
+     * @brief Retrieves files of a build whose paths start with a prefix.
+     *
+     * @param buildid      Id of the build, which must be in the pack.
+     * @param prefix       Prefix of paths, empty string matches everything.
+     * @param withCoverage Whether coverage of files should be loaded.
+     *
+     * @returns Files ordered by path.
+     *
+     * @throws std::runtime_error if file data is corrupted.
+     */
+    std::vector<PackedFile> loadFiles(int buildid, const std::string &prefix,
+                                      bool withCoverage) const;
+
+private:
+    /**
+     * @brief Location of a build within the file.
+     */
+    struct Segment
+    {
+        std::uint64_t offset; //!< Offset of the segment header.
+        int buildid;          //!< Id of the build.
+        std::uint32_t nFiles; //!< Number of file records.
+        int minFileid;        //!< Smallest file id in the segment.
+        int maxFileid;        //!< Largest file id in the segment.
+    };
+
+    /**
+     * @brief Maps the file and finds valid segments in it.
+     *
+     * @throws std::runtime_error if file isn't a valid pack.
+     */
+    void map();
+
+    /**
+     * @brief Fills file from its record.
+     *
+     * @param seg          Segment that contains the record.
+     * @param idx          Index of the record in the segment.
+     * @param withCoverage Whether coverage should be loaded.
+     *
+     * @returns The file.
+     *
+     * @throws std::runtime_error if record points outside of valid data.
+     */
+    PackedFile readFile(const Segment &seg, std::uint32_t idx,
+                        bool withCoverage) const;
+
+    /**
+     * @brief Retrieves path of a record.
+     *
+     * @param seg Segment that contains the record.
+     * @param idx Index of the record in the segment.
+     *
+     * @returns The path.
+     */
+    std::string readPath(const Segment &seg, std::uint32_t idx) const;
+
+    /**
+     * @brief Checks that a range lies within valid part of the file.
+     *
+     * @param offset Start of the range.
+     * @param size   Size of the range.
+     *
+     * @throws std::runtime_error if it doesn't.
+     */
+    void checkRange(std::uint64_t offset, std::uint64_t size) const;
+
+private:
+    std::string path;                  //!< Path to the pack.
+    //! Mapping of the file.
+    boost::iostreams::mapped_file_source file;
+    std::uint64_t mappedSize;          //!< Size of the file when mapped.
+    std::time_t mappedTime;            //!< Modification time when mapped.
+    std::uint64_t validSize;           //!< Size of valid prefix of the file.
+    std::vector<Segment> segments;     //!< Valid segments in order.
+    std::map<int, std::size_t> builds; //!< Build id -> index of segment.
+};
+
+#endif // UNCOV_COVERAGEPACK_HPP_
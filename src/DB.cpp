@@ -17,15 +17,30 @@
 #include "DB.hpp"
 
 #include <sqlite3.h>
-#include <zlib.h>
 
-#include <iterator>
+#include <algorithm>
+#include <chrono>
+#include <list>
 #include <memory>
-#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "DBProfile.hpp"
+#include "coverage_codec.hpp"
+
+static int busyHandler(void *data, int attempt);
+static void executeDirectly(sqlite3 *conn, const std::string &stmt);
+static std::string makeImmutableUri(const std::string &path);
+
+//! Maximum number of idle prepared statements kept per connection.
+static const std::size_t MaxCachedStmts = 64U;
+//! Default time limit on retrying operations on locked database (in ms).
+static const int DefaultBusyTimeout = 5000;
+//! Upper limit on delay between two attempts to access locked database.
+static const int MaxBusyDelay = 100;
+
 namespace {
 
 /**
@@ -37,10 +52,12 @@ public:
     /**
      * @brief Initializes the binder.
      *
-     * @param ps  Handle to statement to initialize.
-     * @param idx Index of the argument.
+     * @param ps    Handle to statement to initialize.
+     * @param idx   Index of the argument.
+     * @param dicts Dictionaries for coverage or @c nullptr.
      */
-    Binder(sqlite3_stmt *ps, int idx) : ps(ps), idx(idx)
+    Binder(sqlite3_stmt *ps, int idx, CoverageDictionaries *dicts)
+        : ps(ps), idx(idx), dicts(dicts)
     {
     }
 
@@ -55,6 +72,16 @@ public:
         errorValue = sqlite3_bind_int(ps, idx, i);
     }
 
+    /**
+     * @brief Binds a 64-bit integer argument.
+     *
+     * @param i The argument.
+     */
+    void operator()(std::int64_t i)
+    {
+        errorValue = sqlite3_bind_int64(ps, idx, i);
+    }
+
     /**
      * @brief Binds a string argument.
      *
@@ -74,27 +101,19 @@ public:
      */
     void operator()(const std::vector<int> &vec)
     {
-        std::ostringstream oss;
-        std::copy(vec.cbegin(), vec.cend(),
-                  std::ostream_iterator<int>(oss, " "));
-        const std::string str = oss.str();
-
-        unsigned long compressedSize = compressBound(str.length());
-        std::vector<unsigned char> blob(4U + compressedSize);
-
-        // Serialize size in an endianness-independent way.
-        blob[0] = str.length() >> 24;
-        blob[1] = str.length() >> 16;
-        blob[2] = str.length() >> 8;
-        blob[3] = str.length();
-
-        if (compress(&blob[4], &compressedSize,
-                     reinterpret_cast<const unsigned char *>(str.data()),
-                     str.size()) != Z_OK) {
-            throw std::runtime_error("Failed to compress data");
-        }
-        blob.resize(4U + compressedSize);
+        const std::vector<unsigned char> blob = encodeCoverage(vec, dicts);
+        errorValue = sqlite3_bind_blob(ps, idx,
+                                       blob.data(), blob.size(),
+                                       SQLITE_TRANSIENT);
+    }
 
+    /**
+     * @brief Binds a blob.
+     *
+     * @param blob The argument.
+     */
+    void operator()(const std::vector<unsigned char> &blob)
+    {
         errorValue = sqlite3_bind_blob(ps, idx,
                                        blob.data(), blob.size(),
                                        SQLITE_TRANSIENT);
@@ -104,28 +123,72 @@ public:
     const int &error = errorValue; //!< "Accessor" for error code.
 
 private:
-    sqlite3_stmt *const ps;     //!< Handle to statement to initialize.
-    const int idx;              //!< Index of the argument.
-    int errorValue = SQLITE_OK; //!< Error code.
+    sqlite3_stmt *const ps;            //!< Handle to statement to initialize.
+    const int idx;                     //!< Index of the argument.
+    CoverageDictionaries *const dicts; //!< Dictionaries or @c nullptr.
+    int errorValue = SQLITE_OK;        //!< Error code.
 };
 
 }
 
-DB::DB(const std::string &path)
+DB::DB(const std::string &path, DBMode mode)
+    : path(path), mode(mode), busyTimeout(DefaultBusyTimeout)
 {
-    if (sqlite3_open(path.c_str(), &conn) != SQLITE_OK) {
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+    std::string target = path;
+    if (mode == DBMode::ReadOnly) {
+        flags = SQLITE_OPEN_READONLY;
+    } else if (mode == DBMode::Snapshot) {
+        flags = SQLITE_OPEN_READONLY | SQLITE_OPEN_URI;
+        target = makeImmutableUri(path);
+    }
+
+    if (sqlite3_open_v2(target.c_str(), &conn, flags, nullptr) != SQLITE_OK) {
         std::string error = std::string("Can't open database: ")
                           + sqlite3_errmsg(conn);
         sqlite3_close(conn);
         throw std::runtime_error(error);
     }
+
+    sqlite3_busy_handler(conn, &busyHandler, &busyTimeout);
+
+    if (mode == DBMode::ReadWrite) {
+        // Takes effect only for a new database and must precede switching
+        // journal mode, which writes database header.  Enables giving space
+        // back to file system without rewriting the whole database.
+        (void)sqlite3_exec(conn, "pragma auto_vacuum = INCREMENTAL",
+                           nullptr, nullptr, nullptr);
+        // Journal mode is persistent, so read-only connections pick it up
+        // from the file.  Failure to switch it isn't fatal, database just
+        // keeps using rollback journal.
+        (void)sqlite3_exec(conn, "pragma journal_mode = WAL",
+                           nullptr, nullptr, nullptr);
+        // This is durable enough in WAL mode and saves on syncs.
+        (void)sqlite3_exec(conn, "pragma synchronous = NORMAL",
+                           nullptr, nullptr, nullptr);
+    }
 }
 
 DB::~DB()
 {
+    for (sqlite3_stmt *ps : stmtCache) {
+        sqlite3_finalize(ps);
+    }
     sqlite3_close(conn);
 }
 
+void
+DB::configure(const DBSettings &settings)
+{
+    busyTimeout = settings.getBusyTimeout();
+
+    const std::int64_t mmapSize = settings.getMmapSize()*1024LL*1024LL;
+    executeDirectly(conn, "pragma mmap_size = " + std::to_string(mmapSize));
+    // Negative value specifies size in kibibytes rather than in pages.
+    executeDirectly(conn, "pragma cache_size = " +
+                          std::to_string(-settings.getCacheSize()));
+}
+
 void
 DB::execute(const std::string &stmt, const std::vector<Binding> &binds)
 {
@@ -136,34 +199,57 @@ DB::execute(const std::string &stmt, const std::vector<Binding> &binds)
     }
 }
 
+void
+DB::setProfile(DBProfile *profile)
+{
+    this->profile = profile;
+    runningStmts.clear();
+
+    const unsigned int mask = (profile == nullptr)
+                            ? 0U
+                            : SQLITE_TRACE_STMT | SQLITE_TRACE_ROW
+                            | SQLITE_TRACE_PROFILE;
+    sqlite3_trace_v2(conn, mask, &DB::onTrace, this);
+}
+
 DB::SingleRow
 DB::queryOne(const std::string &stmt, const std::vector<Binding> &binds)
 {
     stmtPtr ps = prepare(stmt, binds);
-    return SingleRow(std::move(ps));
+    return SingleRow(std::move(ps), dicts);
 }
 
 DB::Rows
 DB::queryAll(const std::string &stmt, const std::vector<Binding> &binds)
 {
     stmtPtr ps = prepare(stmt, binds);
-    return Rows(std::move(ps));
+    return Rows(std::move(ps), dicts);
 }
 
 DB::stmtPtr
 DB::prepare(const std::string &stmt, const std::vector<Binding> &binds)
 {
     sqlite3_stmt *rawPs;
-    const int error = sqlite3_prepare_v2(conn, stmt.c_str(),
-                                         stmt.length() + 1U, &rawPs,
-                                         nullptr);
 
-    if (error != SQLITE_OK) {
-        throw std::runtime_error(std::string("Execute prepare failed: ") +
-                                 sqlite3_errmsg(conn));
+    const auto cached = stmtIndex.find(stmt);
+    if (cached != stmtIndex.end()) {
+        // Statement is taken out of the cache while it's in use, so that
+        // nested queries of the same statement get their own instance.
+        rawPs = *cached->second;
+        stmtCache.erase(cached->second);
+        stmtIndex.erase(cached);
+    } else {
+        const int error = sqlite3_prepare_v2(conn, stmt.c_str(),
+                                             stmt.length() + 1U, &rawPs,
+                                             nullptr);
+
+        if (error != SQLITE_OK) {
+            throw std::runtime_error(std::string("Execute prepare failed: ") +
+                                     sqlite3_errmsg(conn));
+        }
     }
 
-    stmtPtr ps(rawPs, sqlite3_finalize);
+    stmtPtr ps(rawPs, [this](sqlite3_stmt *ps) { release(ps); });
     rawPs = nullptr;
 
     for (const Binding &bind : binds) {
@@ -173,7 +259,7 @@ DB::prepare(const std::string &stmt, const std::vector<Binding> &binds)
             throw std::runtime_error("No such binding: " + bind.getName());
         }
 
-        Binder doBind(ps.get(), idx);
+        Binder doBind(ps.get(), idx, dicts);
         boost::apply_visitor(doBind, bind.getValue());
         if (doBind.error != SQLITE_OK) {
             throw std::runtime_error("Failed to set binding of " +
@@ -185,12 +271,82 @@ DB::prepare(const std::string &stmt, const std::vector<Binding> &binds)
     return ps;
 }
 
+void
+DB::release(sqlite3_stmt *ps)
+{
+    sqlite3_reset(ps);
+    sqlite3_clear_bindings(ps);
+
+    const char *sql = sqlite3_sql(ps);
+    if (sql == nullptr || stmtIndex.find(sql) != stmtIndex.end()) {
+        sqlite3_finalize(ps);
+        return;
+    }
+
+    stmtCache.push_front(ps);
+    stmtIndex.emplace(sql, stmtCache.begin());
+
+    if (stmtCache.size() > MaxCachedStmts) {
+        sqlite3_stmt *const lru = stmtCache.back();
+        stmtIndex.erase(sqlite3_sql(lru));
+        stmtCache.pop_back();
+        sqlite3_finalize(lru);
+    }
+}
+
+int
+DB::onTrace(unsigned int event, void *data, void *p, void *x)
+{
+    using namespace std::chrono;
+
+    static_cast<void>(x);
+
+    DB *const db = static_cast<DB *>(data);
+    sqlite3_stmt *const ps = static_cast<sqlite3_stmt *>(p);
+
+    if (event == SQLITE_TRACE_STMT) {
+        // The event is repeated for triggers, which shouldn't restart timer.
+        db->runningStmts.emplace(ps, StmtRun { steady_clock::now(), 0 });
+        return 0;
+    }
+
+    const auto running = db->runningStmts.find(ps);
+    if (running == db->runningStmts.end()) {
+        // Statement was started before profiling was enabled.
+        return 0;
+    }
+
+    if (event == SQLITE_TRACE_ROW) {
+        ++running->second.rows;
+        return 0;
+    }
+
+    // Duration reported by SQLite has only millisecond precision, so measure
+    // it here.
+    const nanoseconds duration = steady_clock::now() - running->second.start;
+    const int rows = running->second.rows;
+    db->runningStmts.erase(running);
+
+    // Counter is reset to measure each run separately.
+    const int vmSteps = sqlite3_stmt_status(ps, SQLITE_STMTSTATUS_VM_STEP, 1);
+    const char *const sql = sqlite3_sql(ps);
+    db->profile->record(sql == nullptr ? "" : sql, duration.count(), rows,
+                        vmSteps);
+    return 0;
+}
+
 std::int64_t
 DB::getLastRowId()
 {
     return { sqlite3_last_insert_rowid(conn) };
 }
 
+int
+DB::getChanges()
+{
+    return sqlite3_changes(conn);
+}
+
 int
 DB::Row::getColumnCount() const
 {
@@ -203,6 +359,12 @@ DB::makeTransaction()
     return Transaction(conn);
 }
 
+Transaction
+DB::makeWriteTransaction()
+{
+    return Transaction(conn, true);
+}
+
 std::string
 DB::Row::makeTupleItem(std::size_t idx, Marker<std::string>)
 {
@@ -221,6 +383,15 @@ DB::Row::makeTupleItem(std::size_t idx, Marker<int>)
     return sqlite3_column_int(ps, idx);
 }
 
+std::int64_t
+DB::Row::makeTupleItem(std::size_t idx, Marker<std::int64_t>)
+{
+    if (sqlite3_column_type(ps, idx) != SQLITE_INTEGER) {
+        throw std::runtime_error("Expected integer type of column.");
+    }
+    return sqlite3_column_int64(ps, idx);
+}
+
 std::vector<int>
 DB::Row::makeTupleItem(std::size_t idx, Marker<std::vector<int>>)
 {
@@ -229,28 +400,32 @@ DB::Row::makeTupleItem(std::size_t idx, Marker<std::vector<int>>)
     }
 
     auto b = static_cast<const unsigned char *>(sqlite3_column_blob(ps, idx));
-    std::vector<unsigned char> blob(b, b + sqlite3_column_bytes(ps, idx));
-    unsigned long strSize =
-        (blob[0] << 24) + (blob[1] << 16) + (blob[2] << 8) + blob[3];
+    return decodeCoverage(b, sqlite3_column_bytes(ps, idx), dicts);
+}
 
-    std::string str(strSize, '\0');
-    if (uncompress(reinterpret_cast<unsigned char *>(&str[0]), &strSize,
-                   &blob[4], blob.size() - 4U) != Z_OK) {
-        throw std::runtime_error("Failed to uncompress data");
+std::vector<unsigned char>
+DB::Row::makeTupleItem(std::size_t idx, Marker<std::vector<unsigned char>>)
+{
+    if (sqlite3_column_type(ps, idx) != SQLITE_BLOB) {
+        throw std::runtime_error("Expected blob type of column.");
     }
 
-    std::istringstream is(str);
-    std::vector<int> vec;
-    for (int i; is >> i; ) {
-        vec.push_back(i);
-    }
-    return vec;
+    auto b = static_cast<const unsigned char *>(sqlite3_column_blob(ps, idx));
+    return std::vector<unsigned char>(b, b + sqlite3_column_bytes(ps, idx));
 }
 
-DB::SingleRow::SingleRow(stmtPtr ps) : Row(ps.get()), ps(std::move(ps))
+DB::SingleRow::SingleRow(stmtPtr ps, CoverageDictionaries *dicts)
+    : Row(ps.get(), dicts), ps(std::move(ps))
 {
-    if (sqlite3_step(this->ps.get()) != SQLITE_ROW) {
-        throw std::runtime_error("Failed to read single row");
+    const int error = sqlite3_step(this->ps.get());
+    if (error == SQLITE_DONE) {
+        throw std::runtime_error("Failed to read single row: no rows");
+    }
+    if (error != SQLITE_ROW) {
+        throw std::runtime_error(
+            std::string("Failed to read single row: ") +
+            sqlite3_errmsg(sqlite3_db_handle(this->ps.get()))
+        );
     }
 }
 
@@ -262,11 +437,14 @@ DB::RowIterator::increment()
     }
 }
 
-Transaction::Transaction(sqlite3 *conn) : conn(conn), committed(false)
+Transaction::Transaction(sqlite3 *conn, bool immediate)
+    : conn(conn), committed(false)
 {
+    const char *const begin = immediate ? "BEGIN IMMEDIATE TRANSACTION"
+                                        : "BEGIN TRANSACTION";
+
     char *errMsg;
-    if (sqlite3_exec(conn, "BEGIN TRANSACTION", nullptr, nullptr,
-                     &errMsg) != 0) {
+    if (sqlite3_exec(conn, begin, nullptr, nullptr, &errMsg) != 0) {
         std::string error = errMsg;
         sqlite3_free(errMsg);
         throw std::runtime_error("Failed to start transaction: " + error);
@@ -295,3 +473,84 @@ Transaction::~Transaction()
         (void)sqlite3_exec(conn, "ROLLBACK", nullptr, nullptr, nullptr);
     }
 }
+
+/**
+ * @brief Decides whether to retry an operation on a locked database.
+ *
+ * Sleeps between attempts with exponentially growing delay (up to a limit)
+ * until the timeout is exhausted.
+ *
+ * @param data    Pointer to timeout in milliseconds.
+ * @param attempt Number of times the handler was invoked for the same lock.
+ *
+ * @returns Non-zero to retry, zero to give up with @c SQLITE_BUSY.
+ */
+static int
+busyHandler(void *data, int attempt)
+{
+    const int timeout = *static_cast<const int *>(data);
+
+    int slept = 0;
+    int delay = 1;
+    for (int i = 0; i < attempt && slept < timeout; ++i) {
+        slept += delay;
+        delay = std::min(delay*2, MaxBusyDelay);
+    }
+
+    if (slept >= timeout) {
+        return 0;
+    }
+
+    delay = std::min(delay, timeout - slept);
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+    return 1;
+}
+
+/**
+ * @brief Performs a statement bypassing statement cache and ignoring result.
+ *
+ * @param conn Connection to the database.
+ * @param stmt Statement to be performed.
+ *
+ * @throws std::runtime_error on failure to perform the statement.
+ */
+static void
+executeDirectly(sqlite3 *conn, const std::string &stmt)
+{
+    char *errMsg;
+    if (sqlite3_exec(conn, stmt.c_str(), nullptr, nullptr, &errMsg) != 0) {
+        std::string error = errMsg;
+        sqlite3_free(errMsg);
+        throw std::runtime_error("Failed to execute `" + stmt + "`: " +
+                                 error);
+    }
+}
+
+/**
+ * @brief Makes URI that opens database file as immutable.
+ *
+ * SQLite doesn't lock such files and doesn't look for write-ahead log.
+ *
+ * @param path Path to the database.
+ *
+ * @returns The URI.
+ */
+static std::string
+makeImmutableUri(const std::string &path)
+{
+    // Empty authority keeps leading slashes of absolute path from being taken
+    // for one.
+    std::string uri = (!path.empty() && path[0] == '/') ? "file://" : "file:";
+    for (char c : path) {
+        // These have special meaning in URIs.
+        if (c == '%' || c == '?' || c == '#') {
+            static const char hex[] = "0123456789ABCDEF";
+            uri += '%';
+            uri += hex[static_cast<unsigned char>(c) >> 4];
+            uri += hex[static_cast<unsigned char>(c) & 0xF];
+        } else {
+            uri += c;
+        }
+    }
+    return uri + "?immutable=1";
+}
@@ -30,11 +30,14 @@
 
 #include <cstdint>
 
+#include <chrono>
 #include <functional>
 #include <iterator>
+#include <list>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -44,8 +47,52 @@ struct sqlite3;
 struct sqlite3_stmt;
 
 class Binding;
+class CoverageDictionaries;
+class DBProfile;
 class Transaction;
 
+/**
+ * @brief Way in which database is opened.
+ */
+enum class DBMode
+{
+    ReadWrite, //!< Database is created if missing and can be modified.
+    ReadOnly,  //!< Database must exist and can only be queried.
+    Snapshot   //!< Like ReadOnly, but file is assumed to never change.
+};
+
+/**
+ * @brief Settings that tune database connection.
+ */
+class DBSettings
+{
+public:
+    //! Make destructor virtual.
+    virtual ~DBSettings() = default;
+
+public:
+    /**
+     * @brief Retrieves for how long to retry when database is locked.
+     *
+     * @returns Timeout in milliseconds.
+     */
+    virtual int getBusyTimeout() const = 0;
+
+    /**
+     * @brief Retrieves maximum size of memory-mapped region of the database.
+     *
+     * @returns The size in mebibytes, @c 0 disables memory-mapped I/O.
+     */
+    virtual int getMmapSize() const = 0;
+
+    /**
+     * @brief Retrieves size of page cache of a connection.
+     *
+     * @returns The size in kibibytes.
+     */
+    virtual int getCacheSize() const = 0;
+};
+
 /**
  * @brief Represents databaes connection.
  */
@@ -56,6 +103,7 @@ class DB
     class RowIterator;
     class RowsData;
     class Rows;
+    struct StmtRun;
 
     //! Type of smart handle to database statement, which is RAII-friendly.
     using stmtPtr = std::unique_ptr<sqlite3_stmt,
@@ -67,11 +115,21 @@ public:
     /**
      * @brief Opens a database.
      *
+     * Writable databases are switched to write-ahead logging, so that readers
+     * don't block on a writer and vice versa.  Snapshots are read without any
+     * locking and ignore write-ahead log.
+     *
      * @param path Path to the database.
+     * @param mode Whether database is opened for writing.
      *
      * @throws std::runtime_error if database connection can't be opened.
      */
-    explicit DB(const std::string &path);
+    explicit DB(const std::string &path, DBMode mode = DBMode::ReadWrite);
+
+    //! Not copyable, statements refer back to the connection object.
+    DB(const DB &rhs) = delete;
+    //! Not copy-assignable.
+    DB & operator=(const DB &rhs) = delete;
 
     /**
      * @brief Closes database connection.
@@ -79,6 +137,67 @@ public:
     ~DB();
 
 public:
+    /**
+     * @brief Applies settings to the connection.
+     *
+     * @param settings Settings to apply.
+     *
+     * @throws std::runtime_error on failure to apply the settings.
+     */
+    void configure(const DBSettings &settings);
+
+    /**
+     * @brief Retrieves path to the database.
+     *
+     * @returns The path.
+     */
+    const std::string & getPath() const
+    {
+        return path;
+    }
+
+    /**
+     * @brief Checks whether the database was opened for reading only.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool isReadOnly() const
+    {
+        return mode != DBMode::ReadWrite;
+    }
+
+    /**
+     * @brief Retrieves mode in which the database was opened.
+     *
+     * @returns The mode.
+     */
+    DBMode getMode() const
+    {
+        return mode;
+    }
+
+    /**
+     * @brief Starts or stops collecting statistics about statements.
+     *
+     * Each finished run of a statement is recorded along with its duration,
+     * number of produced rows and number of virtual machine steps.
+     *
+     * @param profile Profile to update, which must outlive the connection, or
+     *                @c nullptr to stop profiling.
+     */
+    void setProfile(DBProfile *profile);
+
+    /**
+     * @brief Sets dictionaries for encoding and decoding coverage.
+     *
+     * @param dicts Dictionaries, which must outlive the connection, or
+     *              @c nullptr to use none.
+     */
+    void setDictionaries(CoverageDictionaries *dicts)
+    {
+        this->dicts = dicts;
+    }
+
     /**
      * @brief Performs a statement and discards result.
      *
@@ -123,6 +242,13 @@ public:
      */
     std::int64_t getLastRowId();
 
+    /**
+     * @brief Retrieves number of rows changed by the last statement.
+     *
+     * @returns The number.
+     */
+    int getChanges();
+
     /**
      * @brief Starts a transaction.
      *
@@ -138,21 +264,80 @@ public:
      */
     Transaction makeTransaction();
 
+    /**
+     * @brief Starts a transaction that takes write lock right away.
+     *
+     * Use it when decision to write depends on what is read in the
+     * transaction and another process might make the same decision.
+     *
+     * @returns RAII transaction object.
+     */
+    Transaction makeWriteTransaction();
+
 private:
     /**
-     * @brief Builds a prepared statement.
+     * @brief Builds a prepared statement or takes one from the cache.
      *
      * @param stmt  Statement to be performed.
      * @param binds Bindings to be applied.
      *
-     * @returns Smart pointer to just created prepared statement.
+     * @returns Smart pointer to prepared statement, which returns it to the
+     *          cache on destruction.
      *
      * @throws std::runtime_error on failure to make a statement or apply binds.
      */
     stmtPtr prepare(const std::string &stmt, const std::vector<Binding> &binds);
 
+    /**
+     * @brief Resets statement and puts it into the cache for reuse.
+     *
+     * Finalizes the statement if cache already holds the same one and evicts
+     * least recently used statement if the cache grows too big.
+     *
+     * @param ps Statement that is no longer in use.
+     */
+    void release(sqlite3_stmt *ps);
+
+    /**
+     * @brief Handles trace events of SQLite while profiling.
+     *
+     * @param event Type of the event.
+     * @param data  Pointer to the DB object.
+     * @param p     Prepared statement.
+     * @param x     Event-specific data.
+     *
+     * @returns Always zero.
+     */
+    static int onTrace(unsigned int event, void *data, void *p, void *x);
+
 private:
-    sqlite3 *conn; //!< Connection to the database.
+    const std::string path; //!< Path to the database.
+    const DBMode mode;      //!< Whether database is opened for writing.
+    sqlite3 *conn;          //!< Connection to the database.
+    int busyTimeout;        //!< Time limit on retrying locked operations.
+    //! Profile to record statements into or @c nullptr.
+    DBProfile *profile = nullptr;
+    //! Dictionaries for coverage blobs or @c nullptr.
+    CoverageDictionaries *dicts = nullptr;
+    //! Statements that are running while profiling is enabled.
+    std::unordered_map<sqlite3_stmt *, StmtRun> runningStmts;
+
+    //! Idle prepared statements ordered from most to least recently used.
+    std::list<sqlite3_stmt *> stmtCache;
+    //! Maps SQL text to position of idle statement in the cache.
+    std::unordered_map<std::string,
+                       std::list<sqlite3_stmt *>::iterator> stmtIndex;
+};
+
+/**
+ * @brief Profiling information about statement that is running.
+ */
+struct DB::StmtRun
+{
+    //! When statement started running.
+    std::chrono::steady_clock::time_point start;
+    //! Number of rows it produced so far.
+    int rows;
 };
 
 /**
@@ -171,9 +356,10 @@ public:
     /**
      * @brief Initializes row from database statement.
      *
-     * @param ps @copybrief ps
+     * @param ps    @copybrief ps
+     * @param dicts @copybrief dicts
      */
-    Row(sqlite3_stmt *ps) : ps(ps)
+    Row(sqlite3_stmt *ps, CoverageDictionaries *dicts) : ps(ps), dicts(dicts)
     {
     }
 
@@ -248,6 +434,16 @@ private:
      */
     int makeTupleItem(std::size_t idx, Marker<int> marker);
 
+    /**
+     * @brief Reads contents of a column as a 64-bit integer.
+     *
+     * @param idx    Index of the column.
+     * @param marker Overload resolution marker.
+     *
+     * @returns The integer.
+     */
+    std::int64_t makeTupleItem(std::size_t idx, Marker<std::int64_t> marker);
+
     /**
      * @brief Reads contents of a column as a vector of integers.
      *
@@ -259,8 +455,20 @@ private:
     std::vector<int> makeTupleItem(std::size_t idx,
                                    Marker<std::vector<int>> marker);
 
+    /**
+     * @brief Reads contents of a column as a blob.
+     *
+     * @param idx    Index of the column.
+     * @param marker Overload resolution marker.
+     *
+     * @returns The blob.
+     */
+    std::vector<unsigned char>
+    makeTupleItem(std::size_t idx, Marker<std::vector<unsigned char>> marker);
+
 private:
-    sqlite3_stmt *ps; //!< Handle to the database statement.
+    sqlite3_stmt *ps;            //!< Handle to the database statement.
+    CoverageDictionaries *dicts; //!< Dictionaries for coverage or @c nullptr.
 };
 
 /**
@@ -272,9 +480,10 @@ public:
     /**
      * @brief Takes ownership of the argument and reads single row.
      *
-     * @param ps @copybrief ps
+     * @param ps    @copybrief ps
+     * @param dicts Dictionaries for coverage or @c nullptr.
      */
-    explicit SingleRow(stmtPtr ps);
+    SingleRow(stmtPtr ps, CoverageDictionaries *dicts);
 
 private:
     stmtPtr ps; //!< Smart handle to database statement.
@@ -292,16 +501,18 @@ public:
     /**
      * @brief Initializes empty row iterator (end-iterator).
      */
-    RowIterator() : ps(nullptr), row(ps)
+    RowIterator() : ps(nullptr), row(ps, nullptr)
     {
     }
 
     /**
      * @brief Initializes non-empty row iterator (begin-iterator).
      *
-     * @param ps @copybrief ps
+     * @param ps    @copybrief ps
+     * @param dicts Dictionaries for coverage or @c nullptr.
      */
-    RowIterator(sqlite3_stmt *ps) : ps(ps), row(ps)
+    RowIterator(sqlite3_stmt *ps, CoverageDictionaries *dicts)
+        : ps(ps), row(ps, dicts)
     {
         increment();
     }
@@ -367,11 +578,12 @@ public:
     /**
      * @brief Initializes the range.
      *
-     * @param ps Smart handle to database statement.
+     * @param ps    Smart handle to database statement.
+     * @param dicts Dictionaries for coverage or @c nullptr.
      */
-    explicit Rows(stmtPtr ps)
+    Rows(stmtPtr ps, CoverageDictionaries *dicts)
         : RowsData(std::move(ps)),
-          RowsBase(RowIterator(RowsData::ps.get()), RowIterator())
+          RowsBase(RowIterator(RowsData::ps.get(), dicts), RowIterator())
     {
     }
 };
@@ -388,9 +600,10 @@ public:
     /**
      * Starts the transaction.
      *
-     * @param conn @copybrief conn
+     * @param conn      @copybrief conn
+     * @param immediate Whether to take write lock at the start.
      */
-    Transaction(sqlite3 *conn);
+    Transaction(sqlite3 *conn, bool immediate = false);
     //! Not copyable.
     Transaction(const Transaction &rhs) = delete;
     //! Moveable.
@@ -425,6 +638,12 @@ class Binding
 {
     friend class BlankBinding;
 
+public:
+    //! Type of value that can be bound.
+    using Value = boost::variant<std::string, int, std::int64_t,
+                                 std::vector<int>, std::vector<unsigned char>>;
+
+private:
     /**
      * @brief Initializes the binding.
      *
@@ -433,8 +652,7 @@ class Binding
      * @param name  @copybrief name
      * @param value @copybrief value
      */
-    Binding(std::string name,
-            boost::variant<std::string, int, std::vector<int>> value)
+    Binding(std::string name, Value value)
         : name(std::move(name)), value(value)
     {
     }
@@ -455,7 +673,7 @@ public:
      *
      * @returns The value.
      */
-    const boost::variant<std::string, int, std::vector<int>> & getValue() const
+    const Value & getValue() const
     {
         return value;
     }
@@ -464,7 +682,7 @@ private:
     //! Name of the argument that is being bound.
     const std::string name;
     //! Value that is bound.
-    const boost::variant<std::string, int, std::vector<int>> value;
+    const Value value;
 };
 
 /**
@@ -508,6 +726,18 @@ public:
         return Binding(name, val);
     }
 
+    /**
+     * @brief Completes binding with a 64-bit integer.
+     *
+     * @param val Value for the binding.
+     *
+     * @returns Fully initialized binding.
+     */
+    Binding operator=(std::int64_t val) &&
+    {
+        return Binding(name, val);
+    }
+
     /**
      * @brief Completes binding with vector of integers.
      *
@@ -520,6 +750,18 @@ public:
         return Binding(name, std::move(val));
     }
 
+    /**
+     * @brief Completes binding with a blob.
+     *
+     * @param val Value for the binding.
+     *
+     * @returns Fully initialized binding.
+     */
+    Binding operator=(std::vector<unsigned char> val) &&
+    {
+        return Binding(name, std::move(val));
+    }
+
 private:
     const std::string name; //!< Name of the argument that is being bound.
 };
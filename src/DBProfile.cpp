@@ -0,0 +1,123 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "DBProfile.hpp"
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "TablePrinter.hpp"
+
+static std::string formatDuration(std::int64_t ns);
+static std::string squeezeSpaces(const std::string &sql);
+
+void
+DBProfile::record(const std::string &sql, std::int64_t duration, int rows,
+                  int vmSteps)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    DBStmtStats &entry = stats[sql];
+    ++entry.calls;
+    entry.totalNs += duration;
+    entry.maxNs = std::max(entry.maxNs, duration);
+    entry.rows += rows;
+    entry.vmSteps += vmSteps;
+}
+
+std::map<std::string, DBStmtStats>
+DBProfile::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void
+DBProfile::print(std::ostream &os) const
+{
+    std::vector<std::pair<std::string, DBStmtStats>> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.assign(stats.cbegin(), stats.cend());
+    }
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::pair<std::string, DBStmtStats> &a,
+                        const std::pair<std::string, DBStmtStats> &b) {
+                         return a.second.totalNs > b.second.totalNs;
+                     });
+
+    TablePrinter tablePrinter({ "Calls", "Total, ms", "Max, ms", "Rows",
+                                "Steps", "-Statement" },
+                              std::numeric_limits<unsigned int>::max());
+
+    for (const auto &entry : entries) {
+        const DBStmtStats &s = entry.second;
+        tablePrinter.append({ std::to_string(s.calls),
+                              formatDuration(s.totalNs),
+                              formatDuration(s.maxNs),
+                              std::to_string(s.rows),
+                              std::to_string(s.vmSteps),
+                              squeezeSpaces(entry.first) });
+    }
+
+    tablePrinter.print(os);
+}
+
+/**
+ * @brief Formats duration in nanoseconds as milliseconds.
+ *
+ * @param ns The duration.
+ *
+ * @returns Formatted string.
+ */
+static std::string
+formatDuration(std::int64_t ns)
+{
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3) << ns/1000000.0;
+    return oss.str();
+}
+
+/**
+ * @brief Puts statement on a single line by collapsing runs of whitespace.
+ *
+ * @param sql Statement text.
+ *
+ * @returns Reformatted statement text.
+ */
+static std::string
+squeezeSpaces(const std::string &sql)
+{
+    std::vector<std::string> words;
+    boost::split(words, sql, boost::is_any_of(" \t\n"),
+                 boost::token_compress_on);
+    words.erase(std::remove(words.begin(), words.end(), std::string()),
+                words.end());
+    return boost::join(words, " ");
+}
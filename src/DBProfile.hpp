@@ -0,0 +1,86 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef UNCOV_DBPROFILE_HPP_
+#define UNCOV_DBPROFILE_HPP_
+
+#include <cstdint>
+
+#include <iosfwd>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * @file DBProfile.hpp
+ *
+ * @brief This unit collects statistics about performed database statements.
+ */
+
+/**
+ * @brief Statistics of a single statement accumulated over all its runs.
+ */
+struct DBStmtStats
+{
+    int calls = 0;             //!< Number of times statement was performed.
+    std::int64_t totalNs = 0;  //!< Total time spent in the statement.
+    std::int64_t maxNs = 0;    //!< Longest single run of the statement.
+    std::int64_t rows = 0;     //!< Number of produced rows.
+    std::int64_t vmSteps = 0;  //!< Number of virtual machine steps.
+};
+
+/**
+ * @brief Per-statement profile of database connections.
+ *
+ * Can be shared by several connections including those used from different
+ * threads.
+ */
+class DBProfile
+{
+public:
+    /**
+     * @brief Accounts single run of a statement.
+     *
+     * @param sql      Text of the statement.
+     * @param duration Time it took to run the statement in nanoseconds.
+     * @param rows     Number of rows the statement produced.
+     * @param vmSteps  Number of virtual machine steps taken by the run.
+     */
+    void record(const std::string &sql, std::int64_t duration, int rows,
+                int vmSteps);
+
+    /**
+     * @brief Retrieves statistics of all statements collected so far.
+     *
+     * @returns Statistics keyed by statement text.
+     */
+    std::map<std::string, DBStmtStats> getStats() const;
+
+    /**
+     * @brief Prints statistics from slowest to fastest statement.
+     *
+     * @param os Stream to print onto.
+     */
+    void print(std::ostream &os) const;
+
+private:
+    //! Statistics keyed by text of a statement.
+    std::map<std::string, DBStmtStats> stats;
+    //! Protects the statistics.
+    mutable std::mutex mutex;
+};
+
+#endif // UNCOV_DBPROFILE_HPP_
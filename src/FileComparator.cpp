@@ -26,16 +26,16 @@
 #include <vector>
 
 static bool validate(const std::vector<std::string> &o,
-                     const std::vector<int> &oCov,
+                     const CompactCoverage &oCov,
                      const std::vector<std::string> &n,
-                     const std::vector<int> &nCov,
+                     const CompactCoverage &nCov,
                      std::string &error);
 static inline int normalizeHits(int hits, CompareStrategy strategy);
 
 FileComparator::FileComparator(const std::vector<std::string> &o,
-                               const std::vector<int> &oCov,
+                               const CompactCoverage &oCov,
                                const std::vector<std::string> &n,
-                               const std::vector<int> &nCov,
+                               const CompactCoverage &nCov,
                                CompareStrategy strategy,
                                const FileComparatorSettings &settings)
 {
@@ -157,8 +157,8 @@ FileComparator::FileComparator(const std::vector<std::string> &o,
 }
 
 static bool
-validate(const std::vector<std::string> &o, const std::vector<int> &oCov,
-         const std::vector<std::string> &n, const std::vector<int> &nCov,
+validate(const std::vector<std::string> &o, const CompactCoverage &oCov,
+         const std::vector<std::string> &n, const CompactCoverage &nCov,
          std::string &error)
 {
     bool valid = true;
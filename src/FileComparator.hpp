@@ -22,6 +22,8 @@
 #include <utility>
 #include <vector>
 
+#include "CompactCoverage.hpp"
+
 /**
  * @file FileComparator.hpp
  *
@@ -133,9 +135,9 @@ public:
      * @param settings Settings for tweaking the comparison.
      */
     FileComparator(const std::vector<std::string> &o,
-                   const std::vector<int> &oCov,
+                   const CompactCoverage &oCov,
                    const std::vector<std::string> &n,
-                   const std::vector<int> &nCov,
+                   const CompactCoverage &nCov,
                    CompareStrategy strategy,
                    const FileComparatorSettings &settings);
 
@@ -29,6 +29,7 @@
 #include <vector>
 
 #include "ColorCane.hpp"
+#include "CompactCoverage.hpp"
 #include "FileComparator.hpp"
 #include "colors.hpp"
 #include "printing.hpp"
@@ -53,6 +54,22 @@ countWidth(int n)
     return width;
 }
 
+/**
+ * @brief Finds largest number of hits.
+ *
+ * @param coverage Coverage information.
+ *
+ * @returns The number or @c 0 for empty coverage.
+ */
+int
+getMaxHits(const CompactCoverage &coverage)
+{
+    if (coverage.empty()) {
+        return 0;
+    }
+    return *std::max_element(coverage.cbegin(), coverage.cend());
+}
+
 /**
  * @brief Auxiliary class that draws coverage column.
  */
@@ -121,16 +138,26 @@ public:
      * @param original    Whether this is original side.
      * @param printLineNo Whether to print line numbers.
      */
-    CoverageColumn(const std::vector<int> &coverage, bool original,
+    CoverageColumn(const CompactCoverage &coverage, bool original,
                    bool printLineNo)
+        : CoverageColumn(coverage, getMaxHits(coverage), original,
+                         printLineNo)
+    {
+    }
+
+    /**
+     * @brief Constructs from coverage information and its largest element.
+     *
+     * @param coverage    Coverage information.
+     * @param maxHits     Largest number of hits in @p coverage.
+     * @param original    Whether this is original side.
+     * @param printLineNo Whether to print line numbers.
+     */
+    CoverageColumn(const CompactCoverage &coverage, int maxHits,
+                   bool original, bool printLineNo)
         : coverage(coverage), original(original), printLineNo(printLineNo)
     {
         const int MinHitsNumWidth = 5;
-        // XXX: this could in principle be stored in database.
-        int maxHits = 0;
-        if (!coverage.empty()) {
-            maxHits = *std::max_element(coverage.cbegin(), coverage.cend());
-        }
         hitsNumWidth = std::max(MinHitsNumWidth, countWidth(maxHits));
 
         const int MinLineNoWidth = 5;
@@ -238,11 +265,11 @@ private:
     }
 
 private:
-    const std::vector<int> &coverage; //!< Coverage information.
-    const bool original;              //!< Whether this is original side.
-    const bool printLineNo;           //!< Whether to print line numbers.
-    int lineNoWidth;                  //!< Line number width.
-    int hitsNumWidth;                 //!< Maximum width of number of hits.
+    const CompactCoverage &coverage; //!< Coverage information.
+    const bool original;             //!< Whether this is original side.
+    const bool printLineNo;          //!< Whether to print line numbers.
+    int lineNoWidth;                 //!< Line number width.
+    int hitsNumWidth;                //!< Maximum width of number of hits.
 };
 
 /**
@@ -278,7 +305,16 @@ FilePrinter::FilePrinter(const FilePrinterSettings &settings)
 void
 FilePrinter::print(std::ostream &os, const std::string &path,
                    const std::string &contents,
-                   const std::vector<int> &coverage, bool leaveMissedOnly)
+                   const CompactCoverage &coverage, bool leaveMissedOnly)
+{
+    print(os, path, contents, coverage, getMaxHits(coverage), leaveMissedOnly);
+}
+
+void
+FilePrinter::print(std::ostream &os, const std::string &path,
+                   const std::string &contents,
+                   const CompactCoverage &coverage, int maxHits,
+                   bool leaveMissedOnly)
 {
     // TODO: move this to settings?
     const int MinLineNoWidth = 5;
@@ -337,7 +373,7 @@ FilePrinter::print(std::ostream &os, const std::string &path,
     std::stringstream ss;
     highlight(ss, iss, getLang(path), leaveMissedOnly ? &ranges : nullptr);
 
-    CoverageColumn covCol(coverage, true, false);
+    CoverageColumn covCol(coverage, maxHits, true, false);
     std::size_t lineNo = 0U;
     std::size_t extraLines = 0U;
 
@@ -374,8 +410,8 @@ FilePrinter::print(std::ostream &os, const std::string &path,
 
 void
 FilePrinter::printDiff(std::ostream &os, const std::string &path,
-                       std::istream &oText, const std::vector<int> &oCov,
-                       std::istream &nText, const std::vector<int> &nCov,
+                       std::istream &oText, const CompactCoverage &oCov,
+                       std::istream &nText, const CompactCoverage &nCov,
                        const FileComparator &comparator)
 {
     os << printDiff(path, oText, oCov, nText, nCov, comparator);
@@ -383,8 +419,8 @@ FilePrinter::printDiff(std::ostream &os, const std::string &path,
 
 ColorCane
 FilePrinter::printDiff(const std::string &path,
-                       std::istream &oText, const std::vector<int> &oCov,
-                       std::istream &nText, const std::vector<int> &nCov,
+                       std::istream &oText, const CompactCoverage &oCov,
+                       std::istream &nText, const CompactCoverage &nCov,
                        const FileComparator &comparator)
 {
     const std::deque<DiffLine> &diff = comparator.getDiffSequence();
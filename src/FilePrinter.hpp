@@ -24,6 +24,8 @@
 #include <string>
 #include <vector>
 
+#include "CompactCoverage.hpp"
+
 /**
  * @file FilePrinter.hpp
  *
@@ -117,9 +119,28 @@ public:
      * @note @c coverage.size() should match lines in @p contents.
      */
     void print(std::ostream &os, const std::string &path,
-               const std::string &contents, const std::vector<int> &coverage,
+               const std::string &contents, const CompactCoverage &coverage,
                bool leaveMissedOnly = false);
 
+    /**
+     * @brief Prints highlighted file with optional folding of covered lines.
+     *
+     * Same as another overload, but accepts precomputed largest number of hits
+     * instead of looking it up in @p coverage.
+     *
+     * @param os Stream to print output to.
+     * @param path Name of the file (for highlighting detection).
+     * @param contents Contents of the file.
+     * @param coverage Coverage information per line of contents.
+     * @param maxHits Largest element of @p coverage.
+     * @param leaveMissedOnly Fold lines which are covered or not relevant.
+     *
+     * @note @c coverage.size() should match lines in @p contents.
+     */
+    void print(std::ostream &os, const std::string &path,
+               const std::string &contents, const CompactCoverage &coverage,
+               int maxHits, bool leaveMissedOnly = false);
+
     /**
      * @brief Finds and prints differences between two versions of a file.
      *
@@ -140,8 +161,8 @@ public:
      *       assumed.
      */
     void printDiff(std::ostream &os, const std::string &path,
-                   std::istream &oText, const std::vector<int> &oCov,
-                   std::istream &nText, const std::vector<int> &nCov,
+                   std::istream &oText, const CompactCoverage &oCov,
+                   std::istream &nText, const CompactCoverage &nCov,
                    const FileComparator &comparator);
 
     /**
@@ -163,8 +184,8 @@ public:
      *       assumed.
      */
     ColorCane printDiff(const std::string &path,
-                        std::istream &oText, const std::vector<int> &oCov,
-                        std::istream &nText, const std::vector<int> &nCov,
+                        std::istream &oText, const CompactCoverage &oCov,
+                        std::istream &nText, const CompactCoverage &nCov,
                         const FileComparator &comparator);
 
 private:
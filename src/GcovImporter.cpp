@@ -47,6 +47,7 @@
 #include "utils/md5.hpp"
 #include "utils/strings.hpp"
 #include "BuildHistory.hpp"
+#include "PathInterner.hpp"
 #include "integration.hpp"
 
 namespace fs = boost::filesystem;
@@ -252,7 +253,7 @@ GcovImporter::GcovImporter(const std::string &root,
             }
         } else if (extensions.count(path.extension().string())) {
             std::string filePath = makeRelativePath(rootDir, path).string();
-            if (mapping.find(filePath) == mapping.end()) {
+            if (mapping.find(internPath(filePath)) == mapping.end()) {
                 std::string contents = readFile(path.string());
                 std::string hash = md5(contents);
 
@@ -266,7 +267,7 @@ GcovImporter::GcovImporter(const std::string &root,
     }
 
     for (auto &e : mapping) {
-        std::string contents = readFile(root + '/' + e.first);
+        std::string contents = readFile(root + '/' + *e.first);
         std::string hash = md5(contents);
 
         std::vector<std::string> lines = split(contents, '\n');
@@ -281,7 +282,7 @@ GcovImporter::GcovImporter(const std::string &root,
             ++i;
         }
 
-        files.emplace_back(e.first, std::move(hash), std::move(e.second));
+        files.emplace_back(*e.first, std::move(hash), std::move(e.second));
     }
 
     mapping.clear();
@@ -429,7 +430,7 @@ GcovImporter::parseGcovJson(std::istream &stream)
             continue;
         }
 
-        std::vector<int> &coverage = mapping[sourcePath];
+        std::vector<int> &coverage = mapping[internPath(sourcePath)];
         for (auto &line : file.second.get_child("lines")) {
             updateCoverage(coverage,
                            line.second.get<unsigned int>("line_number"),
@@ -448,7 +449,9 @@ GcovImporter::parseGcov(const std::string &path)
         std::tie(type, value) = splitAt(line, ':');
         if (type == "file") {
             const std::string sourcePath = resolveSourcePath(value);
-            coverage = (sourcePath.empty() ? nullptr : &mapping[sourcePath]);
+            coverage = sourcePath.empty()
+                     ? nullptr
+                     : &mapping[internPath(sourcePath)];
         } else if (coverage != nullptr && type == "lcount") {
             std::vector<std::string> fields = split(value, ',');
             if (fields.size() < 2U) {
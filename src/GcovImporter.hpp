@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "BuildHistory.hpp"
+#include "PathInterner.hpp"
 
 /**
  * @brief Determines information about `gcov` command.
@@ -217,7 +218,7 @@ private:
     //! List of absolute and normalized path to be excluded.
     std::set<boost::filesystem::path> skipPaths;
     //! Temporary storage of coverage data during its collection.
-    std::unordered_map<std::string, std::vector<int>> mapping;
+    std::unordered_map<PathRef, std::vector<int>> mapping;
     //! Final coverage information.
     std::vector<File> files;
     //! Prefix to add to relative paths to source files.
@@ -55,6 +55,8 @@ Invocation::Invocation(std::vector<std::string> args)
 
     printHelp = varMap.count("help");
     printVersion = varMap.count("version");
+    profileDB = varMap.count("profile-db");
+    openSnapshot = varMap.count("snapshot");
     args = varMap["positional"].as<std::vector<std::string>>();
 
     if (printHelp || printVersion) {
@@ -112,7 +114,9 @@ parseOptions(const std::vector<std::string> &args)
 
     cmdlineOptions.add_options()
         ("help,h", "display help message")
-        ("version,v", "display version");
+        ("version,v", "display version")
+        ("profile-db", "report statistics of database statements at exit")
+        ("snapshot", "read database as immutable file without locking");
 
     po::options_description allOptions;
     allOptions.add(cmdlineOptions).add(hiddenOpts);
@@ -159,7 +163,8 @@ std::string
 Invocation::getUsage() const
 {
     return "Usage: " + programName
-         + " [--help|-h] [--version|-v] [repo] subcommand [args...]";
+         + " [--help|-h] [--version|-v] [--profile-db] [--snapshot] [repo] "
+           "subcommand [args...]";
 }
 
 const std::string &
@@ -197,3 +202,15 @@ Invocation::shouldPrintVersion() const
 {
     return printVersion;
 }
+
+bool
+Invocation::shouldProfileDB() const
+{
+    return profileDB;
+}
+
+bool
+Invocation::shouldOpenSnapshot() const
+{
+    return openSnapshot;
+}
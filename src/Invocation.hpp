@@ -91,6 +91,20 @@ public:
      */
     bool shouldPrintVersion() const;
 
+    /**
+     * @brief Checks whether profiling of database statements was requested.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool shouldProfileDB() const;
+
+    /**
+     * @brief Checks whether database should be read as an immutable snapshot.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool shouldOpenSnapshot() const;
+
 private:
     //! Name of the program.
     std::string programName;
@@ -106,6 +120,10 @@ private:
     bool printHelp = false;
     //! Whether version information printing was requested.
     bool printVersion = false;
+    //! Whether profiling of database statements was requested.
+    bool profileDB = false;
+    //! Whether database should be read as an immutable snapshot.
+    bool openSnapshot = false;
 };
 
 #endif // UNCOV_INVOCATION_HPP_
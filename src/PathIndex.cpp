@@ -0,0 +1,204 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "PathIndex.hpp"
+
+#include <cstddef>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Retrieves directory part of a path.
+ *
+ * @param path The path.
+ *
+ * @returns The directory or an empty string for the root.
+ */
+static std::string
+getDir(const std::string &path)
+{
+    const std::string::size_type pos = path.rfind('/');
+    return (pos == std::string::npos) ? std::string() : path.substr(0, pos);
+}
+
+PathIndex::PathIndex(const PathMap &paths)
+{
+    // Paths are already interned, so they are only compared here.
+    entries.reserve(paths.size());
+    for (const auto &entry : paths) {
+        dirs.push_back(getDir(*entry.first));
+        entries.push_back({ 0, entry.first, entry.second });
+    }
+    std::sort(dirs.begin(), dirs.end());
+    dirs.erase(std::unique(dirs.begin(), dirs.end()), dirs.end());
+    dirs.shrink_to_fit();
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry &a, const Entry &b) {
+                  return *a.path < *b.path;
+              });
+    for (Entry &entry : entries) {
+        entry.dir = std::lower_bound(dirs.cbegin(), dirs.cend(),
+                                     getDir(*entry.path))
+                  - dirs.cbegin();
+    }
+}
+
+std::size_t
+PathIndex::size() const
+{
+    return entries.size();
+}
+
+int
+PathIndex::getFileId(const std::string &path) const
+{
+    const auto it = std::lower_bound(entries.cbegin(), entries.cend(), path,
+                                     [this](const Entry &entry,
+                                            const std::string &path) {
+                                         return compare(entry, path) < 0;
+                                     });
+    if (it == entries.cend() || compare(*it, path) != 0) {
+        return 0;
+    }
+    return it->fileid;
+}
+
+bool
+PathIndex::isFile(const std::string &path) const
+{
+    return getFileId(path) != 0;
+}
+
+bool
+PathIndex::isDirectory(const std::string &path) const
+{
+    if (path.empty()) {
+        return !entries.empty();
+    }
+
+    const Range range = findPrefixed(path + '/');
+    return range.first != range.second;
+}
+
+std::vector<std::string>
+PathIndex::getFiles(const std::string &path) const
+{
+    const Range range = findSubtree(path);
+
+    std::vector<std::string> files;
+    files.reserve(range.second - range.first);
+    for (auto it = range.first; it != range.second; ++it) {
+        files.push_back(*it->path);
+    }
+    return files;
+}
+
+std::vector<PathRef>
+PathIndex::getFileRefs(const std::string &path) const
+{
+    const Range range = findSubtree(path);
+
+    std::vector<PathRef> refs;
+    refs.reserve(range.second - range.first);
+    for (auto it = range.first; it != range.second; ++it) {
+        refs.push_back(it->path);
+    }
+    return refs;
+}
+
+std::vector<std::string>
+PathIndex::getDirectFiles(const std::string &dir) const
+{
+    std::vector<std::string> files;
+
+    const auto match = std::lower_bound(dirs.cbegin(), dirs.cend(), dir);
+    if (match == dirs.cend() || *match != dir) {
+        return files;
+    }
+
+    const int dirIdx = match - dirs.cbegin();
+    const Range range = findSubtree(dir);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->dir == dirIdx) {
+            files.push_back(*it->path);
+        }
+    }
+    return files;
+}
+
+std::vector<std::string>
+PathIndex::getSubdirs(const std::string &dir) const
+{
+    const std::string prefix = dir.empty() ? dir : dir + '/';
+
+    // Directories of a subtree aren't necessarily grouped by their first
+    // component (e.g., "a/b" < "a/b-c" < "a/b/d").
+    std::set<std::string> subdirs;
+    for (auto it = std::lower_bound(dirs.cbegin(), dirs.cend(), prefix);
+         it != dirs.cend() && it->compare(0, prefix.size(), prefix) == 0;
+         ++it) {
+        if (it->size() == prefix.size()) {
+            continue;
+        }
+        subdirs.insert(it->substr(0, it->find('/', prefix.size())));
+    }
+    return std::vector<std::string>(subdirs.cbegin(), subdirs.cend());
+}
+
+PathIndex::Range
+PathIndex::findSubtree(const std::string &path) const
+{
+    if (path.empty()) {
+        return { entries.cbegin(), entries.cend() };
+    }
+
+    const Range file = findPrefixed(path);
+    if (file.first != file.second && compare(*file.first, path) == 0) {
+        return { file.first, file.first + 1 };
+    }
+    return findPrefixed(path + '/');
+}
+
+PathIndex::Range
+PathIndex::findPrefixed(const std::string &prefix) const
+{
+    // Cutting paths to the length of the prefix leaves them sorted.
+    const std::size_t len = prefix.size();
+    auto first = std::lower_bound(entries.cbegin(), entries.cend(), prefix,
+                                  [this, len](const Entry &entry,
+                                              const std::string &prefix) {
+                                      return compare(entry, prefix, len) < 0;
+                                  });
+    auto last = std::upper_bound(first, entries.cend(), prefix,
+                                 [this, len](const std::string &prefix,
+                                             const Entry &entry) {
+                                     return compare(entry, prefix, len) > 0;
+                                 });
+    return { first, last };
+}
+
+int
+PathIndex::compare(const Entry &entry, const std::string &str,
+                   std::size_t len) const
+{
+    const std::string &path = *entry.path;
+    return path.compare(0U, std::min(len, path.size()), str);
+}
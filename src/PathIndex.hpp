@@ -0,0 +1,176 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef UNCOV_PATHINDEX_HPP_
+#define UNCOV_PATHINDEX_HPP_
+
+#include <cstddef>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "PathInterner.hpp"
+
+/**
+ * @file PathIndex.hpp
+ *
+ * @brief This unit provides lookup of paths of files of a build.
+ */
+
+/**
+ * @brief Sorted index of paths of files of a build.
+ *
+ * Directories are stored once no matter how many files they contain and
+ * paths of files are interned, so they are shared with other builds.  Files
+ * are kept in the order of their paths, which makes files of a subtree form
+ * a continuous range that is found by binary search.  The root directory is
+ * denoted by an empty string.
+ */
+class PathIndex
+{
+public:
+    /**
+     * @brief Builds index of paths.
+     *
+     * @param paths Mappings of interned file paths to file IDs.
+     */
+    explicit PathIndex(const PathMap &paths);
+
+public:
+    /**
+     * @brief Retrieves number of files in the index.
+     *
+     * @returns The number.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Looks up id of a file.
+     *
+     * @param path Path of the file.
+     *
+     * @returns The id or @c 0 if there is no such file.
+     */
+    int getFileId(const std::string &path) const;
+
+    /**
+     * @brief Checks whether path refers to a file.
+     *
+     * @param path Path to check.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool isFile(const std::string &path) const;
+
+    /**
+     * @brief Checks whether path refers to a directory with files.
+     *
+     * Files in subdirectories count as well.
+     *
+     * @param path Path to check.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    bool isDirectory(const std::string &path) const;
+
+    /**
+     * @brief Lists files of a subtree.
+     *
+     * @param path Directory or a file, which is then the only one listed.
+     *
+     * @returns Paths of the files in sorted order.
+     */
+    std::vector<std::string> getFiles(const std::string &path = {}) const;
+
+    /**
+     * @brief Lists interned paths of files of a subtree.
+     *
+     * @param path Directory or a file, which is then the only one listed.
+     *
+     * @returns References to paths in sorted order of the paths.
+     */
+    std::vector<PathRef> getFileRefs(const std::string &path = {}) const;
+
+    /**
+     * @brief Lists files that reside directly in a directory.
+     *
+     * @param dir The directory.
+     *
+     * @returns Paths of the files in sorted order.
+     */
+    std::vector<std::string> getDirectFiles(const std::string &dir) const;
+
+    /**
+     * @brief Lists directories that reside directly in a directory.
+     *
+     * @param dir The directory.
+     *
+     * @returns Paths of the directories in sorted order.
+     */
+    std::vector<std::string> getSubdirs(const std::string &dir) const;
+
+private:
+    //! Single file.
+    struct Entry
+    {
+        int dir;      //!< Index of directory of the file.
+        PathRef path; //!< Path to the file.
+        int fileid;   //!< Id of the file.
+    };
+
+    //! Range of files.
+    using Range = std::pair<std::vector<Entry>::const_iterator,
+                            std::vector<Entry>::const_iterator>;
+
+    /**
+     * @brief Finds files of a subtree.
+     *
+     * @param path Directory or a file, which is then the only one found.
+     *
+     * @returns Range of files.
+     */
+    Range findSubtree(const std::string &path) const;
+
+    /**
+     * @brief Finds files with paths that start with a prefix.
+     *
+     * @param prefix The prefix.
+     *
+     * @returns Range of files.
+     */
+    Range findPrefixed(const std::string &prefix) const;
+
+    /**
+     * @brief Compares path of a file with a string.
+     *
+     * @param entry The file.
+     * @param str   String to compare with.
+     * @param len   Number of leading characters of the path to compare.
+     *
+     * @returns Negative, zero or positive number in the way std::strcmp()
+     *          does.
+     */
+    int compare(const Entry &entry, const std::string &str,
+                std::size_t len = std::string::npos) const;
+
+private:
+    std::vector<std::string> dirs; //!< Sorted directories that have files.
+    std::vector<Entry> entries;    //!< Files sorted by their paths.
+};
+
+#endif // UNCOV_PATHINDEX_HPP_
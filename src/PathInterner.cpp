@@ -0,0 +1,51 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "PathInterner.hpp"
+
+#include <cstddef>
+
+#include <mutex>
+#include <string>
+
+PathInterner &
+PathInterner::getGlobal()
+{
+    static PathInterner global;
+    return global;
+}
+
+PathRef
+PathInterner::intern(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return &*paths.insert(path).first;
+}
+
+PathRef
+PathInterner::find(const std::string &path) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto match = paths.find(path);
+    return (match == paths.end()) ? nullptr : &*match;
+}
+
+std::size_t
+PathInterner::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return paths.size();
+}
@@ -0,0 +1,127 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef UNCOV_PATHINTERNER_HPP_
+#define UNCOV_PATHINTERNER_HPP_
+
+#include <cstddef>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @file PathInterner.hpp
+ *
+ * @brief This unit provides single storage for paths of files.
+ */
+
+/**
+ * @brief Reference to an interned path.
+ *
+ * Equal paths are represented by the same pointer, so references can be
+ * compared and hashed as integers.
+ */
+using PathRef = const std::string *;
+
+/**
+ * @brief Mappings of interned paths of files to ids of the files.
+ */
+using PathMap = std::unordered_map<PathRef, int>;
+
+/**
+ * @brief Table of unique paths.
+ *
+ * Paths of files repeat in every build that contains them, the table keeps
+ * a single copy of each of them for the lifetime of the process.  Interned
+ * paths are never removed, which is fine as their number is bounded by the
+ * number of distinct paths in the history of a repository.  All methods are
+ * thread-safe.
+ */
+class PathInterner
+{
+public:
+    /**
+     * @brief Retrieves table shared by the whole process.
+     *
+     * @returns The table.
+     */
+    static PathInterner & getGlobal();
+
+public:
+    /**
+     * @brief Looks up a path adding it to the table if it's not there.
+     *
+     * @param path The path.
+     *
+     * @returns Reference that remains valid for the lifetime of the table.
+     */
+    PathRef intern(const std::string &path);
+
+    /**
+     * @brief Looks up a path without adding it to the table.
+     *
+     * @param path The path.
+     *
+     * @returns Reference to the path or @c nullptr if it's not interned.
+     */
+    PathRef find(const std::string &path) const;
+
+    /**
+     * @brief Retrieves number of interned paths.
+     *
+     * @returns The number.
+     */
+    std::size_t size() const;
+
+private:
+    //! Protects the table from concurrent modification.
+    mutable std::mutex mutex;
+    //! Interned paths, elements of the set don't move on its growth.
+    std::unordered_set<std::string> paths;
+};
+
+/**
+ * @brief Interns a path in the global table.
+ *
+ * @param path The path.
+ *
+ * @returns Reference to the interned path.
+ */
+inline PathRef
+internPath(const std::string &path)
+{
+    return PathInterner::getGlobal().intern(path);
+}
+
+/**
+ * @brief Looks up a path in the global table.
+ *
+ * A path that isn't interned isn't a path of any loaded file.
+ *
+ * @param path The path.
+ *
+ * @returns Reference to the path or @c nullptr if it's not interned.
+ */
+inline PathRef
+findPath(const std::string &path)
+{
+    return PathInterner::getGlobal().find(path);
+}
+
+#endif // UNCOV_PATHINTERNER_HPP_
@@ -44,6 +44,14 @@ Settings::loadFromFile(const std::string &path)
     setMinFoldSize(props.get<int>("min-fold-size", minFoldSize));
     foldContext = props.get<int>("fold-context", foldContext);
     setPrintLineNoInDiff(props.get<bool>("diff-show-lineno", diffShowLineNo));
+    busyTimeout = props.get<int>("db-busy-timeout", busyTimeout);
+    mmapSize = props.get<int>("db-mmap-size", mmapSize);
+    cacheSize = props.get<int>("db-cache-size", cacheSize);
+    coverageDeltaChain = props.get<int>("coverage-delta-chain",
+                                        coverageDeltaChain);
+    coveragePack = props.get<bool>("coverage-pack", coveragePack);
+    storeHitCounts = props.get<bool>("store-hit-counts", storeHitCounts);
+    buildCacheSize = props.get<int>("build-cache-size", buildCacheSize);
 
     medLimit = std::max(0.0f, std::min(100.0f, medLimit));
     hiLimit = std::max(0.0f, std::min(100.0f, hiLimit));
@@ -53,6 +61,11 @@ Settings::loadFromFile(const std::string &path)
 
     tabSize = std::max(1, std::min(25, tabSize));
     foldContext = std::max(0, std::min(100, foldContext));
+    busyTimeout = std::max(0, std::min(600000, busyTimeout));
+    mmapSize = std::max(0, std::min(65536, mmapSize));
+    cacheSize = std::max(100, std::min(4194304, cacheSize));
+    coverageDeltaChain = std::max(0, std::min(1000, coverageDeltaChain));
+    buildCacheSize = std::max(0, std::min(65536, buildCacheSize));
 }
 
 void
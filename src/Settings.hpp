@@ -19,6 +19,8 @@
 
 #include <string>
 
+#include "BuildHistory.hpp"
+#include "DB.hpp"
 #include "FileComparator.hpp"
 #include "FilePrinter.hpp"
 #include "integration.hpp"
@@ -34,7 +36,8 @@
  * @brief Implementation of settings for all classes that have them.
  */
 class Settings : public PrintingSettings, public FilePrinterSettings,
-                 public FileComparatorSettings
+                 public FileComparatorSettings, public DBSettings,
+                 public BuildHistorySettings
 {
 public:
     // Loads some of the settings from file.  Does nothing if it doesn't exist.
@@ -83,6 +86,43 @@ public: // FileComparatorSettings and FilePrinterSettings
         return foldContext;
     }
 
+public: // DBSettings only
+    virtual int getBusyTimeout() const override
+    {
+        return busyTimeout;
+    }
+
+    virtual int getMmapSize() const override
+    {
+        return mmapSize;
+    }
+
+    virtual int getCacheSize() const override
+    {
+        return cacheSize;
+    }
+
+public: // BuildHistorySettings only
+    virtual int getCoverageDeltaChain() const override
+    {
+        return coverageDeltaChain;
+    }
+
+    virtual bool isCoveragePackEnabled() const override
+    {
+        return coveragePack;
+    }
+
+    virtual bool isHitCountStored() const override
+    {
+        return storeHitCounts;
+    }
+
+    virtual int getBuildCacheSize() const override
+    {
+        return buildCacheSize;
+    }
+
 public: // PrintingSettings and FilePrinterSettings
     virtual bool isHtmlOutput() const override
     {
@@ -117,6 +157,20 @@ private:
     bool diffShowLineNo = false;
     //! Number of visible lines above and below interesting lines.
     int foldContext = 1;
+    //! For how long to retry accessing locked database (in milliseconds).
+    int busyTimeout = 5000;
+    //! Maximum size of memory-mapped part of database (in mebibytes).
+    int mmapSize = 0;
+    //! Size of database page cache (in kibibytes).
+    int cacheSize = 2000;
+    //! Maximum number of consecutive coverage differences.
+    int coverageDeltaChain = 0;
+    //! Whether coverage pack is updated on adding builds.
+    bool coveragePack = false;
+    //! Whether hit counts of new builds are stored.
+    bool storeHitCounts = true;
+    //! Memory budget of cache of loaded paths and files (in mebibytes).
+    int buildCacheSize = 64;
 };
 
 #endif // UNCOV_SETTINGS_HPP_
@@ -134,6 +134,18 @@ public:
         return false;
     }
 
+    /**
+     * @brief Checks whether this command writes to the database.
+     *
+     * Other commands open database in read-only mode.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    virtual bool modifiesDB() const
+    {
+        return false;
+    }
+
     /**
      * @brief Prints help for this command.
      *
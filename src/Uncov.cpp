@@ -16,6 +16,9 @@
 
 #include "Uncov.hpp"
 
+#include <boost/filesystem/operations.hpp>
+#include <boost/optional.hpp>
+
 #include <cstdlib>
 
 #include <iostream>
@@ -25,8 +28,10 @@
 #include <utility>
 #include <vector>
 
+#include "utils/fs.hpp"
 #include "BuildHistory.hpp"
 #include "DB.hpp"
+#include "DBProfile.hpp"
 #include "Invocation.hpp"
 #include "Repository.hpp"
 #include "Settings.hpp"
@@ -83,12 +88,40 @@ Uncov::run(Settings &settings)
 
     settings.loadFromFile(dataPath + '/' + getConfigFile());
 
-    DB db(dataPath + '/' + getDatabaseFile());
+    const std::string dbPath = dataPath + '/' + getDatabaseFile();
+    const bool dbExists = boost::filesystem::exists(dbPath);
+
+    // Database that can't be modified anyway (e.g., on read-only storage) is
+    // read without locking.
+    const bool snapshot = invocation.shouldOpenSnapshot()
+                       || (dbExists && !isWritable(dbPath));
+    const boost::optional<DBMode> mode =
+        pickDBMode(invocation.getSubcommandName(), snapshot, dbExists);
+    if (!mode) {
+        std::cerr << "Can't modify database snapshot: " << dbPath << '\n';
+        return EXIT_FAILURE;
+    }
+
+    // Profile is declared first to outlive the connection.
+    DBProfile profile;
+    DB db(dbPath, *mode);
+    db.configure(settings);
+    if (invocation.shouldProfileDB()) {
+        db.setProfile(&profile);
+    }
     BuildHistory bh(db);
+    bh.configure(settings);
+    bh.setArchivePath(dataPath + '/' + getArchiveFile());
+    bh.setPackPath(dataPath + '/' + getPackFile());
 
-    return cmd->second->exec(settings, bh, repo,
-                             invocation.getSubcommandName(),
-                             invocation.getSubcommandArgs());
+    const int result = cmd->second->exec(settings, bh, repo,
+                                         invocation.getSubcommandName(),
+                                         invocation.getSubcommandArgs());
+
+    if (invocation.shouldProfileDB()) {
+        profile.print(std::cerr);
+    }
+    return result;
 }
 
 void
@@ -111,6 +144,30 @@ Uncov::printHelp(const std::string &alias)
     cmd->second->printHelp(std::cout, alias);
 }
 
+boost::optional<DBMode>
+Uncov::pickDBMode(const std::string &alias, bool snapshot,
+                  bool dbExists) const
+{
+    auto cmd = cmds.find(alias);
+    if (cmd == cmds.end()) {
+        throw std::invalid_argument("Unknown subcommand: " + alias);
+    }
+
+    if (snapshot) {
+        if (cmd->second->modifiesDB()) {
+            return {};
+        }
+        return DBMode::Snapshot;
+    }
+
+    // Readers don't take write locks, but a missing database has to be
+    // created first.
+    if (!cmd->second->modifiesDB() && dbExists) {
+        return DBMode::ReadOnly;
+    }
+    return DBMode::ReadWrite;
+}
+
 /**
  * @brief Prints information about all commands on standard output.
  *
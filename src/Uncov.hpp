@@ -17,6 +17,8 @@
 #ifndef UNCOV_UNCOV_HPP_
 #define UNCOV_UNCOV_HPP_
 
+#include <boost/optional/optional_fwd.hpp>
+
 #include <map>
 #include <string>
 #include <vector>
@@ -26,6 +28,8 @@
 class Settings;
 class SubCommand;
 
+enum class DBMode;
+
 /**
  * @brief Class that represents application.
  */
@@ -65,6 +69,20 @@ public:
      */
     void printHelp(const std::string &alias);
 
+    /**
+     * @brief Picks mode in which a command accesses the database.
+     *
+     * @param alias    Alias of the command.
+     * @param snapshot Whether database is to be read as a snapshot.
+     * @param dbExists Whether database file already exists.
+     *
+     * @returns The mode or nothing if the command can't work with a snapshot.
+     *
+     * @throws std::invalid_argument on unknown command name.
+     */
+    boost::optional<DBMode> pickDBMode(const std::string &alias,
+                                       bool snapshot, bool dbExists) const;
+
 private:
     /// Processor of command-line arguments.
     Invocation invocation;
@@ -27,6 +27,8 @@
 
 static const std::string configFileName = "uncov.ini";
 static const std::string databaseFileName = "uncov.sqlite";
+static const std::string archiveFileName = "uncov-archive.sqlite";
+static const std::string packFileName = "uncov-coverage.pack";
 
 std::string getAppVersion()
 {
@@ -43,6 +45,16 @@ std::string getDatabaseFile()
     return databaseFileName;
 }
 
+std::string getArchiveFile()
+{
+    return archiveFileName;
+}
+
+std::string getPackFile()
+{
+    return packFileName;
+}
+
 std::string
 pickDataPath(const Repository &repo)
 {
@@ -48,6 +48,20 @@ std::string getConfigFile();
  */
 std::string getDatabaseFile();
 
+/**
+ * @brief Retrieves name of database file that stores archived builds.
+ *
+ * @returns The name.
+ */
+std::string getArchiveFile();
+
+/**
+ * @brief Retrieves name of file that holds coverage pack.
+ *
+ * @returns The name.
+ */
+std::string getPackFile();
+
 /**
  * @brief Selects base path for local data during this run of the application.
  *
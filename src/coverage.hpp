@@ -54,6 +54,16 @@ public:
           missedCount(coverable.getMissedCount())
     {
     }
+    /**
+     * @brief Constructs coverage information from line counts.
+     *
+     * @param coveredCount Number of covered lines.
+     * @param missedCount  Number of missed lines.
+     */
+    CovInfo(int coveredCount, int missedCount)
+        : coveredCount(coveredCount), missedCount(missedCount)
+    {
+    }
 
 public:
     /**
@@ -0,0 +1,723 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "coverage_codec.hpp"
+
+#include <zlib.h>
+
+#ifdef WITH_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! Minimal length of a stretch of @c -1 or @c 0 that's encoded as a run.
+static const std::size_t MinRunLength = 3U;
+//! Upper limit on size of uncompressed data accepted from a blob.
+static const unsigned long long MaxUncompressedSize = 256ULL*1024U*1024U;
+
+namespace {
+
+/**
+ * @brief Incrementally parses whitespace-separated decimal integers.
+ *
+ * Input can be fed in pieces that split numbers at arbitrary places.
+ */
+class DecimalScanner
+{
+public:
+    /**
+     * @brief Constructs scanner that appends to a vector.
+     *
+     * @param out @copybrief out
+     */
+    explicit DecimalScanner(std::vector<int> &out) : out(out)
+    {
+    }
+
+public:
+    /**
+     * @brief Processes next piece of input.
+     *
+     * @param pos Beginning of the input.
+     * @param end End of the input.
+     *
+     * @throws std::runtime_error on unexpected character or too big number.
+     */
+    void feed(const unsigned char *pos, const unsigned char *end)
+    {
+        for (; pos != end; ++pos) {
+            const unsigned char c = *pos;
+            if (c >= '0' && c <= '9') {
+                value = value*10U + (c - '0');
+                if (value > MaxMagnitude) {
+                    throw std::runtime_error("Corrupted coverage data");
+                }
+                inNumber = true;
+            } else if (c == '-' && !inNumber && !negative) {
+                negative = true;
+            } else if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+                flush();
+            } else {
+                throw std::runtime_error("Corrupted coverage data");
+            }
+        }
+    }
+
+    /**
+     * @brief Processes the last number, if any.
+     *
+     * @throws std::runtime_error on dangling minus sign.
+     */
+    void finish()
+    {
+        flush();
+    }
+
+private:
+    /**
+     * @brief Appends number parsed so far to the output.
+     *
+     * @throws std::runtime_error on dangling minus sign.
+     */
+    void flush()
+    {
+        if (inNumber) {
+            const std::int64_t number = negative ? -std::int64_t(value)
+                                                 : std::int64_t(value);
+            if (number > std::numeric_limits<int>::max()) {
+                throw std::runtime_error("Corrupted coverage data");
+            }
+            out.push_back(static_cast<int>(number));
+        } else if (negative) {
+            throw std::runtime_error("Corrupted coverage data");
+        }
+
+        value = 0U;
+        inNumber = false;
+        negative = false;
+    }
+
+private:
+    //! Upper limit on absolute value of a number (allows for @c INT_MIN).
+    static constexpr std::uint64_t MaxMagnitude = 0x80000000U;
+
+    std::vector<int> &out;   //!< Destination for parsed numbers.
+    std::uint64_t value = 0; //!< Absolute value of current number.
+    bool inNumber = false;   //!< Whether at least one digit was seen.
+    bool negative = false;   //!< Whether current number has minus sign.
+};
+
+}
+
+static void putVarintRle(std::vector<unsigned char> &blob,
+                         const std::vector<int> &coverage);
+static void putVarint(std::vector<unsigned char> &blob, std::uint64_t value);
+static std::uint64_t getVarint(const unsigned char *&pos,
+                               const unsigned char *end);
+static std::vector<int> decodeVarintRle(const unsigned char *pos,
+                                        const unsigned char *end);
+static bool putState(std::vector<unsigned char> &blob,
+                     const std::vector<int> &coverage);
+static std::vector<int> decodeState(const unsigned char *pos,
+                                    const unsigned char *end);
+static std::vector<int> decodeLegacy(const unsigned char blob[],
+                                     std::size_t size);
+
+CoverageDictionaries::CoverageDictionaries(Loader loader)
+    : loader(std::move(loader)), active(0U),
+      cdict(nullptr, nullptr), cctx(nullptr, nullptr), dctx(nullptr, nullptr)
+{
+}
+
+CoverageDictionaries::~CoverageDictionaries() = default;
+
+bool
+CoverageDictionaries::isSupported()
+{
+#ifdef WITH_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+std::vector<unsigned char>
+CoverageDictionaries::train(const std::vector<std::vector<int>> &samples,
+                            std::size_t maxSize)
+{
+#ifdef WITH_ZSTD
+    // Codec byte is the same for all samples and isn't compressed.
+    std::vector<unsigned char> data;
+    std::vector<std::size_t> sizes;
+    sizes.reserve(samples.size());
+    for (const std::vector<int> &coverage : samples) {
+        const std::size_t before = data.size();
+        putVarintRle(data, coverage);
+        sizes.push_back(data.size() - before);
+    }
+
+    std::vector<unsigned char> dict(maxSize);
+    const std::size_t size = ZDICT_trainFromBuffer(dict.data(), dict.size(),
+                                                   data.data(), sizes.data(),
+                                                   sizes.size());
+    if (ZDICT_isError(size)) {
+        throw std::runtime_error(std::string("Failed to train dictionary: ") +
+                                 ZDICT_getErrorName(size));
+    }
+    dict.resize(size);
+    return dict;
+#else
+    static_cast<void>(samples);
+    static_cast<void>(maxSize);
+    throw std::runtime_error("Built without zstd support");
+#endif
+}
+
+std::uint32_t
+CoverageDictionaries::getId(const std::vector<unsigned char> &dict)
+{
+#ifdef WITH_ZSTD
+    const std::uint32_t id = ZSTD_getDictID_fromDict(dict.data(), dict.size());
+    if (id == 0U) {
+        throw std::runtime_error("Not a zstd dictionary");
+    }
+    return id;
+#else
+    static_cast<void>(dict);
+    throw std::runtime_error("Built without zstd support");
+#endif
+}
+
+void
+CoverageDictionaries::setActive(std::uint32_t id)
+{
+    if (id != active) {
+        active = id;
+        cdict.reset();
+    }
+}
+
+std::vector<unsigned char>
+CoverageDictionaries::compress(const std::vector<unsigned char> &data)
+{
+#ifdef WITH_ZSTD
+    if (active == 0U) {
+        return {};
+    }
+
+    if (!cdict) {
+        const std::vector<unsigned char> dict = load(active);
+        cdict = zstdPtr<ZSTD_CDict>(ZSTD_createCDict(dict.data(), dict.size(),
+                                                     ZSTD_CLEVEL_DEFAULT),
+                                    &ZSTD_freeCDict);
+    }
+    if (!cctx) {
+        cctx = zstdPtr<ZSTD_CCtx>(ZSTD_createCCtx(), &ZSTD_freeCCtx);
+    }
+    if (!cdict || !cctx) {
+        throw std::runtime_error("Failed to initialize compression");
+    }
+
+    std::vector<unsigned char> compressed(ZSTD_compressBound(data.size()));
+    const std::size_t size =
+        ZSTD_compress_usingCDict(cctx.get(),
+                                 compressed.data(), compressed.size(),
+                                 data.data(), data.size(), cdict.get());
+    if (ZSTD_isError(size)) {
+        throw std::runtime_error(std::string("Failed to compress data: ") +
+                                 ZSTD_getErrorName(size));
+    }
+    compressed.resize(size);
+    return compressed;
+#else
+    static_cast<void>(data);
+    return {};
+#endif
+}
+
+std::vector<unsigned char>
+CoverageDictionaries::decompress(std::uint32_t id, const unsigned char *pos,
+                                 const unsigned char *end)
+{
+#ifdef WITH_ZSTD
+    auto it = ddicts.find(id);
+    if (it == ddicts.end()) {
+        const std::vector<unsigned char> dict = load(id);
+        zstdPtr<ZSTD_DDict> ddict(ZSTD_createDDict(dict.data(), dict.size()),
+                                  &ZSTD_freeDDict);
+        if (!ddict) {
+            throw std::runtime_error("Failed to initialize decompression");
+        }
+        it = ddicts.emplace(id, std::move(ddict)).first;
+    }
+    if (!dctx) {
+        dctx = zstdPtr<ZSTD_DCtx>(ZSTD_createDCtx(), &ZSTD_freeDCtx);
+        if (!dctx) {
+            throw std::runtime_error("Failed to initialize decompression");
+        }
+    }
+
+    const unsigned long long expected = ZSTD_getFrameContentSize(pos,
+                                                                 end - pos);
+    if (expected == ZSTD_CONTENTSIZE_UNKNOWN ||
+        expected == ZSTD_CONTENTSIZE_ERROR ||
+        expected > MaxUncompressedSize) {
+        throw std::runtime_error("Corrupted coverage data");
+    }
+
+    std::vector<unsigned char> data(expected);
+    const std::size_t size =
+        ZSTD_decompress_usingDDict(dctx.get(), data.data(), data.size(),
+                                   pos, end - pos, it->second.get());
+    if (ZSTD_isError(size) || size != expected) {
+        throw std::runtime_error("Corrupted coverage data");
+    }
+    return data;
+#else
+    static_cast<void>(id);
+    static_cast<void>(pos);
+    static_cast<void>(end);
+    throw std::runtime_error("Coverage data is compressed with zstd, but "
+                             "built without zstd support");
+#endif
+}
+
+std::vector<unsigned char>
+CoverageDictionaries::load(std::uint32_t id)
+{
+    std::vector<unsigned char> dict = loader ? loader(id)
+                                             : std::vector<unsigned char>();
+    if (dict.empty()) {
+        throw std::runtime_error("Unknown coverage dictionary: " +
+                                 std::to_string(id));
+    }
+    if (getId(dict) != id) {
+        throw std::runtime_error("Corrupted coverage dictionary: " +
+                                 std::to_string(id));
+    }
+    return dict;
+}
+
+std::vector<unsigned char>
+encodeCoverage(const std::vector<int> &coverage, CoverageDictionaries *dicts)
+{
+    std::vector<unsigned char> blob;
+    blob.reserve(1U + 5U + coverage.size());
+
+    blob.push_back(static_cast<unsigned char>(CoverageCodec::VarintRle));
+    putVarintRle(blob, coverage);
+
+    if (dicts != nullptr && dicts->getActive() != 0U) {
+        const std::vector<unsigned char> compressed =
+            dicts->compress(std::vector<unsigned char>(blob.cbegin() + 1,
+                                                       blob.cend()));
+        std::vector<unsigned char> packed =
+            getCoveragePrefix(dicts->getActive());
+        // Short blobs don't benefit from compression.
+        if (!compressed.empty() &&
+            packed.size() + compressed.size() < blob.size()) {
+            packed.insert(packed.cend(), compressed.cbegin(),
+                          compressed.cend());
+            blob.swap(packed);
+        }
+    }
+
+    std::vector<unsigned char> state = {
+        static_cast<unsigned char>(CoverageCodec::State)
+    };
+    if (putState(state, coverage) && state.size() < blob.size()) {
+        return state;
+    }
+    return blob;
+}
+
+std::vector<int>
+dropHitCounts(std::vector<int> coverage)
+{
+    for (int &hits : coverage) {
+        if (hits > 1) {
+            hits = 1;
+        }
+    }
+    return coverage;
+}
+
+std::vector<unsigned char>
+getCoveragePrefix(std::uint32_t dictId)
+{
+    if (dictId == 0U) {
+        return { static_cast<unsigned char>(CoverageCodec::VarintRle) };
+    }
+
+    std::vector<unsigned char> prefix = {
+        static_cast<unsigned char>(CoverageCodec::ZstdDict)
+    };
+    putVarint(prefix, dictId);
+    return prefix;
+}
+
+std::vector<int>
+decodeCoverage(const unsigned char blob[], std::size_t size,
+               CoverageDictionaries *dicts)
+{
+    if (size == 0U) {
+        throw std::runtime_error("Empty coverage data");
+    }
+
+    if (blob[0] == static_cast<unsigned char>(CoverageCodec::VarintRle)) {
+        return decodeVarintRle(blob + 1, blob + size);
+    }
+
+    if (blob[0] == static_cast<unsigned char>(CoverageCodec::State)) {
+        return decodeState(blob + 1, blob + size);
+    }
+
+    if (blob[0] == static_cast<unsigned char>(CoverageCodec::ZstdDict)) {
+        const unsigned char *pos = blob + 1;
+        const unsigned char *const end = blob + size;
+        const std::uint64_t dictId = getVarint(pos, end);
+        if (dictId == 0U ||
+            dictId > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::runtime_error("Corrupted coverage data");
+        }
+        if (dicts == nullptr) {
+            throw std::runtime_error("No dictionaries to decode coverage");
+        }
+
+        const std::vector<unsigned char> data =
+            dicts->decompress(dictId, pos, end);
+        return decodeVarintRle(data.data(), data.data() + data.size());
+    }
+
+    return decodeLegacy(blob, size);
+}
+
+std::vector<int>
+diffCoverage(const std::vector<int> &base, const std::vector<int> &coverage)
+{
+    std::vector<int> delta;
+    delta.push_back(coverage.size());
+
+    std::size_t next = 0U;
+    for (std::size_t i = 0U; i < coverage.size(); ++i) {
+        const int old = (i < base.size() ? base[i] : -1);
+        if (coverage[i] != old) {
+            delta.push_back(i - next);
+            delta.push_back(coverage[i]);
+            next = i + 1U;
+        }
+    }
+
+    return delta;
+}
+
+std::vector<int>
+patchCoverage(const std::vector<int> &base, const std::vector<int> &delta)
+{
+    if (delta.empty() || delta[0] < 0 || delta.size()%2U != 1U) {
+        throw std::runtime_error("Malformed coverage difference");
+    }
+
+    const std::size_t size = delta[0];
+    std::vector<int> coverage(base.cbegin(),
+                              base.cbegin() + std::min(size, base.size()));
+    coverage.resize(size, -1);
+
+    std::size_t next = 0U;
+    for (std::size_t i = 1U; i < delta.size(); i += 2U) {
+        if (delta[i] < 0 || size - next <= std::size_t(delta[i])) {
+            throw std::runtime_error("Coverage difference is out of range");
+        }
+        next += delta[i];
+        coverage[next++] = delta[i + 1U];
+    }
+
+    return coverage;
+}
+
+/**
+ * @brief Appends coverage in CoverageCodec::VarintRle format without codec
+ *        byte to a blob.
+ *
+ * @param blob     Destination.
+ * @param coverage Coverage to serialize.
+ */
+static void
+putVarintRle(std::vector<unsigned char> &blob,
+             const std::vector<int> &coverage)
+{
+    putVarint(blob, coverage.size());
+
+    const std::size_t size = coverage.size();
+    for (std::size_t i = 0U; i < size; ) {
+        const int hits = coverage[i];
+
+        if (hits == -1 || hits == 0) {
+            std::size_t j = i + 1U;
+            while (j < size && coverage[j] == hits) {
+                ++j;
+            }
+
+            const std::size_t runLength = j - i;
+            if (runLength >= MinRunLength) {
+                // Run token: (length - min) << 2 | is-minus-one << 1 | 1.
+                putVarint(blob, (std::uint64_t(runLength - MinRunLength) << 2)
+                              | ((hits == -1) << 1)
+                              | 1U);
+                i = j;
+                continue;
+            }
+        }
+
+        // Literal token: zigzag-encoded value shifted left by one.
+        const std::uint32_t zigzag = (std::uint32_t(hits) << 1)
+                                   ^ std::uint32_t(hits >> 31);
+        putVarint(blob, std::uint64_t(zigzag) << 1);
+        ++i;
+    }
+}
+
+/**
+ * @brief Appends unsigned number to a blob in LEB128 format.
+ *
+ * @param blob  Destination.
+ * @param value The number.
+ */
+static void
+putVarint(std::vector<unsigned char> &blob, std::uint64_t value)
+{
+    while (value >= 0x80U) {
+        blob.push_back(static_cast<unsigned char>(value | 0x80U));
+        value >>= 7;
+    }
+    blob.push_back(static_cast<unsigned char>(value));
+}
+
+/**
+ * @brief Reads unsigned number in LEB128 format.
+ *
+ * @param pos Current position, which is advanced past the number.
+ * @param end End of input.
+ *
+ * @returns The number.
+ *
+ * @throws std::runtime_error on truncated or too long number.
+ */
+static std::uint64_t
+getVarint(const unsigned char *&pos, const unsigned char *end)
+{
+    std::uint64_t value = 0U;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos == end) {
+            throw std::runtime_error("Truncated coverage data");
+        }
+
+        const unsigned char byte = *pos++;
+        value |= std::uint64_t(byte & 0x7FU) << shift;
+        if ((byte & 0x80U) == 0U) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Corrupted coverage data");
+}
+
+/**
+ * @brief Decodes coverage in CoverageCodec::VarintRle format.
+ *
+ * @param pos Beginning of the data (past codec byte).
+ * @param end End of the data.
+ *
+ * @returns Coverage information.
+ *
+ * @throws std::runtime_error on corrupted data.
+ */
+static std::vector<int>
+decodeVarintRle(const unsigned char *pos, const unsigned char *end)
+{
+    const std::uint64_t size = getVarint(pos, end);
+    if (size > std::uint64_t(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Corrupted coverage data");
+    }
+
+    std::vector<int> coverage;
+    // Don't trust the size of corrupted data, every token takes at least a
+    // byte and yields at least one line.
+    coverage.reserve(std::min<std::uint64_t>(size, end - pos));
+
+    while (pos != end) {
+        const std::uint64_t token = getVarint(pos, end);
+
+        if (token & 1U) {
+            const std::uint64_t runLength = (token >> 2) + MinRunLength;
+            if (runLength > size - coverage.size()) {
+                throw std::runtime_error("Corrupted coverage data");
+            }
+            coverage.insert(coverage.end(), runLength,
+                            (token & 2U) ? -1 : 0);
+            continue;
+        }
+
+        const std::uint64_t zigzag = token >> 1;
+        if (zigzag > std::numeric_limits<std::uint32_t>::max() ||
+            coverage.size() == size) {
+            throw std::runtime_error("Corrupted coverage data");
+        }
+        const std::uint32_t value = static_cast<std::uint32_t>(zigzag);
+        const std::uint32_t sign = 0U - (value & 1U);
+        coverage.push_back(static_cast<int>((value >> 1) ^ sign));
+    }
+
+    if (coverage.size() != size) {
+        throw std::runtime_error("Truncated coverage data");
+    }
+    return coverage;
+}
+
+/**
+ * @brief Appends coverage in CoverageCodec::State format without codec byte
+ *        to a blob.
+ *
+ * Lines are stored from the lowest bits of a byte: @c 0 for irrelevant,
+ * @c 1 for missed and @c 2 for covered.
+ *
+ * @param blob     Destination.
+ * @param coverage Coverage to serialize.
+ *
+ * @returns @c false if coverage has hit counts, @c true otherwise.
+ */
+static bool
+putState(std::vector<unsigned char> &blob, const std::vector<int> &coverage)
+{
+    putVarint(blob, coverage.size());
+
+    unsigned char byte = 0U;
+    for (std::size_t i = 0U; i < coverage.size(); ++i) {
+        const int hits = coverage[i];
+        if (hits < -1 || hits > 1) {
+            return false;
+        }
+
+        byte |= static_cast<unsigned char>(hits + 1) << (i%4U*2U);
+        if (i%4U == 3U) {
+            blob.push_back(byte);
+            byte = 0U;
+        }
+    }
+    if (coverage.size()%4U != 0U) {
+        blob.push_back(byte);
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes coverage in CoverageCodec::State format.
+ *
+ * @param pos Beginning of the data (past codec byte).
+ * @param end End of the data.
+ *
+ * @returns Coverage information.
+ *
+ * @throws std::runtime_error on corrupted data.
+ */
+static std::vector<int>
+decodeState(const unsigned char *pos, const unsigned char *end)
+{
+    const std::uint64_t size = getVarint(pos, end);
+    if (size > std::uint64_t(std::numeric_limits<int>::max()) ||
+        std::uint64_t(end - pos) != (size + 3U)/4U) {
+        throw std::runtime_error("Corrupted coverage data");
+    }
+
+    std::vector<int> coverage;
+    coverage.reserve(size);
+    for (std::uint64_t i = 0U; i < size; ++i) {
+        const unsigned int state = (pos[i/4U] >> (i%4U*2U)) & 3U;
+        if (state == 3U) {
+            throw std::runtime_error("Corrupted coverage data");
+        }
+        coverage.push_back(static_cast<int>(state) - 1);
+    }
+    return coverage;
+}
+
+/**
+ * @brief Decodes coverage in legacy format.
+ *
+ * The format is zlib-compressed list of space-separated decimal numbers
+ * prefixed with 32-bit big-endian length of uncompressed data.  Data is
+ * inflated in chunks and parsed on the fly, so whole text is never
+ * materialized.
+ *
+ * @param blob Pointer to the beginning of the blob.
+ * @param size Size of the blob.
+ *
+ * @returns Coverage information.
+ *
+ * @throws std::runtime_error on corrupted data.
+ */
+static std::vector<int>
+decodeLegacy(const unsigned char blob[], std::size_t size)
+{
+    if (size < 4U) {
+        throw std::runtime_error("Truncated coverage data");
+    }
+
+    const unsigned long strSize = (static_cast<unsigned long>(blob[0]) << 24)
+                                + (blob[1] << 16) + (blob[2] << 8) + blob[3];
+
+    std::vector<int> coverage;
+    // Each number takes at least two characters, but don't trust the size
+    // more than maximum compression ratio of deflate allows.
+    coverage.reserve(std::min<unsigned long>(strSize, (size - 4U)*1032U)/2U);
+
+    z_stream zs = {};
+    zs.next_in = const_cast<unsigned char *>(&blob[4]);
+    zs.avail_in = size - 4U;
+    if (inflateInit(&zs) != Z_OK) {
+        throw std::runtime_error("Failed to uncompress data");
+    }
+    std::unique_ptr<z_stream, int (*)(z_streamp)> guard(&zs, &inflateEnd);
+
+    DecimalScanner scanner(coverage);
+    unsigned char chunk[16*1024];
+    int ret;
+    do {
+        zs.next_out = chunk;
+        zs.avail_out = sizeof(chunk);
+
+        ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            throw std::runtime_error("Failed to uncompress data");
+        }
+
+        scanner.feed(chunk, zs.next_out);
+    } while (ret != Z_STREAM_END);
+    scanner.finish();
+
+    return coverage;
+}
@@ -0,0 +1,286 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef UNCOV_COVERAGE_CODEC_HPP_
+#define UNCOV_COVERAGE_CODEC_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct ZSTD_CCtx_s;
+struct ZSTD_CDict_s;
+struct ZSTD_DCtx_s;
+struct ZSTD_DDict_s;
+
+/**
+ * @file coverage_codec.hpp
+ *
+ * @brief Serialization of coverage information for storing it in a database.
+ */
+
+/**
+ * @brief Identifies encoding of a coverage blob by its first byte.
+ *
+ * Values are picked from the top of the byte range, because the first byte of
+ * legacy blobs is the most significant byte of 32-bit length of uncompressed
+ * text, which can't reasonably get that big.
+ */
+enum class CoverageCodec : unsigned char
+{
+    //! Zigzag varints with run-lengths for stretches of @c -1 and @c 0.
+    VarintRle = 0xF1,
+    //! VarintRle data compressed by zstd using a dictionary.
+    ZstdDict = 0xF2,
+    //! Two bits per line for coverage that consists of @c -1, @c 0 and @c 1.
+    State = 0xF3,
+};
+
+/**
+ * @brief Dictionaries for compressing coverage with zstd.
+ *
+ * Dictionaries are identified by ids that zstd embeds in them, every blob
+ * records id of the dictionary it was compressed with.  One of the
+ * dictionaries can be active, which means that new blobs are compressed with
+ * it.  Without zstd support blobs are never compressed and compressed blobs
+ * can't be decoded.
+ */
+class CoverageDictionaries
+{
+public:
+    /**
+     * @brief Retrieves contents of a dictionary.
+     *
+     * Should return empty vector if there is no such dictionary.
+     */
+    using Loader = std::function<std::vector<unsigned char>(std::uint32_t id)>;
+
+public:
+    /**
+     * @brief Initializes an empty set of dictionaries.
+     *
+     * @param loader @copybrief loader
+     */
+    explicit CoverageDictionaries(Loader loader);
+
+    //! Not copyable, owns compression contexts.
+    CoverageDictionaries(const CoverageDictionaries &rhs) = delete;
+    //! Not copy-assignable.
+    CoverageDictionaries & operator=(const CoverageDictionaries &rhs) = delete;
+
+    /**
+     * @brief Frees dictionaries and compression contexts.
+     */
+    ~CoverageDictionaries();
+
+public:
+    /**
+     * @brief Checks whether zstd support was compiled in.
+     *
+     * @returns @c true if so, @c false otherwise.
+     */
+    static bool isSupported();
+
+    /**
+     * @brief Makes a dictionary out of sample coverage.
+     *
+     * @param samples Coverage of some files.
+     * @param maxSize Upper limit on size of the dictionary.
+     *
+     * @returns The dictionary.
+     *
+     * @throws std::runtime_error if zstd isn't supported or on failure to
+     *                            train a dictionary (e.g., too few samples).
+     */
+    static std::vector<unsigned char>
+    train(const std::vector<std::vector<int>> &samples, std::size_t maxSize);
+
+    /**
+     * @brief Retrieves id of a dictionary.
+     *
+     * @param dict The dictionary.
+     *
+     * @returns The id.
+     *
+     * @throws std::runtime_error if zstd isn't supported or it's not a valid
+     *                            dictionary.
+     */
+    static std::uint32_t getId(const std::vector<unsigned char> &dict);
+
+public:
+    /**
+     * @brief Retrieves id of the active dictionary.
+     *
+     * @returns The id or @c 0 if there is no active dictionary.
+     */
+    std::uint32_t getActive() const
+    {
+        return active;
+    }
+
+    /**
+     * @brief Picks dictionary to compress new blobs with.
+     *
+     * Contents of the dictionary is loaded on first use.
+     *
+     * @param id Id of the dictionary or @c 0 to store blobs uncompressed.
+     */
+    void setActive(std::uint32_t id);
+
+    /**
+     * @brief Compresses data with the active dictionary.
+     *
+     * @param data Data to compress.
+     *
+     * @returns Compressed data or empty vector if there is no active
+     *          dictionary or zstd isn't supported.
+     *
+     * @throws std::runtime_error on failure to load the dictionary.
+     */
+    std::vector<unsigned char> compress(const std::vector<unsigned char> &data);
+
+    /**
+     * @brief Uncompresses data.
+     *
+     * @param id  Id of the dictionary used to compress the data.
+     * @param pos Beginning of the data.
+     * @param end End of the data.
+     *
+     * @returns Uncompressed data.
+     *
+     * @throws std::runtime_error if zstd isn't supported, on failure to load
+     *                            the dictionary or on corrupted data.
+     */
+    std::vector<unsigned char> decompress(std::uint32_t id,
+                                          const unsigned char *pos,
+                                          const unsigned char *end);
+
+private:
+    /**
+     * @brief Retrieves contents of a dictionary checking it.
+     *
+     * @param id Id of the dictionary.
+     *
+     * @returns The dictionary.
+     *
+     * @throws std::runtime_error if it's missing or doesn't match the id.
+     */
+    std::vector<unsigned char> load(std::uint32_t id);
+
+private:
+    //! Smart pointer to a zstd object.
+    template <typename T>
+    using zstdPtr = std::unique_ptr<T, std::size_t (*)(T *)>;
+
+    Loader loader;        //!< Source of dictionaries.
+    std::uint32_t active; //!< Id of the active dictionary or @c 0.
+    //! Active dictionary prepared for compression, loaded lazily.
+    zstdPtr<ZSTD_CDict_s> cdict;
+    //! Dictionaries prepared for decompression by their ids.
+    std::unordered_map<std::uint32_t, zstdPtr<ZSTD_DDict_s>> ddicts;
+    zstdPtr<ZSTD_CCtx_s> cctx; //!< Compression context, created lazily.
+    zstdPtr<ZSTD_DCtx_s> dctx; //!< Decompression context, created lazily.
+};
+
+/**
+ * @brief Serializes coverage information into a blob.
+ *
+ * Blob is compressed if there is an active dictionary and it makes it smaller.
+ * Coverage without hit counts is packed by state of lines if that's smaller.
+ *
+ * @param coverage Coverage to serialize.
+ * @param dicts    Dictionaries to use or @c nullptr.
+ *
+ * @returns Blob starting with a codec byte.
+ *
+ * @throws std::runtime_error on failure to load active dictionary.
+ */
+std::vector<unsigned char>
+encodeCoverage(const std::vector<int> &coverage,
+               CoverageDictionaries *dicts = nullptr);
+
+/**
+ * @brief Replaces hit counts with state of lines.
+ *
+ * Covered lines get one hit, missed and irrelevant ones are left as is.
+ *
+ * @param coverage Coverage with hit counts.
+ *
+ * @returns Coverage that consists of @c -1, @c 0 and @c 1.
+ */
+std::vector<int> dropHitCounts(std::vector<int> coverage);
+
+/**
+ * @brief Computes prefix of blobs compressed with a dictionary.
+ *
+ * @param dictId Id of the dictionary or @c 0 for uncompressed blobs.
+ *
+ * @returns The prefix.
+ */
+std::vector<unsigned char> getCoveragePrefix(std::uint32_t dictId);
+
+/**
+ * @brief Deserializes coverage information.
+ *
+ * Understands all codecs as well as legacy format without codec byte
+ * (zlib-compressed decimal text prefixed with big-endian length).
+ *
+ * @param blob  Pointer to the beginning of the blob.
+ * @param size  Size of the blob.
+ * @param dicts Dictionaries to use or @c nullptr.
+ *
+ * @returns Coverage information.
+ *
+ * @throws std::runtime_error on corrupted data or unavailable dictionary.
+ */
+std::vector<int> decodeCoverage(const unsigned char blob[], std::size_t size,
+                                CoverageDictionaries *dicts = nullptr);
+
+/**
+ * @brief Computes difference between two versions of coverage.
+ *
+ * Result is itself a vector of integers, so it can be stored like coverage:
+ * size of the new version followed by pairs of number of unchanged lines
+ * since previous change and new value of the line.  Lines past the end of
+ * base version are treated as irrelevant (@c -1).
+ *
+ * @param base     Old version.
+ * @param coverage New version.
+ *
+ * @returns The difference.
+ */
+std::vector<int> diffCoverage(const std::vector<int> &base,
+                              const std::vector<int> &coverage);
+
+/**
+ * @brief Reconstructs new version of coverage from old one and a difference.
+ *
+ * @param base  Old version.
+ * @param delta Difference produced by diffCoverage().
+ *
+ * @returns New version.
+ *
+ * @throws std::runtime_error on corrupted difference.
+ */
+std::vector<int> patchCoverage(const std::vector<int> &base,
+                               const std::vector<int> &delta);
+
+#endif // UNCOV_COVERAGE_CODEC_HPP_
@@ -24,8 +24,8 @@
 #include <string>
 #include <vector>
 
-#include "utils/fs.hpp"
 #include "BuildHistory.hpp"
+#include "PathIndex.hpp"
 #include "coverage.hpp"
 #include "printing.hpp"
 
@@ -98,18 +98,13 @@ static std::map<std::string, CovInfo>
 getDirsCoverage(const Build &build, const std::string &dirFilter)
 {
     std::map<std::string, CovInfo> dirs;
-    for (const std::string &filePath : build.getPaths()) {
-        if (!pathIsInSubtree(dirFilter, filePath)) {
-            continue;
+    for (const auto &entry : build.getDirStats(dirFilter)) {
+        const DirStats &stats = entry.second;
+        // Only directories with files in them are listed.
+        if (stats.getOwnFileCount() != 0) {
+            dirs.emplace(entry.first, CovInfo(stats.getOwnCoveredCount(),
+                                              stats.getOwnMissedCount()));
         }
-
-        boost::filesystem::path dirPath = filePath;
-        dirPath.remove_filename();
-
-        File &file = *build.getFile(filePath);
-        CovInfo &info = dirs[dirPath.string()];
-
-        info.add(CovInfo(file));
     }
     return dirs;
 }
@@ -119,7 +114,10 @@ describeBuildFiles(BuildHistory *bh, const Build &build,
                    const std::string &dirFilter, ListChangedOnly changedOnly,
                    ListDirectOnly directOnly, const Build *prevBuild)
 {
-    const std::vector<std::string> &paths = build.getPaths();
+    const PathIndex &index = build.getPathIndex();
+    const std::vector<std::string> &paths = directOnly
+                                          ? index.getDirectFiles(dirFilter)
+                                          : index.getFiles(dirFilter);
 
     std::vector<std::vector<std::string>> rows;
     rows.reserve(paths.size());
@@ -131,19 +129,8 @@ describeBuildFiles(BuildHistory *bh, const Build &build,
         prev = bh->getBuild(prevBuildId);
     }
 
-    boost::filesystem::path dpath = dirFilter;
     for (const std::string &filePath : paths) {
-        boost::filesystem::path fpath = filePath;
-
-        if (!pathIsInSubtree(dpath, fpath)) {
-            continue;
-        }
-
-        if (directOnly && fpath.parent_path() != dpath) {
-            continue;
-        }
-
-        CovInfo covInfo(*build.getFile(filePath));
+        CovInfo covInfo(*build.getFileStats(filePath));
         CovChange covChange = getFileCovChange(bh, build, filePath, &prev,
                                                covInfo);
 
@@ -152,7 +139,8 @@ describeBuildFiles(BuildHistory *bh, const Build &build,
         }
 
         rows.push_back({
-            directOnly ? fpath.filename().string() : filePath,
+            directOnly ? boost::filesystem::path(filePath).filename().string()
+                       : filePath,
             covInfo.formatCoverageRate(),
             covInfo.formatLines(" / "),
             covChange.formatCoverageRate(),
@@ -222,8 +210,9 @@ printFileHeader(std::ostream &os, BuildHistory *bh, const Build &build,
                 const std::string &filePath, const Build *prevBuild)
 {
     CovInfo covInfo;
-    if (boost::optional<File &> file = build.getFile(filePath)) {
-        covInfo = CovInfo(*file);
+    if (boost::optional<const FileStats &> stats =
+            build.getFileStats(filePath)) {
+        covInfo = CovInfo(*stats);
     }
 
     CovChange covChange = getFileCovChange(bh, build, filePath, nullptr,
@@ -259,8 +248,9 @@ getFileCovChange(BuildHistory *bh, const Build &build, const std::string &path,
 
     CovInfo prevCovInfo;
     if (*prevBuildHint) {
-        if (boost::optional<File &> file = (*prevBuildHint)->getFile(path)) {
-            prevCovInfo = CovInfo(*file);
+        if (boost::optional<const FileStats &> stats =
+                (*prevBuildHint)->getFileStats(path)) {
+            prevCovInfo = CovInfo(*stats);
         }
     }
 
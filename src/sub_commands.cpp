@@ -26,12 +26,15 @@
 
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <ctime>
 
 #include <algorithm>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -44,12 +47,15 @@
 #include "FileComparator.hpp"
 #include "FilePrinter.hpp"
 #include "GcovImporter.hpp"
+#include "PathIndex.hpp"
+#include "PathInterner.hpp"
 #include "Repository.hpp"
 #include "Settings.hpp"
 #include "TablePrinter.hpp"
 #include "Uncov.hpp"
 #include "arg_parsing.hpp"
 #include "coverage.hpp"
+#include "coverage_codec.hpp"
 #include "integration.hpp"
 #include "listings.hpp"
 
@@ -257,6 +263,78 @@ static void printFile(BuildHistory *bh, const Repository *repo,
 static void printLineSeparator();
 static PathCategory classifyPath(const Build &build, const std::string &path);
 
+/**
+ * @brief Moves old builds into the archive.
+ */
+class ArchiveCmd : public AutoSubCommand<ArchiveCmd>
+{
+public:
+    using noArgsForm = Lst<>;
+    using callForms = Lst<noArgsForm>;
+    using buildForm = Lst<BuildId>;
+
+    ArchiveCmd() : AutoSubCommand({ "archive" },
+                                  0U, std::numeric_limits<std::size_t>::max())
+    {
+        describe("archive", "Moves old builds into the archive");
+
+        namespace po = boost::program_options;
+        options.add_options()
+            ("help,h", "display help message")
+            ("before", po::value<std::string>(),
+             "move builds older than the specified one");
+    }
+
+private:
+    virtual bool
+    modifiesDB() const override
+    {
+        return true;
+    }
+
+    virtual void printHelp(std::ostream &os,
+                           const std::string &/*alias*/) const override
+    {
+        os << "Usage: uncov archive --before <build>\n"
+           << "\nOptions:\n" << options;
+    }
+
+    virtual void
+    execImpl(const std::string &alias,
+             const std::vector<std::string> &args) override
+    {
+        namespace po = boost::program_options;
+
+        po::variables_map varMap;
+        po::store(po::command_line_parser(args).options(options).run(),
+                  varMap);
+        if (varMap.count("help")) {
+            printHelp(std::cout, alias);
+            return;
+        }
+
+        if (!varMap.count("before")) {
+            return usageError(alias);
+        }
+
+        BuildRef buildRef(bh);
+        if (auto parsed = tryParse({ varMap["before"].as<std::string>() },
+                                   buildForm{})) {
+            std::tie(buildRef) = *parsed;
+        } else {
+            return usageError(alias);
+        }
+
+        Build build = buildRef;
+        const int nMoved = bh->archiveBuilds(build.getId());
+        std::cout << "Archived builds: " << nMoved << '\n';
+    }
+
+private:
+    //! Options for the subcommand.
+    boost::program_options::options_description options;
+};
+
 /**
  * @brief Displays information about single build.
  */
@@ -453,16 +531,26 @@ private:
             }
         }
 
-        filePrinter.reset(new FilePrinter(*settings));
-
-        RedirectToPager redirectToPager;
-
         CompareStrategy strategy = (alias == "diff")
                                  ? CompareStrategy::State
                                  : (alias == "diff-hits")
                                  ? CompareStrategy::Hits
                                  : CompareStrategy::Regress;
 
+        if (strategy == CompareStrategy::Hits &&
+            (!oldBuild.hasHitCounts() || !newBuild.hasHitCounts())) {
+            const Build &build = oldBuild.hasHitCounts() ? newBuild
+                                                         : oldBuild;
+            std::cerr << "Hit counts aren't stored for build #"
+                      << build.getId() << ", comparing state of lines "
+                         "instead\n";
+            strategy = CompareStrategy::State;
+        }
+
+        filePrinter.reset(new FilePrinter(*settings));
+
+        RedirectToPager redirectToPager;
+
         if (buildsDiff) {
             diffBuilds(oldBuild, newBuild, path, strategy);
         } else {
@@ -485,24 +573,56 @@ private:
     void diffBuilds(const Build &oldBuild, const Build &newBuild,
                     const std::string &dirFilter, CompareStrategy strategy)
     {
-        const std::vector<std::string> &oldPaths = oldBuild.getPaths();
-        const std::vector<std::string> &newPaths = newBuild.getPaths();
-
-        std::set<std::string> allFiles(oldPaths.cbegin(), oldPaths.cend());
-        allFiles.insert(newPaths.cbegin(), newPaths.cend());
+        const PathIndex &oldIndex = oldBuild.getPathIndex();
+        const PathIndex &newIndex = newBuild.getPathIndex();
+        const std::vector<PathRef> oldPaths = oldIndex.getFileRefs(dirFilter);
+        auto nextOld = oldPaths.cbegin();
+        const bool sharedIds = oldBuild.sharesFileIds(newBuild);
 
         printInfo(oldBuild, newBuild, std::string(), true, false);
 
-        for (const std::string &path : allFiles) {
-            if (pathIsInSubtree(dirFilter, path)) {
-                diffFile(oldBuild, newBuild, path, false, strategy);
+        // Flush output stream so that user can start seeing output faster
+        // than output buffer fills up (this is actually noticeable as
+        // composing diffs and highlighting files takes time).
+        auto diffRemoved = [&](PathRef path) {
+            boost::optional<File> oldFile = oldBuild.loadFile(*path);
+            diffFiles(oldBuild, newBuild, *path, oldFile.get_ptr(), nullptr,
+                      false, strategy);
+            std::cout.flush();
+        };
 
-                // Flush output stream so that user can start seeing output
-                // faster than output buffer fills up (this is actually
-                // noticeable as composing diffs and highlighting files takes
-                // time).
-                std::cout.flush();
+        // Files of the new build are streamed in order of their paths and
+        // files of the old build are loaded one by one along the way, so
+        // only a couple of files are in memory at any time.
+        // Paths are interned, so they are compared as strings only to order
+        // files that exist in one of the builds.
+        newBuild.forEachFile(dirFilter, [&](const File &newFile) {
+            const PathRef pathRef = newFile.getPathRef();
+            const std::string &path = *pathRef;
+            while (nextOld != oldPaths.cend() && *nextOld != pathRef &&
+                   **nextOld < path) {
+                diffRemoved(*nextOld++);
+            }
+
+            boost::optional<File> oldFile;
+            if (nextOld != oldPaths.cend() && *nextOld == pathRef) {
+                ++nextOld;
+                // Builds of the same database share unchanged files, files
+                // of different ones are compared by diffFiles().
+                if (sharedIds &&
+                    oldIndex.getFileId(path) == newIndex.getFileId(path)) {
+                    return;
+                }
+                oldFile = oldBuild.loadFile(path);
             }
+
+            diffFiles(oldBuild, newBuild, path, oldFile.get_ptr(), &newFile,
+                      false, strategy);
+            std::cout.flush();
+        });
+
+        for (; nextOld != oldPaths.cend(); ++nextOld) {
+            diffRemoved(*nextOld);
         }
     }
 
@@ -521,15 +641,34 @@ private:
     {
         boost::optional<File &> oldFile = oldBuild.getFile(filePath);
         boost::optional<File &> newFile = newBuild.getFile(filePath);
+        diffFiles(oldBuild, newBuild, filePath, oldFile.get_ptr(),
+                  newFile.get_ptr(), standalone, strategy);
+    }
 
+    /**
+     * @brief Prints difference between two versions of a file.
+     *
+     * @param oldBuild   Original build.
+     * @param newBuild   Changed build.
+     * @param filePath   Path to the file.
+     * @param oldFile    File in original build or @c nullptr.
+     * @param newFile    File in changed build or @c nullptr.
+     * @param standalone Whether we're printing just one file.
+     * @param strategy   Comparison strategy.
+     */
+    void diffFiles(const Build &oldBuild, const Build &newBuild,
+                   const std::string &filePath, const File *oldFile,
+                   const File *newFile, bool standalone,
+                   CompareStrategy strategy)
+    {
         const std::string &oldHash = oldFile ? oldFile->getHash()
                                              : std::string();
         const std::string &newHash = newFile ? newFile->getHash()
                                              : std::string();
-        const std::vector<int> &oldCov = oldFile ? oldFile->getCoverage()
-                                                 : std::vector<int>{};
-        const std::vector<int> &newCov = newFile ? newFile->getCoverage()
-                                                 : std::vector<int>{};
+        const CompactCoverage &oldCov = oldFile ? oldFile->getCoverage()
+                                                : CompactCoverage();
+        const CompactCoverage &newCov = newFile ? newFile->getCoverage()
+                                                : CompactCoverage();
         if (oldHash == newHash && oldCov == newCov) {
             // Do nothing for files that didn't change at all.
             return;
@@ -686,6 +825,178 @@ private:
     }
 };
 
+/**
+ * @brief Removes old builds according to retention policies.
+ */
+class GcCmd : public AutoSubCommand<GcCmd>
+{
+public:
+    using noArgsForm = Lst<>;
+    using callForms = Lst<noArgsForm>;
+
+    GcCmd() : AutoSubCommand({ "gc" },
+                             0U, std::numeric_limits<std::size_t>::max())
+    {
+        describe("gc", "Removes old builds according to retention policies");
+
+        namespace po = boost::program_options;
+        options.add_options()
+            ("help,h",    "display help message")
+            ("dry-run,n", "only list builds that would be removed")
+            ("keep-last", po::value<int>(),
+             "keep N last builds of every ref name")
+            ("keep-newer", po::value<int>(),
+             "keep builds newer than N days")
+            ("keep-daily-after", po::value<int>(),
+             "keep one build per ref name per day for builds older than N "
+             "days and all newer builds");
+    }
+
+private:
+    virtual bool
+    modifiesDB() const override
+    {
+        return true;
+    }
+
+    virtual void printHelp(std::ostream &os,
+                           const std::string &/*alias*/) const override
+    {
+        os << "Usage: uncov gc [options...]\n"
+           << "\nA build is kept if any of the policies keeps it.  The last "
+              "build is always kept.\n"
+           << "\nOptions:\n" << options;
+    }
+
+    virtual void
+    execImpl(const std::string &alias,
+             const std::vector<std::string> &args) override
+    {
+        namespace po = boost::program_options;
+
+        po::variables_map varMap;
+        po::store(po::command_line_parser(args).options(options).run(),
+                  varMap);
+        if (varMap.count("help")) {
+            printHelp(std::cout, alias);
+            return;
+        }
+
+        if (!varMap.count("keep-last") && !varMap.count("keep-newer") &&
+            !varMap.count("keep-daily-after")) {
+            std::cerr << "At least one retention policy must be specified\n";
+            return error();
+        }
+        for (const char *policy : { "keep-last", "keep-newer",
+                                    "keep-daily-after" }) {
+            if (varMap.count(policy) && varMap[policy].as<int>() < 0) {
+                std::cerr << "Value of --" << policy
+                          << " can't be negative\n";
+                return error();
+            }
+        }
+
+        std::vector<Build> builds = bh->getBuilds();
+        std::set<int> kept = { bh->getLastBuildId() };
+
+        if (varMap.count("keep-last")) {
+            keepLast(builds, varMap["keep-last"].as<int>(), kept);
+        }
+        if (varMap.count("keep-newer")) {
+            keepNewer(builds, varMap["keep-newer"].as<int>(), kept);
+        }
+        if (varMap.count("keep-daily-after")) {
+            const int days = varMap["keep-daily-after"].as<int>();
+            keepNewer(builds, days, kept);
+            keepDaily(builds, kept);
+        }
+
+        std::vector<int> removed;
+        for (const Build &build : builds) {
+            if (kept.find(build.getId()) == kept.end()) {
+                removed.push_back(build.getId());
+            }
+        }
+
+        if (varMap.count("dry-run")) {
+            for (int id : removed) {
+                std::cout << "Would remove build #" << id << '\n';
+            }
+            return;
+        }
+
+        bh->removeBuilds(removed);
+        const GarbageStats stats = bh->collectGarbage();
+
+        std::cout << "Removed builds: " << removed.size() << '\n'
+                  << "Removed file entries: " << stats.files << '\n'
+                  << "Removed coverage entries: " << stats.coverage << '\n'
+                  << "Released pages: " << stats.pages << '\n';
+    }
+
+    /**
+     * @brief Marks last builds of every reference name as kept.
+     *
+     * @param builds All builds in ascending order of their ids.
+     * @param n      Number of builds to keep per reference name.
+     * @param kept   Set of ids of builds to keep.
+     */
+    static void keepLast(const std::vector<Build> &builds, int n,
+                         std::set<int> &kept)
+    {
+        std::map<std::string, int> counts;
+        for (auto it = builds.crbegin(); it != builds.crend(); ++it) {
+            if (counts[it->getRefName()]++ < n) {
+                kept.insert(it->getId());
+            }
+        }
+    }
+
+    /**
+     * @brief Marks builds newer than specified age as kept.
+     *
+     * @param builds All builds in ascending order of their ids.
+     * @param days   Age limit in days.
+     * @param kept   Set of ids of builds to keep.
+     */
+    static void keepNewer(const std::vector<Build> &builds, int days,
+                          std::set<int> &kept)
+    {
+        const std::time_t threshold = std::time(nullptr)
+                                   - std::time_t{days}*SecsPerDay;
+        for (const Build &build : builds) {
+            if (build.getTimestamp() > threshold) {
+                kept.insert(build.getId());
+            }
+        }
+    }
+
+    /**
+     * @brief Marks last build of every reference name per day as kept.
+     *
+     * @param builds All builds in ascending order of their ids.
+     * @param kept   Set of ids of builds to keep.
+     */
+    static void keepDaily(const std::vector<Build> &builds,
+                          std::set<int> &kept)
+    {
+        std::set<std::pair<std::string, std::time_t>> seen;
+        for (auto it = builds.crbegin(); it != builds.crend(); ++it) {
+            const std::time_t day = it->getTimestamp()/SecsPerDay;
+            if (seen.emplace(it->getRefName(), day).second) {
+                kept.insert(it->getId());
+            }
+        }
+    }
+
+private:
+    //! Number of seconds in a day.
+    static constexpr int SecsPerDay = 24*60*60;
+
+    //! Options for the subcommand.
+    boost::program_options::options_description options;
+};
+
 /**
  * @brief Displays help message.
  */
@@ -767,6 +1078,96 @@ private:
     }
 };
 
+/**
+ * @brief Updates data stored by older versions.
+ */
+class MigrateCmd : public AutoSubCommand<MigrateCmd>
+{
+public:
+    using noArgsForm = Lst<>;
+    using callForms = Lst<noArgsForm>;
+
+    MigrateCmd() : AutoSubCommand({ "migrate" },
+                                  0U, std::numeric_limits<std::size_t>::max())
+    {
+        describe("migrate", "Updates data stored by older versions");
+
+        namespace po = boost::program_options;
+        options.add_options()
+            ("help,h",     "display help message")
+            ("status,s",   "only display progress")
+            ("batch-size", po::value<int>()->default_value(1000),
+             "number of rows to update per transaction")
+            ("compact",
+             "rewrite database afterwards to minimize its size (blocks "
+             "other commands)");
+    }
+
+private:
+    virtual bool
+    modifiesDB() const override
+    {
+        return true;
+    }
+
+    virtual void printHelp(std::ostream &os,
+                           const std::string &/*alias*/) const override
+    {
+        os << "Usage: uncov migrate [options...]\n"
+           << "\nCan be interrupted and continued later, other commands can "
+              "run meanwhile.\n"
+           << "\nOptions:\n" << options;
+    }
+
+    virtual void
+    execImpl(const std::string &alias,
+             const std::vector<std::string> &args) override
+    {
+        namespace po = boost::program_options;
+
+        po::variables_map varMap;
+        po::store(po::command_line_parser(args).options(options).run(),
+                  varMap);
+        if (varMap.count("help")) {
+            printHelp(std::cout, alias);
+            return;
+        }
+
+        const int batchSize = varMap["batch-size"].as<int>();
+        if (batchSize <= 0) {
+            std::cerr << "Batch size must be positive\n";
+            return error();
+        }
+
+        if (varMap.count("status")) {
+            for (const MigrationProgress &progress : bh->getMigrations()) {
+                std::cout << progress.name << ": " << progress.position
+                          << " / " << progress.last << '\n';
+            }
+            return;
+        }
+
+        std::vector<MigrationProgress> pending = bh->getMigrations();
+        while (!pending.empty()) {
+            const std::string name = pending.front().name;
+            (void)bh->migrate(batchSize);
+
+            pending = bh->getMigrations();
+            if (pending.empty() || pending.front().name != name) {
+                std::cout << name << ": done\n";
+            }
+        }
+
+        if (varMap.count("compact")) {
+            bh->compact();
+        }
+    }
+
+private:
+    //! Options for the subcommand.
+    boost::program_options::options_description options;
+};
+
 /**
  * @brief Imports new build from stdin.
  */
@@ -782,6 +1183,12 @@ public:
     }
 
 private:
+    virtual bool
+    modifiesDB() const override
+    {
+        return true;
+    }
+
     virtual void
     execImpl(const std::string &/*alias*/,
              const std::vector<std::string> &/*args*/) override
@@ -897,6 +1304,12 @@ public:
     }
 
 private:
+    virtual bool
+    modifiesDB() const override
+    {
+        return true;
+    }
+
     virtual void printHelp(std::ostream &os,
                            const std::string &/*alias*/) const override
     {
@@ -1113,6 +1526,12 @@ public:
     }
 
 private:
+    virtual bool
+    modifiesDB() const override
+    {
+        return true;
+    }
+
     virtual void
     execImpl(const std::string &/*alias*/,
              const std::vector<std::string> &/*args*/) override
@@ -1192,6 +1611,99 @@ private:
     }
 };
 
+/**
+ * @brief Compresses stored coverage with a newly trained dictionary.
+ */
+class RecompressCmd : public AutoSubCommand<RecompressCmd>
+{
+public:
+    using noArgsForm = Lst<>;
+    using callForms = Lst<noArgsForm>;
+
+    RecompressCmd()
+        : AutoSubCommand({ "recompress" },
+                         0U, std::numeric_limits<std::size_t>::max())
+    {
+        describe("recompress",
+                 "Compresses coverage with a newly trained dictionary");
+
+        namespace po = boost::program_options;
+        options.add_options()
+            ("help,h",     "display help message")
+            ("no-dict",    "store coverage uncompressed")
+            ("samples",    po::value<int>()->default_value(10000),
+             "number of latest coverage entries to train dictionary on")
+            ("dict-size",  po::value<int>()->default_value(112640),
+             "maximum size of dictionary in bytes")
+            ("batch-size", po::value<int>()->default_value(1000),
+             "number of rows to update per transaction");
+    }
+
+private:
+    virtual bool
+    modifiesDB() const override
+    {
+        return true;
+    }
+
+    virtual void printHelp(std::ostream &os,
+                           const std::string &/*alias*/) const override
+    {
+        os << "Usage: uncov recompress [options...]\n"
+           << "\nCan be interrupted and continued later via migrate "
+              "subcommand.\n"
+           << "\nOptions:\n" << options;
+    }
+
+    virtual void
+    execImpl(const std::string &alias,
+             const std::vector<std::string> &args) override
+    {
+        namespace po = boost::program_options;
+
+        po::variables_map varMap;
+        po::store(po::command_line_parser(args).options(options).run(),
+                  varMap);
+        if (varMap.count("help")) {
+            printHelp(std::cout, alias);
+            return;
+        }
+
+        const int samples = varMap["samples"].as<int>();
+        const int dictSize = varMap["dict-size"].as<int>();
+        const int batchSize = varMap["batch-size"].as<int>();
+        if (samples <= 0 || dictSize <= 0 || batchSize <= 0) {
+            std::cerr << "Sizes must be positive\n";
+            return error();
+        }
+
+        if (varMap.count("no-dict")) {
+            bh->useDictionary(0U);
+        } else {
+            if (!CoverageDictionaries::isSupported()) {
+                std::cerr << "Compression requires zstd support, which "
+                             "wasn't compiled in\n";
+                return error();
+            }
+
+            const std::uint32_t id = bh->trainDictionary(samples, dictSize);
+            bh->useDictionary(id);
+            std::cout << "Trained dictionary: " << id << '\n';
+        }
+
+        while (bh->migrate(batchSize)) {
+            // Everything is done by migrate().
+        }
+
+        const int nRemoved = bh->removeUnusedDictionaries();
+        std::cout << "Removed unused dictionaries: " << nRemoved << '\n';
+    }
+
+private:
+    //! Options for the subcommand.
+    boost::program_options::options_description options;
+};
+
 /**
  * @brief Displays a build, directory or file.
  */
@@ -1238,27 +1750,52 @@ private:
             return error();
         }
 
+        const bool leaveMissedOnly = (alias == "missed");
+
+        if (!leaveMissedOnly && !build.hasHitCounts()) {
+            std::cerr << "Hit counts aren't stored for build #"
+                      << build.getId() << ", covered lines are shown with "
+                         "one hit\n";
+        }
+
         FilePrinter printer(*settings);
         RedirectToPager redirectToPager;
         printBuildHeader(std::cout, bh, build);
 
-        const bool leaveMissedOnly = (alias == "missed");
+        if (printWholeBuild || fileType == PathCategory::Directory) {
+            const std::string dirFilter = printWholeBuild ? std::string()
+                                                          : path.str();
+            auto print = [&](const File &file) {
+                printFile(bh, repo, build, file, printer, leaveMissedOnly);
+            };
 
-        if (printWholeBuild) {
-            for (const std::string &path : build.getPaths()) {
-                printFile(bh, repo, build, *build.getFile(path), printer,
-                          leaveMissedOnly);
+            if (!leaveMissedOnly) {
+                build.forEachFile(dirFilter, print);
+                return;
             }
-        } else if (fileType == PathCategory::Directory) {
-            for (const std::string &filePath : build.getPaths()) {
-                if (pathIsInSubtree(path.str(), filePath)) {
-                    printFile(bh, repo, build, *build.getFile(filePath),
-                              printer, leaveMissedOnly);
+
+            // Files without missed lines are recognized by their statistics
+            // to avoid loading them, so streaming would mostly do extra work.
+            for (const std::string &filePath :
+                 build.getPathIndex().getFiles(dirFilter)) {
+                if (build.getFileStats(filePath)->getMissedCount() == 0) {
+                    continue;
+                }
+
+                if (boost::optional<File> file = build.loadFile(filePath)) {
+                    print(*file);
+                } else {
+                    std::cerr << "Failed to load file " << filePath
+                              << " of build #" << build.getId() << "\n";
+                    error();
                 }
             }
+        } else if (boost::optional<File &> file = build.getFile(path)) {
+            printFile(bh, repo, build, *file, printer, leaveMissedOnly);
         } else {
-            printFile(bh, repo, build, *build.getFile(path), printer,
-                      leaveMissedOnly);
+            std::cerr << "Failed to load file " << path.str() << " of build #"
+                      << build.getId() << "\n";
+            error();
         }
     }
 };
@@ -1300,7 +1837,7 @@ static void
 printFile(BuildHistory *bh, const Repository *repo, const Build &build,
           const File &file, FilePrinter &printer, bool leaveMissedOnly)
 {
-    const std::vector<int> &coverage = file.getCoverage();
+    const CompactCoverage &coverage = file.getCoverage();
 
     if (leaveMissedOnly && std::none_of(coverage.cbegin(), coverage.cend(),
                                         [](int x) { return x == 0; })) {
@@ -1315,7 +1852,7 @@ printFile(BuildHistory *bh, const Repository *repo, const Build &build,
     const std::string &path = file.getPath();
     const std::string &ref = build.getRef();
     printer.print(std::cout, path, repo->readFile(ref, path), coverage,
-                  leaveMissedOnly);
+                  file.getMaxHits(), leaveMissedOnly);
 }
 
 /**
@@ -1339,16 +1876,12 @@ printLineSeparator()
 static PathCategory
 classifyPath(const Build &build, const std::string &path)
 {
-    for (const std::string &filePath : build.getPaths()) {
-        if (filePath == path) {
-            return PathCategory::File;
-        }
-
-        boost::filesystem::path dirPath = filePath;
-        dirPath.remove_filename();
-        if (dirPath == path) {
-            return PathCategory::Directory;
-        }
+    const PathIndex &index = build.getPathIndex();
+    if (index.isFile(path)) {
+        return PathCategory::File;
+    }
+    if (index.isDirectory(path)) {
+        return PathCategory::Directory;
     }
     return PathCategory::None;
 }
@@ -99,3 +99,15 @@ readFile(const std::string &path)
     iss << ifile.rdbuf();
     return iss.str();
 }
+
+bool
+isWritable(const std::string &path)
+{
+    if (!fs::is_regular_file(path)) {
+        return false;
+    }
+
+    // Opening for update neither creates nor truncates the file.
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    return file.is_open();
+}
@@ -124,4 +124,15 @@ boost::filesystem::path makeRelativePath(boost::filesystem::path base,
  */
 std::string readFile(const std::string &path);
 
+/**
+ * @brief Checks whether existing file can be modified.
+ *
+ * Accounts for permissions as well as for read-only file systems.
+ *
+ * @param path Path to the file.
+ *
+ * @returns @c true if so, otherwise @c false.
+ */
+bool isWritable(const std::string &path);
+
 #endif // UNCOV_UTILS_FS_HPP_
@@ -43,14 +43,12 @@ struct Idx;
 
 /**
  * @brief Tail specialization of integer sequence builder.
- *
- * @tparam T Tail type.
  */
-template <typename T>
-struct Idx<T>
+template <>
+struct Idx<>
 {
     //! Integer sequence type.
-    using type = integer_sequence<0U>;
+    using type = integer_sequence<>;
 };
 
 /**
@@ -0,0 +1,116 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <boost/optional.hpp>
+
+#include <cstddef>
+
+#include <string>
+#include <vector>
+
+#include "BuildCache.hpp"
+#include "BuildHistory.hpp"
+#include "PathInterner.hpp"
+
+TEST_CASE("Paths and files are cached", "[BuildCache]")
+{
+    BuildCache cache(1024U*1024U);
+
+    PathMap paths;
+    CHECK(!cache.getPaths(1, paths));
+    CHECK(!cache.getFile(1));
+
+    cache.putPaths(1, { { internPath("a.cpp"), 10 },
+                        { internPath("b.cpp"), 20 } });
+    cache.putFile(10, File("a.cpp", "hash", { -1, 0, 3 }));
+
+    REQUIRE(cache.getPaths(1, paths));
+    CHECK(paths == (PathMap{ { internPath("a.cpp"), 10 },
+                             { internPath("b.cpp"), 20 } }));
+
+    boost::optional<File> file = cache.getFile(10);
+    REQUIRE(file);
+    CHECK(file->getPath() == "a.cpp");
+    CHECK(file->getHash() == "hash");
+    CHECK(file->getCoverage() == std::vector<int>({ -1, 0, 3 }));
+
+    CHECK(!cache.getPaths(10, paths));
+    CHECK(!cache.getFile(1));
+    CHECK(cache.getSize() != 0U);
+
+    cache.clear();
+    CHECK(!cache.getPaths(1, paths));
+    CHECK(!cache.getFile(10));
+    CHECK(cache.getSize() == 0U);
+}
+
+TEST_CASE("Least recently used entries are evicted", "[BuildCache]")
+{
+    const File file("a.cpp", "hash", std::vector<int>(100, 1));
+
+    BuildCache sizer(1024U*1024U);
+    sizer.putFile(1, file);
+    const std::size_t fileSize = sizer.getSize();
+
+    BuildCache cache(3U*fileSize);
+    cache.putFile(1, file);
+    cache.putFile(2, file);
+    cache.putFile(3, file);
+    CHECK(cache.getSize() == 3U*fileSize);
+
+    // Using the oldest entry makes the second one the oldest.
+    CHECK(cache.getFile(1));
+    cache.putFile(4, file);
+    CHECK(cache.getSize() == 3U*fileSize);
+    CHECK(cache.getFile(1));
+    CHECK(!cache.getFile(2));
+    CHECK(cache.getFile(3));
+    CHECK(cache.getFile(4));
+
+    cache.setBudget(fileSize);
+    CHECK(cache.getSize() == fileSize);
+    CHECK(cache.getFile(4));
+    CHECK(!cache.getFile(1));
+    CHECK(!cache.getFile(3));
+}
+
+TEST_CASE("Entries that exceed budget aren't cached", "[BuildCache]")
+{
+    SECTION("Zero budget disables caching")
+    {
+        BuildCache cache(0U);
+        cache.putFile(1, File("a.cpp", "hash", { 1 }));
+        cache.putPaths(1, { { internPath("a.cpp"), 1 } });
+
+        PathMap paths;
+        CHECK(!cache.getFile(1));
+        CHECK(!cache.getPaths(1, paths));
+        CHECK(cache.getSize() == 0U);
+    }
+
+    SECTION("Large entry doesn't evict others")
+    {
+        BuildCache cache(4096U);
+        cache.putFile(1, File("a.cpp", "hash", { 1 }));
+        cache.putFile(2, File("b.cpp", "hash", std::vector<int>(4096, 100)));
+
+        CHECK(cache.getFile(1));
+        CHECK(!cache.getFile(2));
+    }
+}
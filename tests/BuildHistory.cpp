@@ -16,14 +16,38 @@
 
 #include "Catch/catch.hpp"
 
+#include <boost/filesystem/operations.hpp>
 #include <boost/optional.hpp>
+#include <boost/scope_exit.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "BuildCache.hpp"
 #include "BuildHistory.hpp"
+#include "CoveragePack.hpp"
 #include "DB.hpp"
+#include "DBProfile.hpp"
+#include "PathInterner.hpp"
 #include "Repository.hpp"
 
 #include "TestUtils.hpp"
 
+namespace fs = boost::filesystem;
+
 TEST_CASE("BuildHistory throws on too new database schema", "[BuildHistory]")
 {
     Repository repo("tests/test-repo/subdir");
@@ -35,6 +59,83 @@ TEST_CASE("BuildHistory throws on too new database schema", "[BuildHistory]")
     REQUIRE_THROWS_AS(BuildHistory bh(db), const std::runtime_error &);
 }
 
+TEST_CASE("Schema of read-only database is updated", "[BuildHistory]")
+{
+    // Tracked copy of the database is never opened and stays at version 2.
+    const std::string dbPath = "tests/read-only-schema.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+        std::remove((dbPath + "-shm").c_str());
+        std::remove((dbPath + "-wal").c_str());
+    };
+    fs::copy_file("tests/test-repo/_git/uncov.sqlite", dbPath);
+
+    DB db(dbPath, DBMode::ReadOnly);
+    BuildHistory bh(db);
+
+    std::tuple<int> vals = db.queryOne("pragma user_version");
+    REQUIRE(std::get<0>(vals) > 2);
+    REQUIRE(bh.getBuild(1));
+}
+
+TEST_CASE("Schema is updated once on concurrent opening", "[BuildHistory]")
+{
+    const std::string dbPath = "tests/concurrent-schema.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+        std::remove((dbPath + "-shm").c_str());
+        std::remove((dbPath + "-wal").c_str());
+    };
+    fs::copy_file("tests/test-repo/_git/uncov.sqlite", dbPath);
+
+    // Both connections see outdated schema before either of them updates it.
+    DB first(dbPath);
+    DB second(dbPath);
+
+    std::atomic<int> failures(0);
+    auto open = [&failures](DB &db) {
+        try {
+            BuildHistory bh(db);
+        } catch (const std::runtime_error &) {
+            ++failures;
+        }
+    };
+
+    std::thread thread(open, std::ref(first));
+    open(second);
+    thread.join();
+
+    CHECK(failures == 0);
+    CHECK(BuildHistory(first).getBuild(1));
+}
+
+TEST_CASE("Schema of snapshot isn't updated", "[BuildHistory]")
+{
+    Repository repo("tests/test-repo/subdir");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+
+    SECTION("Outdated schema")
+    {
+        DB(dbPath).execute("pragma user_version = 2");
+
+        DB db(dbPath, DBMode::Snapshot);
+        REQUIRE_THROWS_AS(BuildHistory bh(db), const std::runtime_error &);
+    }
+
+    SECTION("Current schema")
+    {
+        {
+            DB db(dbPath);
+            BuildHistory bh(db);
+        }
+
+        DB db(dbPath, DBMode::Snapshot);
+        BuildHistory bh(db);
+        REQUIRE(bh.getBuild(1));
+    }
+}
+
 TEST_CASE("List of builds on unknown branch is empty", "[BuildHistory]")
 {
     Repository repo("tests/test-repo/subdir");
@@ -45,10 +146,93 @@ TEST_CASE("List of builds on unknown branch is empty", "[BuildHistory]")
     REQUIRE(BuildHistory(db).getBuildsOn(":wrong").empty());
 }
 
+TEST_CASE("Queries of builds and files don't scan tables", "[BuildHistory]")
+{
+    class Settings : public BuildHistorySettings
+    {
+    public:
+        virtual int getCoverageDeltaChain() const override
+        {
+            return 2;
+        }
+
+        virtual bool isCoveragePackEnabled() const override
+        {
+            return false;
+        }
+
+        virtual bool isHitCountStored() const override
+        {
+            return true;
+        }
+
+        virtual int getBuildCacheSize() const override
+        {
+            return 64;
+        }
+    };
+
+    DB db(":memory:");
+    BuildHistory bh(db);
+    bh.configure(Settings());
+
+    // Statements are collected from regular use of the history.
+    DBProfile profile;
+    db.setProfile(&profile);
+
+    for (int i = 0; i < 3; ++i) {
+        BuildData bd("ref" + std::to_string(i), "branch");
+        bd.addFile(File("src/a.cpp", "hash" + std::to_string(i), { -1, i }));
+        bd.addFile(File("top.cpp", "hash", { 0 }));
+        bh.addBuild(bd);
+    }
+
+    for (int id = 1; id <= 3; ++id) {
+        Build build = *bh.getBuild(id);
+        CHECK(build.getPaths().size() == 2U);
+        CHECK(build.getFileStats("top.cpp"));
+        CHECK(build.getFile("src/a.cpp"));
+        CHECK(!build.getDirStats("src").empty());
+        build.prefetchFiles("src");
+    }
+    CHECK(bh.getBuildsOn("branch").size() == 3U);
+    CHECK(bh.getPreviousBuildId(3) == 2);
+    CHECK(bh.getNToLastBuildId(1) == 2);
+    bh.removeBuilds({ 1 });
+
+    db.setProfile(nullptr);
+
+    std::vector<std::string> scans;
+    for (const auto &entry : profile.getStats()) {
+        const std::string &sql = entry.first;
+        // Staging table is processed as a whole and is gone by now.
+        if (sql.find("stagedfiles") != std::string::npos) {
+            continue;
+        }
+
+        for (std::tuple<int, int, int, std::string> vals :
+             db.queryAll("EXPLAIN QUERY PLAN " + sql)) {
+            const std::string &detail = std::get<3>(vals);
+            // Tables with a couple of rows and scans in order of the key
+            // stopped by a limit are fine.
+            if (detail.compare(0U, 5U, "SCAN ") != 0 ||
+                detail.find("dictionaries") != std::string::npos ||
+                detail.find("backfills") != std::string::npos ||
+                sql.find("LIMIT") != std::string::npos) {
+                continue;
+            }
+            scans.push_back(detail + ": " + sql);
+        }
+    }
+    CHECK(scans == std::vector<std::string>());
+}
+
 TEST_CASE("File is loaded from database", "[Build][File]")
 {
     Repository repo("tests/test-repo/subdir");
-    DB db(getDbPath(repo));
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+    DB db(dbPath);
     BuildHistory bh(db);
 
     boost::optional<Build> build = bh.getBuild(1);
@@ -61,3 +245,1040 @@ TEST_CASE("File is loaded from database", "[Build][File]")
 
     REQUIRE(file->getCoverage() == vi({ -1, 1, -1, 1, -1 }));
 }
+
+TEST_CASE("File statistics are loaded from database", "[Build][FileStats]")
+{
+    Repository repo("tests/test-repo/subdir");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+    DB db(dbPath);
+    BuildHistory bh(db);
+
+    boost::optional<Build> build = bh.getBuild(1);
+    REQUIRE(build);
+
+    boost::optional<const FileStats &> stats =
+        build->getFileStats("test-file1.cpp");
+    REQUIRE(stats);
+    CHECK(stats->getCoveredCount() == 2);
+    CHECK(stats->getMissedCount() == 0);
+    CHECK(stats->getMaxHits() == 1);
+
+    CHECK(!build->getFileStats("no-such-file"));
+}
+
+TEST_CASE("File statistics are computed from coverage", "[FileStats]")
+{
+    FileStats stats({ -1, 0, 7, 1, 0, 0 });
+    CHECK(stats.getCoveredCount() == 2);
+    CHECK(stats.getMissedCount() == 3);
+    CHECK(stats.getMaxHits() == 7);
+
+    File file("path", "hash", { -1, 3, 0 });
+    CHECK(file.getCoveredCount() == 1);
+    CHECK(file.getMissedCount() == 1);
+    CHECK(file.getMaxHits() == 3);
+}
+
+TEST_CASE("Hash of a file is preserved", "[File]")
+{
+    const std::string md5 = "0123456789abcdef0123456789abcdef";
+    CHECK(File("path", md5, {}).getHash() == md5);
+
+    const std::string upperMd5 = "0123456789ABCDEF0123456789ABCDEF";
+    CHECK(File("path", upperMd5, {}).getHash() == upperMd5);
+
+    CHECK(File("path", "hash", {}).getHash() == "hash");
+    CHECK(File("path", "", {}).getHash() == "");
+}
+
+TEST_CASE("Copies of a file share its data", "[File]")
+{
+    const File file("path", "hash", { -1, 3, 0 });
+    const File copy = file;
+    CHECK(&copy.getPath() == &file.getPath());
+    CHECK(&copy.getCoverage() == &file.getCoverage());
+    CHECK(copy.getCoverage() == vi({ -1, 3, 0 }));
+}
+
+TEST_CASE("Files of a build are loaded in bulk", "[Build][File]")
+{
+    Repository repo("tests/test-repo/subdir");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+    DB db(dbPath);
+    BuildHistory bh(db);
+
+    boost::optional<Build> build = bh.getBuild(1);
+    REQUIRE(build);
+
+    build->prefetchFiles();
+
+    boost::optional<File &> file = build->getFile("test-file1.cpp");
+    REQUIRE(file);
+    REQUIRE(file->getCoverage() == vi({ -1, 1, -1, 1, -1 }));
+}
+
+TEST_CASE("Prefetched files aren't loaded again", "[Build][File]")
+{
+    class Loader : public DataLoader
+    {
+    public:
+        virtual PathMap loadPaths(int) override
+        {
+            return { { internPath("a/file"), 1 },
+                     { internPath("b/file"), 2 } };
+        }
+
+        virtual boost::optional<File> loadFile(int fileid) override
+        {
+            ++nLoadFile;
+            return File(fileid == 1 ? "a/file" : "b/file", "hash", { 1 });
+        }
+
+        virtual std::vector<File> loadFiles(int,
+                                            const std::string &prefix) override
+        {
+            ++nLoadFiles;
+            std::vector<File> files;
+            if (std::string("a/file").compare(0, prefix.size(), prefix) == 0) {
+                files.emplace_back("a/file", "hash", std::vector<int>{ 1 });
+            }
+            return files;
+        }
+
+        virtual void
+        streamFiles(int, const std::string &,
+                    const std::function<void(const File &)> &) override
+        {
+            throw std::logic_error("Files shouldn't be streamed");
+        }
+
+        virtual std::unordered_map<PathRef, FileStats>
+        loadFileStats(int) override
+        {
+            return { { internPath("a/file"), FileStats(1, 0, 1) },
+                     { internPath("b/file"), FileStats(1, 0, 1) } };
+        }
+
+        virtual std::map<std::string, DirStats>
+        loadDirStats(int, const std::string &) override
+        {
+            return {};
+        }
+
+    public:
+        int nLoadFile = 0;
+        int nLoadFiles = 0;
+    };
+
+    Loader loader;
+    Build build(1, "ref", "name", 1, 0, 0, true, loader);
+
+    build.prefetchFiles("a");
+    REQUIRE(loader.nLoadFiles == 1);
+
+    CHECK(build.getFile("a/file"));
+    CHECK(loader.nLoadFile == 0);
+    CHECK(build.getFile("b/file"));
+    CHECK(loader.nLoadFile == 1);
+}
+
+TEST_CASE("Files are streamed in order of paths", "[Build][File]")
+{
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    BuildData bd("ref", "name");
+    bd.addFile(File("top.cpp", "hash", { 1, 0 }));
+    bd.addFile(File("a/b/c.cpp", "hash", { 1, 1, 0 }));
+    bd.addFile(File("ab/e.cpp", "hash", { 1 }));
+    bd.addFile(File("a/d.cpp", "hash", { 0, -1 }));
+    Build build = bh.addBuild(bd);
+
+    auto collect = [&build](const std::string &dirFilter) {
+        std::vector<std::string> paths;
+        build.forEachFile(dirFilter, [&paths](const File &file) {
+            paths.push_back(file.getPath());
+        });
+        return paths;
+    };
+
+    CHECK(collect("") == std::vector<std::string>({ "a/b/c.cpp", "a/d.cpp",
+                                                    "ab/e.cpp", "top.cpp" }));
+    CHECK(collect("a") ==
+          std::vector<std::string>({ "a/b/c.cpp", "a/d.cpp" }));
+    CHECK(collect("a/d.cpp") == std::vector<std::string>({ "a/d.cpp" }));
+    CHECK(collect("b").empty());
+
+    build.forEachFile("ab", [](const File &file) {
+        CHECK(file.getCoverage() == vi({ 1 }));
+        CHECK(file.getStats().getCoveredCount() == 1);
+    });
+
+    boost::optional<File> file = build.loadFile("a/d.cpp");
+    REQUIRE(file);
+    CHECK(file->getCoverage() == vi({ 0, -1 }));
+    CHECK(!build.loadFile("a"));
+}
+
+TEST_CASE("File statistics don't require loading files", "[Build][FileStats]")
+{
+    class Loader : public DataLoader
+    {
+    public:
+        virtual PathMap loadPaths(int) override
+        {
+            return { { internPath("file"), 1 } };
+        }
+
+        virtual boost::optional<File> loadFile(int) override
+        {
+            throw std::logic_error("File shouldn't be loaded");
+        }
+
+        virtual std::vector<File> loadFiles(int, const std::string &) override
+        {
+            throw std::logic_error("Files shouldn't be loaded");
+        }
+
+        virtual void
+        streamFiles(int, const std::string &,
+                    const std::function<void(const File &)> &) override
+        {
+            throw std::logic_error("Files shouldn't be loaded");
+        }
+
+        virtual std::unordered_map<PathRef, FileStats>
+        loadFileStats(int) override
+        {
+            return { { internPath("file"), FileStats(10, 5, 100) } };
+        }
+
+        virtual std::map<std::string, DirStats>
+        loadDirStats(int, const std::string &) override
+        {
+            return {};
+        }
+    };
+
+    Loader loader;
+    Build build(1, "ref", "name", 10, 5, 0, true, loader);
+
+    boost::optional<const FileStats &> stats = build.getFileStats("file");
+    REQUIRE(stats);
+    CHECK(stats->getCoveredCount() == 10);
+    CHECK(stats->getMissedCount() == 5);
+    CHECK(stats->getMaxHits() == 100);
+}
+
+TEST_CASE("Directory statistics are stored along with a build",
+          "[BuildHistory][DirStats]")
+{
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    BuildData bd("ref", "name");
+    bd.addFile(File("top.cpp", "hash", { 1, 0 }));
+    bd.addFile(File("a/b/c.cpp", "hash", { 1, 1, 0 }));
+    bd.addFile(File("a/b/d.cpp", "hash", { 0, -1 }));
+    bd.addFile(File("ab/e.cpp", "hash", { 1 }));
+    Build build = bh.addBuild(bd);
+
+    std::map<std::string, DirStats> all = build.getDirStats();
+    REQUIRE(all.size() == 4U);
+
+    const DirStats &root = all.at("");
+    CHECK(root.getCoveredCount() == 4);
+    CHECK(root.getMissedCount() == 3);
+    CHECK(root.getOwnCoveredCount() == 1);
+    CHECK(root.getOwnMissedCount() == 1);
+    CHECK(root.getOwnFileCount() == 1);
+
+    const DirStats &a = all.at("a");
+    CHECK(a.getCoveredCount() == 2);
+    CHECK(a.getMissedCount() == 2);
+    CHECK(a.getOwnFileCount() == 0);
+
+    const DirStats &ab = all.at("a/b");
+    CHECK(ab.getOwnCoveredCount() == 2);
+    CHECK(ab.getOwnMissedCount() == 2);
+    CHECK(ab.getOwnFileCount() == 2);
+
+    std::map<std::string, DirStats> subtree = build.getDirStats("a");
+    REQUIRE(subtree.size() == 2U);
+    CHECK(subtree.count("a") == 1U);
+    CHECK(subtree.count("a/b") == 1U);
+
+    CHECK(build.getDirStats("a/b/c.cpp").empty());
+}
+
+TEST_CASE("Identical coverage is stored once", "[BuildHistory]")
+{
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    BuildData bd1("ref1", "name");
+    bd1.addFile(File("a.hpp", "hash1", { -1, 1, 0 }));
+    bd1.addFile(File("vendor/a.hpp", "hash1", { -1, 1, 0 }));
+    bd1.addFile(File("b.hpp", "hash2", { -1, 1, 0 }));
+    bd1.addFile(File("c.hpp", "hash3", { 0, 1, -1 }));
+    bh.addBuild(bd1);
+
+    BuildData bd2("ref2", "name");
+    bd2.addFile(File("renamed.hpp", "hash1", { -1, 1, 0 }));
+    Build build = bh.addBuild(bd2);
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM coverage");
+    CHECK(std::get<0>(vals) == 2);
+
+    vals = db.queryOne("SELECT count(*) FROM files");
+    CHECK(std::get<0>(vals) == 5);
+
+    boost::optional<File &> file = build.getFile("renamed.hpp");
+    REQUIRE(file);
+    CHECK(file->getCoverage() == vi({ -1, 1, 0 }));
+}
+
+TEST_CASE("Coverage can be stored as differences", "[BuildHistory]")
+{
+    class Settings : public BuildHistorySettings
+    {
+    public:
+        virtual int getCoverageDeltaChain() const override
+        {
+            return 2;
+        }
+
+        virtual bool isCoveragePackEnabled() const override
+        {
+            return false;
+        }
+
+        virtual bool isHitCountStored() const override
+        {
+            return true;
+        }
+
+        virtual int getBuildCacheSize() const override
+        {
+            return 64;
+        }
+    };
+
+    DB db(":memory:");
+    BuildHistory bh(db);
+    bh.configure(Settings());
+
+    std::vector<int> coverage(20, -1);
+    std::vector<std::vector<int>> versions;
+    std::vector<int> buildids;
+    for (int i = 0; i < 5; ++i) {
+        coverage[i] = i;
+        versions.push_back(coverage);
+
+        BuildData bd("ref" + std::to_string(i), "name");
+        bd.addFile(File("file.cpp", "hash", coverage));
+        bd.addFile(File("small.cpp", "hash", { i }));
+        buildids.push_back(bh.addBuild(bd).getId());
+    }
+
+    std::vector<int> depths;
+    for (std::tuple<int> vals :
+         db.queryAll("SELECT depth FROM coverage JOIN files USING (covid) "
+                     "WHERE path = 'file.cpp' ORDER BY covid")) {
+        depths.push_back(std::get<0>(vals));
+    }
+    CHECK(depths == vi({ 0, 1, 2, 0, 1 }));
+
+    std::tuple<int> vals =
+        db.queryOne("SELECT count(*) FROM coverage JOIN files USING (covid) "
+                    "WHERE path = 'small.cpp' AND base IS NOT NULL");
+    CHECK(std::get<0>(vals) == 0);
+
+    for (int i = 0; i < 5; ++i) {
+        boost::optional<Build> build = bh.getBuild(buildids[i]);
+        REQUIRE(build);
+
+        boost::optional<File &> file = build->getFile("file.cpp");
+        REQUIRE(file);
+        CHECK(file->getCoverage() == versions[i]);
+
+        build->prefetchFiles();
+        CHECK(build->getFile("small.cpp")->getCoverage() == vi({ i }));
+    }
+
+    BuildData bd("ref", "name");
+    bd.addFile(File("file.cpp", "hash", versions[2]));
+    bh.addBuild(bd);
+
+    vals = db.queryOne("SELECT count(*) FROM coverage");
+    CHECK(std::get<0>(vals) == 10);
+}
+
+// Run explicitly with `tests "[bench]"` to see timings.
+TEST_CASE("Hit counts can be left out", "[BuildHistory]")
+{
+    class Settings : public BuildHistorySettings
+    {
+    public:
+        virtual int getCoverageDeltaChain() const override
+        {
+            return 0;
+        }
+
+        virtual bool isCoveragePackEnabled() const override
+        {
+            return false;
+        }
+
+        virtual bool isHitCountStored() const override
+        {
+            return false;
+        }
+
+        virtual int getBuildCacheSize() const override
+        {
+            return 64;
+        }
+    };
+
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    BuildData withHits("ref1", "name");
+    withHits.addFile(File("file.cpp", "hash", { -1, 5, 0 }));
+    CHECK(bh.addBuild(withHits).hasHitCounts());
+
+    bh.configure(Settings());
+    BuildData withoutHits("ref2", "name");
+    withoutHits.addFile(File("file.cpp", "hash", { -1, 5, 0, 2 }));
+    Build build = bh.addBuild(withoutHits);
+
+    CHECK(!build.hasHitCounts());
+    CHECK(build.getCoveredCount() == 2);
+    CHECK(build.getMissedCount() == 1);
+    CHECK(build.getFileStats("file.cpp")->getMaxHits() == 1);
+    CHECK(build.getFile("file.cpp")->getCoverage() == vi({ -1, 1, 0, 1 }));
+
+    CHECK(bh.getBuild(1)->getFile("file.cpp")->getCoverage() ==
+          vi({ -1, 5, 0 }));
+    CHECK(bh.getBuildsOn("name").front().hasHitCounts());
+}
+
+TEST_CASE("Removed builds leave gaps in identifiers", "[BuildHistory]")
+{
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    for (int i = 0; i < 4; ++i) {
+        BuildData bd("ref" + std::to_string(i), "name");
+        bd.addFile(File("dir/file.cpp", "hash", { i }));
+        bh.addBuild(bd);
+    }
+
+    bh.removeBuilds({ 2, 3 });
+    REQUIRE_THROWS_AS(bh.removeBuilds({ 4 }), const std::runtime_error &);
+
+    CHECK(!bh.getBuild(2));
+    CHECK(!bh.getBuild(3));
+    CHECK(bh.getPreviousBuildId(4) == 1);
+    CHECK(bh.getPreviousBuildId(1) == 0);
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM dirstats "
+                                       "WHERE buildid IN (2, 3)");
+    CHECK(std::get<0>(vals) == 0);
+
+    BuildData bd("ref", "name");
+    CHECK(bh.addBuild(bd).getId() == 5);
+}
+
+TEST_CASE("Ids of removed files aren't reused", "[BuildHistory][BuildCache]")
+{
+    const std::string dbPath = "tests/reused-ids.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+        std::remove((dbPath + "-shm").c_str());
+        std::remove((dbPath + "-wal").c_str());
+    };
+
+    DB writerDB(dbPath);
+    BuildHistory writer(writerDB);
+
+    auto addBuild = [&writer](const std::string &path, int hits) {
+        BuildData bd("ref", "name");
+        bd.addFile(File(path, "hash", { hits }));
+        return writer.addBuild(bd).getId();
+    };
+    addBuild("a.cpp", 1);
+    const int removedid = addBuild("b.cpp", 2);
+    addBuild("a.cpp", 1);
+
+    // Long-running process like uncov-web with a cache that is shared by
+    // its histories.
+    auto cache = std::make_shared<BuildCache>(1024U*1024U);
+    DB readerDB(dbPath, DBMode::ReadOnly);
+    BuildHistory warmReader(readerDB);
+    warmReader.setCache(cache);
+    CHECK(warmReader.getBuild(removedid)->getFile("b.cpp"));
+
+    // The file with the largest id is removed by another process.
+    writer.removeBuilds({ removedid });
+    REQUIRE(writer.collectGarbage().files == 1);
+    const int newid = addBuild("c.cpp", 3);
+
+    DB otherDB(dbPath, DBMode::ReadOnly);
+    BuildHistory reader(otherDB);
+    reader.setCache(cache);
+    boost::optional<Build> build = reader.getBuild(newid);
+    REQUIRE(build);
+    boost::optional<File &> file = build->getFile("c.cpp");
+    REQUIRE(file);
+    CHECK(file->getPath() == "c.cpp");
+    CHECK(file->getCoverage() == vi({ 3 }));
+}
+
+TEST_CASE("Garbage collection keeps used files and coverage",
+          "[BuildHistory]")
+{
+    class Settings : public BuildHistorySettings
+    {
+    public:
+        virtual int getCoverageDeltaChain() const override
+        {
+            return 5;
+        }
+
+        virtual bool isCoveragePackEnabled() const override
+        {
+            return false;
+        }
+
+        virtual bool isHitCountStored() const override
+        {
+            return true;
+        }
+
+        virtual int getBuildCacheSize() const override
+        {
+            return 64;
+        }
+    };
+
+    DB db(":memory:");
+    BuildHistory bh(db);
+    bh.configure(Settings());
+
+    std::vector<int> coverage(20, -1);
+    std::vector<std::vector<int>> versions;
+    for (int i = 0; i < 4; ++i) {
+        coverage[i] = i;
+        versions.push_back(coverage);
+
+        BuildData bd("ref" + std::to_string(i), "name");
+        bd.addFile(File("file.cpp", "hash", coverage));
+        bd.addFile(File("other.cpp", "hash" + std::to_string(i), { i }));
+        bh.addBuild(bd);
+    }
+
+    bh.removeBuilds({ 1, 2 });
+    GarbageStats stats = bh.collectGarbage(1);
+
+    // Coverage of the first build is a base of differences of later ones.
+    CHECK(stats.files == 4);
+    CHECK(stats.coverage == 2);
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM files");
+    CHECK(std::get<0>(vals) == 4);
+
+    CHECK(bh.getBuild(3)->getFile("file.cpp")->getCoverage() == versions[2]);
+    CHECK(bh.getBuild(4)->getFile("file.cpp")->getCoverage() == versions[3]);
+    CHECK(bh.getBuild(4)->getFile("other.cpp")->getCoverage() == vi({ 3 }));
+
+    stats = bh.collectGarbage();
+    CHECK(stats.files == 0);
+    CHECK(stats.coverage == 0);
+}
+
+TEST_CASE("Old builds can be moved to the archive", "[BuildHistory]")
+{
+    class Settings : public BuildHistorySettings
+    {
+    public:
+        virtual int getCoverageDeltaChain() const override
+        {
+            return 5;
+        }
+
+        virtual bool isCoveragePackEnabled() const override
+        {
+            return false;
+        }
+
+        virtual bool isHitCountStored() const override
+        {
+            return true;
+        }
+
+        virtual int getBuildCacheSize() const override
+        {
+            return 64;
+        }
+    };
+
+    const std::string dbPath = "tests/archive-main.sqlite";
+    const std::string archivePath = "tests/archive-test.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath, archivePath) {
+        for (const std::string &path : { dbPath, archivePath }) {
+            std::remove(path.c_str());
+            std::remove((path + "-shm").c_str());
+            std::remove((path + "-wal").c_str());
+        }
+    };
+
+    DB db(dbPath);
+    BuildHistory bh(db);
+    bh.configure(Settings());
+
+    std::vector<int> coverage(20, -1);
+    std::vector<std::vector<int>> versions;
+    for (int i = 0; i < 5; ++i) {
+        coverage[i] = i;
+        versions.push_back(coverage);
+
+        BuildData bd("ref" + std::to_string(i), "name");
+        bd.addFile(File("file.cpp", "hash", coverage));
+        bd.addFile(File("same.cpp", "hash", { 1 }));
+        bh.addBuild(bd);
+    }
+
+    REQUIRE_THROWS_AS(bh.archiveBuilds(3), const std::runtime_error &);
+
+    bh.setArchivePath(archivePath);
+    CHECK(bh.archiveBuilds(3) == 2);
+
+    auto checkBuilds = [&](BuildHistory &bh) {
+        for (int i = 0; i < 5; ++i) {
+            boost::optional<Build> build = bh.getBuild(i + 1);
+            REQUIRE(build);
+            CHECK(build->getRefName() == "name");
+            CHECK(build->getFile("file.cpp")->getCoverage() == versions[i]);
+            CHECK(build->getFile("same.cpp")->getCoverage() == vi({ 1 }));
+        }
+    };
+
+    CHECK(bh.getBuilds().size() == 3U);
+    CHECK(bh.getPreviousBuildId(3) == 2);
+    checkBuilds(bh);
+
+    // Ids of files of the archive are unrelated to ids in the main database.
+    CHECK(bh.getBuild(3)->sharesFileIds(*bh.getBuild(4)));
+    CHECK(!bh.getBuild(2)->sharesFileIds(*bh.getBuild(3)));
+
+    // All builds but the last one.
+    CHECK(bh.archiveBuilds(100) == 2);
+    CHECK(bh.getBuilds().size() == 1U);
+    CHECK(bh.getLastBuildId() == 5);
+    checkBuilds(bh);
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM files");
+    CHECK(std::get<0>(vals) == 2);
+
+    {
+        DB archiveDB(archivePath, DBMode::ReadOnly);
+        BuildHistory archive(archiveDB);
+        CHECK(archive.getBuilds().size() == 4U);
+
+        vals = archiveDB.queryOne("SELECT count(*) FROM files "
+                                  "WHERE path = 'same.cpp'");
+        CHECK(std::get<0>(vals) == 1);
+    }
+
+    // New builds continue numbering.
+    BuildData bd("ref", "name");
+    CHECK(bh.addBuild(bd).getId() == 6);
+
+    BuildHistory reopened(db);
+    reopened.setArchivePath(archivePath);
+    checkBuilds(reopened);
+    CHECK(!reopened.getBuild(100));
+}
+
+TEST_CASE("Interrupted archiving can be repeated", "[BuildHistory]")
+{
+    const std::string archivePath = "tests/archive-rerun.sqlite";
+    BOOST_SCOPE_EXIT_ALL(archivePath) {
+        std::remove(archivePath.c_str());
+        std::remove((archivePath + "-shm").c_str());
+        std::remove((archivePath + "-wal").c_str());
+    };
+
+    auto addBuilds = [](BuildHistory &bh) {
+        for (int i = 0; i < 3; ++i) {
+            BuildData bd("ref" + std::to_string(i), "name");
+            bd.addFile(File("file.cpp", "hash", { i }));
+            bh.addBuild(bd);
+        }
+    };
+
+    DB first(":memory:");
+    BuildHistory firstBH(first);
+    addBuilds(firstBH);
+    firstBH.setArchivePath(archivePath);
+    CHECK(firstBH.archiveBuilds(3) == 2);
+
+    // Identical database plays the role of one whose builds were copied to
+    // the archive, but weren't removed from it.
+    DB second(":memory:");
+    BuildHistory secondBH(second);
+    addBuilds(secondBH);
+    secondBH.setArchivePath(archivePath);
+    CHECK(secondBH.archiveBuilds(3) == 2);
+    CHECK(secondBH.getBuilds().size() == 1U);
+
+    for (int i = 0; i < 3; ++i) {
+        boost::optional<Build> build = secondBH.getBuild(i + 1);
+        REQUIRE(build);
+        CHECK(build->getFile("file.cpp")->getCoverage() == vi({ i }));
+    }
+
+    DB archiveDB(archivePath, DBMode::ReadOnly);
+    std::tuple<int> vals = archiveDB.queryOne("SELECT count(*) FROM filemap");
+    CHECK(std::get<0>(vals) == 2);
+    vals = archiveDB.queryOne("SELECT count(*) FROM builds");
+    CHECK(std::get<0>(vals) == 2);
+}
+
+TEST_CASE("Coverage pack is read instead of database", "[BuildHistory]")
+{
+    class Settings : public BuildHistorySettings
+    {
+    public:
+        virtual int getCoverageDeltaChain() const override
+        {
+            return 2;
+        }
+
+        virtual bool isCoveragePackEnabled() const override
+        {
+            return true;
+        }
+
+        virtual bool isHitCountStored() const override
+        {
+            return true;
+        }
+
+        virtual int getBuildCacheSize() const override
+        {
+            return 64;
+        }
+    };
+
+    const std::string packPath = "tests/bh-coverage.pack";
+    BOOST_SCOPE_EXIT_ALL(packPath) {
+        std::remove(packPath.c_str());
+    };
+
+    DB db(":memory:");
+    BuildHistory bh(db);
+    bh.configure(Settings());
+
+    BuildData first("ref", "name");
+    first.addFile(File("old.cpp", "hash", { 1 }));
+    bh.addBuild(first);
+
+    bh.setPackPath(packPath);
+    for (int i = 0; i < 3; ++i) {
+        BuildData bd("ref" + std::to_string(i), "name");
+        bd.addFile(File("src/a.cpp", "hash" + std::to_string(i),
+                        { -1, i, 0 }));
+        bd.addFile(File("src/b.cpp", "hash", { 1, 1 }));
+        bd.addFile(File("top.cpp", "hash", { 0 }));
+        bh.addBuild(bd);
+    }
+
+    {
+        // Pack that didn't exist starts with the build that created it.
+        CoveragePack pack(packPath);
+        CHECK(!pack.hasBuild(1));
+        CHECK(pack.hasBuild(2));
+        CHECK(pack.getLastBuildId() == 4);
+    }
+
+    // Make database disagree with the pack to see where data comes from.
+    db.execute("UPDATE files SET hash = 'db'");
+
+    boost::optional<Build> build = bh.getBuild(4);
+    REQUIRE(build);
+    CHECK(build->getPaths() ==
+          std::vector<std::string>({ "src/a.cpp", "src/b.cpp", "top.cpp" }));
+    CHECK(build->getFile("src/a.cpp")->getHash() == "hash2");
+    CHECK(build->getFile("src/a.cpp")->getCoverage() == vi({ -1, 2, 0 }));
+    CHECK(build->getFileStats("top.cpp")->getMissedCount() == 1);
+    CHECK(build->getDirStats("src").at("src").getCoveredCount() == 3);
+
+    build->prefetchFiles("src");
+    CHECK(build->getFile("src/b.cpp")->getCoverage() == vi({ 1, 1 }));
+
+    // Pack isn't checked for changes on every file of a stream, so its
+    // removal doesn't affect files after the first one.
+    std::vector<std::string> hashes;
+    build->forEachFile("", [&](const File &file) {
+        std::remove(packPath.c_str());
+        hashes.push_back(file.getHash());
+    });
+    CHECK(hashes == std::vector<std::string>({ "hash2", "hash", "hash" }));
+
+    CHECK(bh.getBuild(1)->getFile("old.cpp")->getHash() == "db");
+
+    // Removal of files makes the pack obsolete, but not the cache.
+    bh.removeBuilds({ 2 });
+    REQUIRE(bh.collectGarbage().files != 0);
+    CHECK(!std::ifstream(packPath));
+    CHECK(bh.getBuild(4)->getFile("src/a.cpp")->getHash() == "hash2");
+
+    BuildHistory uncached(db);
+    uncached.setPackPath(packPath);
+    CHECK(uncached.getBuild(4)->getFile("src/a.cpp")->getHash() == "db");
+}
+
+TEST_CASE("Old data is migrated in resumable batches", "[BuildHistory]")
+{
+    Repository repo("tests/test-repo/subdir");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+
+    auto describe = [](BuildHistory &bh) {
+        std::vector<std::string> lines;
+        for (const Build &build : bh.getBuilds()) {
+            const std::string id = std::to_string(build.getId()) + ' ';
+            for (const std::string &path : build.getPaths()) {
+                const File &file = *build.getFile(path);
+                const FileStats &stats = *build.getFileStats(path);
+                lines.push_back(id + path + ' ' +
+                                std::to_string(file.getCoverage().size()) +
+                                ' ' + std::to_string(file.getCoveredCount()) +
+                                ' ' + std::to_string(stats.getMissedCount()));
+            }
+            for (const auto &entry : build.getDirStats()) {
+                lines.push_back(id + entry.first + "/ " +
+                                std::to_string(entry.second.getCoveredCount()) +
+                                ' ' +
+                                std::to_string(entry.second.getOwnFileCount()));
+            }
+        }
+        return lines;
+    };
+
+    std::vector<std::string> expected;
+    {
+        DB db(dbPath);
+        BuildHistory bh(db);
+        REQUIRE(bh.getMigrations().size() == 4U);
+        expected = describe(bh);
+        REQUIRE(!expected.empty());
+        CHECK(bh.migrate(1));
+    }
+
+    // Interrupted migration continues where it has stopped.
+    DB db(dbPath);
+    BuildHistory bh(db);
+    std::vector<MigrationProgress> migrations = bh.getMigrations();
+    REQUIRE(migrations.size() == 4U);
+    CHECK(migrations[0].name == "filemap");
+    CHECK(migrations[0].position == 1);
+    CHECK(describe(bh) == expected);
+
+    // Builds can be added in the middle of migration.
+    BuildData bd("ref", "name");
+    bd.addFile(File("test-file1.cpp", "hash", { -1, 1, 0 }));
+    const int buildid = bh.addBuild(bd).getId();
+
+    int nBatches = 0;
+    while (bh.migrate(1)) {
+        ++nBatches;
+    }
+    CHECK(nBatches > 3);
+    CHECK(bh.getMigrations().empty());
+
+    boost::optional<Build> build = bh.getBuild(buildid);
+    REQUIRE(build);
+    CHECK(build->getFile("test-file1.cpp")->getCoverage() == vi({ -1, 1, 0 }));
+    CHECK(build->getDirStats().at("").getMissedCount() == 1);
+
+    // Data of old builds is the same after migration.
+    const std::string newBuild = std::to_string(buildid) + ' ';
+    BuildHistory migrated(db);
+    std::vector<std::string> lines = describe(migrated);
+    lines.erase(std::remove_if(lines.begin(), lines.end(),
+                               [&](const std::string &line) {
+                                   return line.compare(0U, newBuild.size(),
+                                                       newBuild) == 0;
+                               }),
+                lines.end());
+    CHECK(lines == expected);
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM files "
+                                       "WHERE covid IS NULL");
+    CHECK(std::get<0>(vals) == 0);
+
+    std::tuple<std::string> type = db.queryOne("SELECT type "
+                                               "FROM sqlite_master "
+                                               "WHERE name = 'filemap'");
+    CHECK(std::get<0>(type) == "table");
+}
+
+TEST_CASE("Builds can be removed in the middle of migration",
+          "[BuildHistory]")
+{
+    Repository repo("tests/test-repo/subdir");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+
+    DB db(dbPath);
+    BuildHistory bh(db);
+    REQUIRE(bh.migrate(2));
+
+    // Files of the last removed build are at the end of old mapping.
+    BuildData bd("ref", "name");
+    bd.addFile(File("new.cpp", "hash", { 1 }));
+    const int buildid = bh.addBuild(bd).getId();
+    bh.removeBuilds({ 3 });
+    CHECK(!bh.getBuild(3));
+
+    while (bh.migrate(2)) {
+        // Everything is done by migrate().
+    }
+    CHECK(bh.getMigrations().empty());
+
+    CHECK(bh.getBuild(1)->getPaths().size() == 2U);
+    CHECK(bh.getBuild(buildid)->getPaths() == vs({ "new.cpp" }));
+}
+
+TEST_CASE("Only stored dictionary can be used", "[BuildHistory]")
+{
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    REQUIRE_THROWS_AS(bh.useDictionary(12345U), const std::runtime_error &);
+
+    bh.useDictionary(0U);
+    CHECK(bh.getMigrations().empty());
+    CHECK(bh.removeUnusedDictionaries() == 0);
+}
+
+#ifdef WITH_ZSTD
+
+TEST_CASE("Coverage is recompressed with a trained dictionary",
+          "[BuildHistory]")
+{
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    auto countCompressed = [&db]() {
+        std::tuple<int> vals = db.queryOne("SELECT count(*) FROM coverage "
+                                           "WHERE substr(data, 1, 1) = "
+                                                 "x'F2'");
+        return std::get<0>(vals);
+    };
+
+    unsigned int state = 1U;
+    std::vector<std::vector<int>> stored;
+    for (int i = 0; i < 20; ++i) {
+        BuildData bd("ref" + std::to_string(i), "name");
+        for (int j = 0; j < 20; ++j) {
+            std::vector<int> coverage;
+            while (coverage.size() < 300U) {
+                state = state*1103515245U + 12345U;
+                const unsigned int kind = (state >> 16) % 4U;
+                coverage.insert(coverage.end(), 1U + (state >> 24) % 5U,
+                                kind < 2U ? -1 : kind < 3U ? 0 : i + j);
+            }
+            stored.push_back(coverage);
+            bd.addFile(File("file" + std::to_string(j), "hash", coverage));
+        }
+        bh.addBuild(bd);
+    }
+
+    auto readAll = [&bh]() {
+        std::vector<std::vector<int>> coverage;
+        for (const Build &build : bh.getBuilds()) {
+            for (int j = 0; j < 20; ++j) {
+                coverage.push_back(build.getFile("file" + std::to_string(j))
+                                        ->getCoverage());
+            }
+        }
+        return coverage;
+    };
+    REQUIRE(readAll() == stored);
+
+    const std::uint32_t id = bh.trainDictionary(1000, 4096);
+    bh.useDictionary(id);
+    REQUIRE(bh.getMigrations().size() == 1U);
+    while (bh.migrate(7)) {
+        // Everything is done by migrate().
+    }
+    CHECK(bh.getMigrations().empty());
+    CHECK(countCompressed() > 300);
+    CHECK(readAll() == stored);
+    CHECK(bh.removeUnusedDictionaries() == 0);
+
+    std::vector<int> changed = stored.back();
+    changed[0] = 1000;
+    BuildData bd("newref", "name");
+    bd.addFile(File("file0", "newhash", changed));
+    const int before = countCompressed();
+    bh.addBuild(bd);
+    CHECK(countCompressed() == before + 1);
+
+    bh.useDictionary(0U);
+    while (bh.migrate(7)) {
+        // Everything is done by migrate().
+    }
+    CHECK(countCompressed() == 0);
+    CHECK(bh.removeUnusedDictionaries() == 1);
+}
+
+#endif
+
+TEST_CASE("Importing 50k-file build", "[.][bench][BuildHistory]")
+{
+    using clock = std::chrono::steady_clock;
+
+    const int nFiles = 50000;
+
+    DB db(":memory:");
+    BuildHistory bh(db);
+
+    auto makeBuild = [&](int changed) {
+        BuildData bd("ref", "name");
+        for (int i = 0; i < nFiles; ++i) {
+            std::vector<int> coverage(200, -1);
+            coverage[i % 200] = (i < changed ? 2 : 1);
+            bd.addFile(File("dir" + std::to_string(i % 100) + "/file" +
+                            std::to_string(i) + ".cpp", "hash",
+                            std::move(coverage)));
+        }
+        return bd;
+    };
+
+    auto measure = [&](const BuildData &bd) {
+        const clock::time_point start = clock::now();
+        bh.addBuild(bd);
+        const auto elapsed = clock::now() - start;
+        return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+              .count();
+    };
+
+    const auto initial = measure(makeBuild(0));
+    const auto incremental = measure(makeBuild(nFiles/10));
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM filemap");
+    REQUIRE(std::get<0>(vals) == 2*nFiles);
+    vals = db.queryOne("SELECT count(*) FROM files");
+    REQUIRE(std::get<0>(vals) == nFiles + nFiles/10);
+
+    WARN("initial import: " << initial << "ms");
+    WARN("import with 10% of files changed: " << incremental << "ms");
+}
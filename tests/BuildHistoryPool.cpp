@@ -0,0 +1,137 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <boost/optional.hpp>
+#include <boost/scope_exit.hpp>
+
+#include <cstdio>
+
+#include <stdexcept>
+#include <string>
+
+#include "BuildHistory.hpp"
+#include "BuildHistoryPool.hpp"
+#include "DB.hpp"
+
+#include "TestUtils.hpp"
+
+TEST_CASE("Pool size must be positive", "[BuildHistoryPool]")
+{
+    REQUIRE_THROWS_AS(BuildHistoryPool("tests/pool-test.sqlite", "", "",
+                                       getSettings(), 0),
+                      const std::invalid_argument &);
+}
+
+TEST_CASE("Pool hands out separate build histories", "[BuildHistoryPool]")
+{
+    const std::string dbPath = "tests/pool-test.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+        std::remove((dbPath + "-shm").c_str());
+        std::remove((dbPath + "-wal").c_str());
+    };
+
+    {
+        DB db(dbPath);
+        BuildHistory bh(db);
+    }
+
+    BuildHistoryPool pool(dbPath, "", "", getSettings(), 2);
+
+    BuildHistory *first;
+    {
+        BuildHistoryPool::Handle a = pool.acquire();
+        BuildHistoryPool::Handle b = pool.acquire();
+        CHECK(a.get() != b.get());
+        CHECK(a->getBuilds().empty());
+        CHECK(!b->getBuild(1));
+        first = a.get();
+    }
+
+    BuildHistoryPool::Handle a = pool.acquire();
+    BuildHistoryPool::Handle b = pool.acquire();
+    CHECK((a.get() == first || b.get() == first));
+}
+
+TEST_CASE("Moved from handle doesn't release build history",
+          "[BuildHistoryPool]")
+{
+    const std::string dbPath = "tests/pool-test.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+        std::remove((dbPath + "-shm").c_str());
+        std::remove((dbPath + "-wal").c_str());
+    };
+
+    {
+        DB db(dbPath);
+        BuildHistory bh(db);
+    }
+
+    BuildHistoryPool pool(dbPath, "", "", getSettings(), 2);
+
+    BuildHistoryPool::Handle a = pool.acquire();
+    BuildHistory *const bh = a.get();
+    {
+        BuildHistoryPool::Handle moved = std::move(a);
+        CHECK(moved.get() == bh);
+    }
+
+    BuildHistoryPool::Handle b = pool.acquire();
+    BuildHistoryPool::Handle c = pool.acquire();
+    CHECK((b.get() == bh || c.get() == bh));
+}
+
+TEST_CASE("Build histories of the pool share cache", "[BuildHistoryPool]")
+{
+    const std::string dbPath = "tests/pool-test.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+        std::remove((dbPath + "-shm").c_str());
+        std::remove((dbPath + "-wal").c_str());
+    };
+
+    DB db(dbPath);
+    {
+        BuildHistory bh(db);
+        BuildData bd("ref", "branch");
+        bd.addFile(File("file.cpp", "hash", { -1, 1, 0 }));
+        bh.addBuild(bd);
+    }
+
+    BuildHistoryPool pool(dbPath, "", "", getSettings(), 2);
+    pool.configure(getSettings());
+
+    BuildHistoryPool::Handle a = pool.acquire();
+    BuildHistoryPool::Handle b = pool.acquire();
+
+    boost::optional<Build> build = a->getBuild(1);
+    REQUIRE(build);
+    REQUIRE(build->getFile("file.cpp"));
+
+    // Files never change, which allows the other connection to not look
+    // into the database.
+    db.execute("UPDATE files SET hash = 'changed'");
+
+    build = b->getBuild(1);
+    REQUIRE(build);
+    boost::optional<File &> file = build->getFile("file.cpp");
+    REQUIRE(file);
+    CHECK(file->getHash() == "hash");
+}
@@ -0,0 +1,78 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "CompactCoverage.hpp"
+
+#include "TestUtils.hpp"
+
+TEST_CASE("Empty coverage", "[CompactCoverage]")
+{
+    const CompactCoverage coverage;
+    CHECK(coverage.empty());
+    CHECK(coverage.size() == 0U);
+    CHECK(coverage.begin() == coverage.end());
+    CHECK(coverage.toVector() == vi({}));
+    CHECK(coverage == CompactCoverage(vi({})));
+}
+
+TEST_CASE("Coverage is stored without losses", "[CompactCoverage]")
+{
+    std::vector<int> lines;
+    for (int i = 0; i < 1000; ++i) {
+        // Long runs of irrelevant lines mixed with all kinds of values.
+        lines.push_back((i%7 == 0) ? i : (i%5 == 0) ? 0 : (i%3 == 0) ? 1 : -1);
+    }
+    lines.push_back(-5);
+    lines.push_back(2);
+
+    const CompactCoverage coverage(lines);
+    REQUIRE(coverage.size() == lines.size());
+    CHECK(!coverage.empty());
+    CHECK(coverage.toVector() == lines);
+    for (std::size_t i = 0U; i < lines.size(); ++i) {
+        REQUIRE(coverage[i] == lines[i]);
+    }
+
+    CHECK(std::vector<int>(coverage.cbegin(), coverage.cend()) == lines);
+    CHECK(*std::max_element(coverage.begin(), coverage.end()) == 994);
+    CHECK(coverage.end() - coverage.begin() == 1002);
+}
+
+TEST_CASE("Compact coverage takes less memory", "[CompactCoverage]")
+{
+    std::vector<int> lines(3200, -1);
+    lines[10] = 0;
+    lines[100] = 1;
+    lines[1000] = 100;
+
+    const CompactCoverage coverage(lines);
+    CHECK(coverage.getMemoryUsage() < lines.size()*sizeof(int)/10U);
+}
+
+TEST_CASE("Compact coverage is compared by values", "[CompactCoverage]")
+{
+    const CompactCoverage coverage = { -1, 0, 1, 2 };
+    CHECK(coverage == vi({ -1, 0, 1, 2 }));
+    CHECK(coverage != vi({ -1, 0, 1, 3 }));
+    CHECK(coverage != vi({ -1, 0, 1, 2, -1 }));
+    CHECK(coverage != vi({ -1, 0, 1 }));
+}
@@ -0,0 +1,202 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <boost/scope_exit.hpp>
+
+#include <cstdint>
+#include <cstdio>
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "CoveragePack.hpp"
+#include "PathInterner.hpp"
+
+#include "TestUtils.hpp"
+
+/**
+ * @brief Retrieves size of a file.
+ *
+ * @param path Path to the file.
+ *
+ * @returns The size.
+ */
+static std::uint64_t
+getSize(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file.tellg();
+}
+
+TEST_CASE("Coverage pack must exist and be valid", "[CoveragePack]")
+{
+    const std::string path = "tests/invalid.pack";
+    BOOST_SCOPE_EXIT_ALL(path) {
+        std::remove(path.c_str());
+    };
+
+    REQUIRE_THROWS_AS(CoveragePack pack(path), const std::runtime_error &);
+
+    std::ofstream(path) << "not a coverage pack";
+    REQUIRE_THROWS_AS(CoveragePack pack(path), const std::runtime_error &);
+
+    // Invalid file is replaced on appending.
+    CoveragePack::append(path, 1, { });
+    CHECK(CoveragePack(path).hasBuild(1));
+}
+
+TEST_CASE("Builds are read back from coverage pack", "[CoveragePack]")
+{
+    const std::string path = "tests/roundtrip.pack";
+    BOOST_SCOPE_EXIT_ALL(path) {
+        std::remove(path.c_str());
+    };
+
+    CoveragePack::append(path, 3, {
+        { 7, "src/b.cpp", "hash-b", 1, 1, 5, 10, { -1, 5, 0 } },
+        { 5, "src/a.cpp", "hash-a", 0, 0, 0, 20, { } },
+        { 9, "top.cpp", "hash-c", 2, 0, 1, 30, { 1, 1 } },
+    });
+    CoveragePack::append(path, 5, {
+        { 11, "src/a.cpp", "hash-d", 1, 0, 2, 40, { 2 } },
+    });
+
+    CoveragePack pack(path);
+    CHECK(pack.getLastBuildId() == 5);
+    CHECK(pack.hasBuild(3));
+    CHECK(!pack.hasBuild(4));
+
+    CHECK(pack.loadPaths(3) == (PathMap{
+        { internPath("src/a.cpp"), 5 },
+        { internPath("src/b.cpp"), 7 },
+        { internPath("top.cpp"), 9 }
+    }));
+
+    PackedFile file;
+    REQUIRE(pack.loadFile(7, file));
+    CHECK(file.path == "src/b.cpp");
+    CHECK(file.hash == "hash-b");
+    CHECK(file.coveredCount == 1);
+    CHECK(file.missedCount == 1);
+    CHECK(file.maxHits == 5);
+    CHECK(file.covHash == 10);
+    CHECK(file.coverage == vi({ -1, 5, 0 }));
+
+    REQUIRE(pack.loadFile(11, file));
+    CHECK(file.coverage == vi({ 2 }));
+    CHECK(!pack.loadFile(8, file));
+
+    std::vector<PackedFile> files = pack.loadFiles(3, "src/", false);
+    REQUIRE(files.size() == 2U);
+    CHECK(files[0].path == "src/a.cpp");
+    CHECK(files[1].path == "src/b.cpp");
+    CHECK(files[1].coverage.empty());
+
+    CHECK(pack.loadFiles(3, "", true).size() == 3U);
+    CHECK(pack.loadFiles(5, "top", true).empty());
+}
+
+TEST_CASE("Coverage pack doesn't duplicate coverage", "[CoveragePack]")
+{
+    const std::string path = "tests/dedup.pack";
+    BOOST_SCOPE_EXIT_ALL(path) {
+        std::remove(path.c_str());
+    };
+
+    const std::vector<int> coverage(1000, 1);
+
+    CoveragePack::append(path, 1, {
+        { 1, "a.cpp", "hash", 1000, 0, 1, 10, coverage },
+    });
+    const std::uint64_t size = getSize(path);
+
+    CoveragePack::append(path, 2, {
+        { 1, "a.cpp", "hash", 1000, 0, 1, 10, coverage },
+        { 2, "b.cpp", "hash", 1000, 0, 1, 10, coverage },
+        // Same hash, but different contents.
+        { 3, "c.cpp", "hash", 999, 1, 1, 10, vi({ 0 }) },
+    });
+    CHECK(getSize(path) - size < coverage.size()*sizeof(int));
+
+    // Adding the same build again does nothing.
+    const std::uint64_t fullSize = getSize(path);
+    CoveragePack::append(path, 2, { });
+    CHECK(getSize(path) == fullSize);
+
+    CoveragePack pack(path);
+    PackedFile file;
+    REQUIRE(pack.loadFile(2, file));
+    CHECK(file.coverage == coverage);
+    REQUIRE(pack.loadFile(3, file));
+    CHECK(file.coverage == vi({ 0 }));
+}
+
+TEST_CASE("Incomplete segment of coverage pack is ignored", "[CoveragePack]")
+{
+    const std::string path = "tests/torn.pack";
+    BOOST_SCOPE_EXIT_ALL(path) {
+        std::remove(path.c_str());
+    };
+
+    CoveragePack::append(path, 1, {
+        { 1, "a.cpp", "hash", 1, 0, 1, 10, { 1 } },
+    });
+    const std::uint64_t size = getSize(path);
+    CoveragePack::append(path, 2, {
+        { 2, "a.cpp", "hash", 1, 1, 1, 20, { 1, 0 } },
+    });
+
+    CoveragePack pack(path);
+    CHECK(pack.getLastBuildId() == 2);
+
+    // Cut off the end of the last segment.
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(in)),
+                             std::istreambuf_iterator<char>());
+        contents.resize(contents.size() - 3U);
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+    }
+
+    CHECK(CoveragePack(path).getLastBuildId() == 1);
+
+    // Mapping is updated only when file changes.
+    CHECK(pack.refresh());
+    CHECK(!pack.refresh());
+    CHECK(!pack.hasBuild(2));
+
+    // Appending replaces incomplete data.
+    CoveragePack::append(path, 3, {
+        { 3, "a.cpp", "hash", 0, 1, 0, 30, { 0 } },
+    });
+    CHECK(getSize(path) > size);
+    CHECK(pack.refresh());
+    CHECK(pack.hasBuild(1));
+    CHECK(!pack.hasBuild(2));
+    CHECK(pack.hasBuild(3));
+
+    PackedFile file;
+    REQUIRE(pack.loadFile(3, file));
+    CHECK(file.coverage == vi({ 0 }));
+
+    std::remove(path.c_str());
+    REQUIRE_THROWS_AS(pack.refresh(), const std::runtime_error &);
+}
@@ -0,0 +1,242 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <boost/scope_exit.hpp>
+
+#include <cstdint>
+#include <cstdio>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "DB.hpp"
+#include "DBProfile.hpp"
+
+TEST_CASE("Repeated queries return correct results", "[DB]")
+{
+    DB db(":memory:");
+    db.execute("CREATE TABLE t (id INTEGER, name TEXT)");
+
+    for (int i = 0; i < 10; ++i) {
+        db.execute("INSERT INTO t (id, name) VALUES (:id, :name)",
+                   { ":id"_b = i, ":name"_b = std::to_string(i) });
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        std::tuple<std::string> vals =
+            db.queryOne("SELECT name FROM t WHERE id = :id", { ":id"_b = i });
+        REQUIRE(std::get<0>(vals) == std::to_string(i));
+    }
+}
+
+TEST_CASE("Nested queries of the same statement don't interfere", "[DB]")
+{
+    DB db(":memory:");
+    db.execute("CREATE TABLE t (id INTEGER)");
+    db.execute("INSERT INTO t (id) VALUES (1)");
+    db.execute("INSERT INTO t (id) VALUES (2)");
+
+    int nRows = 0;
+    for (std::tuple<int> outer : db.queryAll("SELECT id FROM t")) {
+        int nInner = 0;
+        for (std::tuple<int> inner : db.queryAll("SELECT id FROM t")) {
+            static_cast<void>(inner);
+            ++nInner;
+        }
+        REQUIRE(nInner == 2);
+        REQUIRE(std::get<0>(outer) == ++nRows);
+    }
+    REQUIRE(nRows == 2);
+}
+
+TEST_CASE("Unused bindings of cached statement are cleared", "[DB]")
+{
+    DB db(":memory:");
+    db.execute("CREATE TABLE t (id INTEGER, name TEXT NOT NULL)");
+
+    db.execute("INSERT INTO t (id, name) VALUES (:id, :name)",
+               { ":id"_b = 1, ":name"_b = "a" });
+    REQUIRE_THROWS_AS(db.execute("INSERT INTO t (id, name) "
+                                 "VALUES (:id, :name)",
+                                 { ":id"_b = 2 }),
+                      const std::runtime_error &);
+}
+
+TEST_CASE("Writable database is switched to write-ahead log", "[DB]")
+{
+    const std::string dbPath = "tests/db-test.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+    };
+
+    DB db(dbPath);
+    std::tuple<std::string> vals = db.queryOne("pragma journal_mode");
+    REQUIRE(std::get<0>(vals) == "wal");
+}
+
+TEST_CASE("Read-only database can't be modified", "[DB]")
+{
+    const std::string dbPath = "tests/db-test.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+    };
+
+    {
+        DB db(dbPath);
+        db.execute("CREATE TABLE t (id INTEGER)");
+        db.execute("INSERT INTO t (id) VALUES (1)");
+    }
+
+    DB db(dbPath, DBMode::ReadOnly);
+    REQUIRE(db.isReadOnly());
+    REQUIRE_THROWS_AS(db.execute("INSERT INTO t (id) VALUES (2)"),
+                      const std::runtime_error &);
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM t");
+    REQUIRE(std::get<0>(vals) == 1);
+}
+
+TEST_CASE("Read-only database must exist", "[DB]")
+{
+    REQUIRE_THROWS_AS(DB("tests/no-such-db.sqlite", DBMode::ReadOnly),
+                      const std::runtime_error &);
+}
+
+TEST_CASE("Snapshot is read without locking", "[DB]")
+{
+    // Characters that are special in URIs must not confuse SQLite.
+    const std::string dbPath = "tests/db-test?#%.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+    };
+
+    {
+        DB db(dbPath);
+        db.execute("CREATE TABLE t (id INTEGER)");
+        db.execute("INSERT INTO t (id) VALUES (1)");
+    }
+
+    DB db(dbPath, DBMode::Snapshot);
+    REQUIRE(db.isReadOnly());
+    REQUIRE(db.getMode() == DBMode::Snapshot);
+
+    std::tuple<int> vals = db.queryOne("SELECT count(*) FROM t");
+    REQUIRE(std::get<0>(vals) == 1);
+    REQUIRE_THROWS_AS(db.execute("INSERT INTO t (id) VALUES (2)"),
+                      const std::runtime_error &);
+
+    // Shared memory of write-ahead log isn't used.
+    REQUIRE(!std::ifstream(dbPath + "-shm"));
+}
+
+TEST_CASE("Reader isn't blocked by a writer", "[DB]")
+{
+    const std::string dbPath = "tests/db-test.sqlite";
+    BOOST_SCOPE_EXIT_ALL(dbPath) {
+        std::remove(dbPath.c_str());
+    };
+
+    DB writer(dbPath);
+    writer.execute("CREATE TABLE t (id INTEGER)");
+    writer.execute("INSERT INTO t (id) VALUES (1)");
+
+    DB reader(dbPath, DBMode::ReadOnly);
+
+    Transaction transaction = writer.makeTransaction();
+    writer.execute("INSERT INTO t (id) VALUES (2)");
+
+    std::tuple<int> vals = reader.queryOne("SELECT count(*) FROM t");
+    REQUIRE(std::get<0>(vals) == 1);
+
+    transaction.commit();
+
+    vals = reader.queryOne("SELECT count(*) FROM t");
+    REQUIRE(std::get<0>(vals) == 2);
+}
+
+TEST_CASE("Statements are profiled", "[DB][DBProfile]")
+{
+    const std::string select = "SELECT id FROM t";
+
+    DBProfile profile;
+    DB db(":memory:");
+    db.execute("CREATE TABLE t (id INTEGER)");
+    db.setProfile(&profile);
+
+    for (int i = 0; i < 3; ++i) {
+        db.execute("INSERT INTO t (id) VALUES (:id)", { ":id"_b = i });
+    }
+    for (int i = 0; i < 2; ++i) {
+        for (std::tuple<int> row : db.queryAll(select)) {
+            static_cast<void>(row);
+        }
+    }
+
+    const std::map<std::string, DBStmtStats> stats = profile.getStats();
+    REQUIRE(stats.size() == 2U);
+
+    const DBStmtStats &insert =
+        stats.at("INSERT INTO t (id) VALUES (:id)");
+    CHECK(insert.calls == 3);
+    CHECK(insert.rows == 0);
+    CHECK(insert.vmSteps > 0);
+
+    const DBStmtStats &query = stats.at(select);
+    CHECK(query.calls == 2);
+    CHECK(query.rows == 6);
+    CHECK(query.vmSteps > 0);
+    CHECK(query.maxNs <= query.totalNs);
+
+    std::ostringstream oss;
+    profile.print(oss);
+    CHECK(oss.str().find(select) != std::string::npos);
+
+    db.setProfile(nullptr);
+    db.execute("INSERT INTO t (id) VALUES (:id)", { ":id"_b = 10 });
+    CHECK(profile.getStats().at("INSERT INTO t (id) VALUES (:id)").calls == 3);
+}
+
+TEST_CASE("64-bit integers are stored and read back", "[DB]")
+{
+    const std::int64_t big = -0x7FFFFFFFFFFFFF00LL;
+
+    DB db(":memory:");
+    db.execute("CREATE TABLE t (val INTEGER)");
+    db.execute("INSERT INTO t (val) VALUES (:val)", { ":val"_b = big });
+
+    std::tuple<std::int64_t> vals = db.queryOne("SELECT val FROM t");
+    REQUIRE(std::get<0>(vals) == big);
+}
+
+TEST_CASE("Blobs are stored and read back as is", "[DB]")
+{
+    const std::vector<unsigned char> blob = { 0x00, 0xF1, 0xFF, 0x00 };
+
+    DB db(":memory:");
+    db.execute("CREATE TABLE t (val BLOB)");
+    db.execute("INSERT INTO t (val) VALUES (:val)", { ":val"_b = blob });
+
+    std::tuple<std::vector<unsigned char>> vals =
+        db.queryOne("SELECT val FROM t");
+    REQUIRE(std::get<0>(vals) == blob);
+}
@@ -98,6 +98,32 @@ TEST_CASE("Options are parsed", "[Invocation]")
         REQUIRE(invocation.getError() == std::string());
         CHECK(invocation.shouldPrintHelp());
     }
+
+    SECTION("Profiling of database")
+    {
+        Invocation invocation({ "uncov", "--profile-db", "show", "arg" });
+        REQUIRE(invocation.getError() == std::string());
+        CHECK(invocation.shouldProfileDB());
+        CHECK(invocation.getSubcommandName() == "show");
+        CHECK(invocation.getSubcommandArgs() == vs({ "arg" }));
+    }
+
+    SECTION("No profiling by default")
+    {
+        Invocation invocation({ "uncov", "show" });
+        REQUIRE(invocation.getError() == std::string());
+        CHECK_FALSE(invocation.shouldProfileDB());
+        CHECK_FALSE(invocation.shouldOpenSnapshot());
+    }
+
+    SECTION("Snapshot mode")
+    {
+        Invocation invocation({ "uncov", "--snapshot", "./repo", "show" });
+        REQUIRE(invocation.getError() == std::string());
+        CHECK(invocation.shouldOpenSnapshot());
+        CHECK(invocation.getRepositoryPath() == "./repo");
+        CHECK(invocation.getSubcommandName() == "show");
+    }
 }
 
 TEST_CASE("Usage message includes program name", "[Invocation]")
@@ -0,0 +1,144 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "PathIndex.hpp"
+#include "PathInterner.hpp"
+
+#include "TestUtils.hpp"
+
+static const std::map<std::string, int> paths = {
+    { "top.cpp", 1 },
+    { "src/a.cpp", 2 },
+    { "src/b-c/d.cpp", 3 },
+    { "src/b/e.cpp", 4 },
+    { "src/b/f/g.cpp", 5 },
+    { "src.cpp", 6 },
+    { "lib/x/y.cpp", 7 },
+};
+
+static PathMap internPaths(const std::map<std::string, int> &paths);
+
+TEST_CASE("Files are looked up by path", "[PathIndex]")
+{
+    const PathIndex index(internPaths(paths));
+    CHECK(index.size() == paths.size());
+
+    for (const auto &entry : paths) {
+        CHECK(index.isFile(entry.first));
+        CHECK(index.getFileId(entry.first) == entry.second);
+        CHECK(!index.isDirectory(entry.first));
+    }
+
+    CHECK(index.getFileId("src") == 0);
+    CHECK(index.getFileId("src/b") == 0);
+    CHECK(index.getFileId("src/a") == 0);
+    CHECK(index.getFileId("src/a.cpp.orig") == 0);
+    CHECK(index.getFileId("") == 0);
+}
+
+TEST_CASE("Directories are recognized", "[PathIndex]")
+{
+    const PathIndex index(internPaths(paths));
+
+    CHECK(index.isDirectory(""));
+    CHECK(index.isDirectory("src"));
+    CHECK(index.isDirectory("src/b"));
+    CHECK(index.isDirectory("src/b-c"));
+    CHECK(index.isDirectory("src/b/f"));
+    CHECK(index.isDirectory("lib"));
+    CHECK(index.isDirectory("lib/x"));
+
+    CHECK(!index.isDirectory("sr"));
+    CHECK(!index.isDirectory("src/b/f/g"));
+    CHECK(!index.isDirectory("lib/x/y.cpp"));
+    CHECK(!index.isDirectory("tests"));
+
+    CHECK(!PathIndex({}).isDirectory(""));
+}
+
+TEST_CASE("Files of subtree are listed", "[PathIndex]")
+{
+    const PathIndex index(internPaths(paths));
+
+    CHECK(index.getFiles() == vs({ "lib/x/y.cpp", "src.cpp", "src/a.cpp",
+                                   "src/b-c/d.cpp", "src/b/e.cpp",
+                                   "src/b/f/g.cpp", "top.cpp" }));
+    CHECK(index.getFiles("src") == vs({ "src/a.cpp", "src/b-c/d.cpp",
+                                        "src/b/e.cpp", "src/b/f/g.cpp" }));
+    CHECK(index.getFiles("src/b") == vs({ "src/b/e.cpp", "src/b/f/g.cpp" }));
+    CHECK(index.getFiles("src/b/e.cpp") == vs({ "src/b/e.cpp" }));
+    CHECK(index.getFiles("src/b/e") == vs({}));
+    CHECK(index.getFiles("tests") == vs({}));
+}
+
+TEST_CASE("Children of directories are listed", "[PathIndex]")
+{
+    const PathIndex index(internPaths(paths));
+
+    CHECK(index.getDirectFiles("") == vs({ "src.cpp", "top.cpp" }));
+    CHECK(index.getDirectFiles("src") == vs({ "src/a.cpp" }));
+    CHECK(index.getDirectFiles("src/b") == vs({ "src/b/e.cpp" }));
+    CHECK(index.getDirectFiles("lib") == vs({}));
+    CHECK(index.getDirectFiles("tests") == vs({}));
+
+    CHECK(index.getSubdirs("") == vs({ "lib", "src" }));
+    CHECK(index.getSubdirs("src") == vs({ "src/b", "src/b-c" }));
+    CHECK(index.getSubdirs("src/b") == vs({ "src/b/f" }));
+    CHECK(index.getSubdirs("src/b/f") == vs({}));
+    CHECK(index.getSubdirs("tests") == vs({}));
+}
+
+TEST_CASE("Indexes share interned paths", "[PathIndex]")
+{
+    const PathIndex first(internPaths(paths));
+    const PathIndex second(internPaths({ { "src/a.cpp", 10 },
+                                         { "src/z.cpp", 11 } }));
+
+    const std::vector<PathRef> refs = first.getFileRefs("src");
+    REQUIRE(refs.size() == 4U);
+    CHECK(*refs[0] == "src/a.cpp");
+    CHECK(*refs[3] == "src/b/f/g.cpp");
+
+    const std::vector<PathRef> otherRefs = second.getFileRefs();
+    REQUIRE(otherRefs.size() == 2U);
+    CHECK(otherRefs[0] == refs[0]);
+    CHECK(otherRefs[1] == internPath("src/z.cpp"));
+    CHECK(first.getFileRefs("src/z.cpp").empty());
+}
+
+/**
+ * @brief Interns paths of a map.
+ *
+ * @param paths Mappings of paths to file ids.
+ *
+ * @returns Mappings of interned paths to file ids.
+ */
+static PathMap
+internPaths(const std::map<std::string, int> &paths)
+{
+    PathMap interned;
+    for (const auto &entry : paths) {
+        interned.emplace(internPath(entry.first), entry.second);
+    }
+    return interned;
+}
@@ -0,0 +1,60 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <string>
+
+#include "PathInterner.hpp"
+
+TEST_CASE("Equal paths are interned once", "[PathInterner]")
+{
+    PathInterner interner;
+
+    const PathRef ref = interner.intern("src/file.cpp");
+    CHECK(*ref == "src/file.cpp");
+    CHECK(interner.intern(std::string("src/") + "file.cpp") == ref);
+    CHECK(interner.intern("src/other.cpp") != ref);
+    CHECK(interner.size() == 2U);
+}
+
+TEST_CASE("Interned paths don't move", "[PathInterner]")
+{
+    PathInterner interner;
+
+    const PathRef ref = interner.intern("path");
+    for (int i = 0; i < 10000; ++i) {
+        interner.intern("path" + std::to_string(i));
+    }
+    CHECK(interner.intern("path") == ref);
+    CHECK(*ref == "path");
+}
+
+TEST_CASE("Global table is shared", "[PathInterner]")
+{
+    CHECK(internPath("a/b.cpp") == PathInterner::getGlobal().intern("a/b.cpp"));
+}
+
+TEST_CASE("Paths are looked up without interning them", "[PathInterner]")
+{
+    PathInterner interner;
+
+    const PathRef ref = interner.intern("src/file.cpp");
+    CHECK(interner.find("src/file.cpp") == ref);
+    CHECK(interner.find("src/other.cpp") == nullptr);
+    CHECK(interner.size() == 1U);
+}
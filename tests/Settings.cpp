@@ -29,7 +29,14 @@ operator==(const Settings &lhs, const Settings &rhs)
         && lhs.printLineNoInDiff() == rhs.printLineNoInDiff()
         && lhs.getMinFoldSize() == rhs.getMinFoldSize()
         && lhs.getFoldContext() == rhs.getFoldContext()
-        && lhs.isHtmlOutput() == rhs.isHtmlOutput();
+        && lhs.isHtmlOutput() == rhs.isHtmlOutput()
+        && lhs.getBusyTimeout() == rhs.getBusyTimeout()
+        && lhs.getMmapSize() == rhs.getMmapSize()
+        && lhs.getCacheSize() == rhs.getCacheSize()
+        && lhs.getCoverageDeltaChain() == rhs.getCoverageDeltaChain()
+        && lhs.isCoveragePackEnabled() == rhs.isCoveragePackEnabled()
+        && lhs.isHitCountStored() == rhs.isHitCountStored()
+        && lhs.getBuildCacheSize() == rhs.getBuildCacheSize();
 }
 
 TEST_CASE("Loading from nonexistent file doesn't change anything", "[Settings]")
@@ -62,6 +69,13 @@ TEST_CASE("Settings from correct config are applied", "[Settings]")
     CHECK(settings.getMinFoldSize() == 3);
     CHECK(settings.getFoldContext() == 1);
     CHECK(!settings.printLineNoInDiff());
+    CHECK(settings.getBusyTimeout() == 5000);
+    CHECK(settings.getMmapSize() == 0);
+    CHECK(settings.getCacheSize() == 2000);
+    CHECK(settings.getCoverageDeltaChain() == 0);
+    CHECK(!settings.isCoveragePackEnabled());
+    CHECK(settings.isHitCountStored());
+    CHECK(settings.getBuildCacheSize() == 64);
 
     settings.loadFromFile("tests/test-configs/correct.ini");
     CHECK(settings.getMedLimit() == 50.5f);
@@ -70,6 +84,13 @@ TEST_CASE("Settings from correct config are applied", "[Settings]")
     CHECK(settings.getMinFoldSize() == 4);
     CHECK(settings.getFoldContext() == 3);
     CHECK(settings.printLineNoInDiff());
+    CHECK(settings.getBusyTimeout() == 1000);
+    CHECK(settings.getMmapSize() == 64);
+    CHECK(settings.getCacheSize() == 8192);
+    CHECK(settings.getCoverageDeltaChain() == 8);
+    CHECK(settings.isCoveragePackEnabled());
+    CHECK(!settings.isHitCountStored());
+    CHECK(settings.getBuildCacheSize() == 16);
 }
 
 TEST_CASE("Settings from incorrect config are ignored", "[Settings]")
@@ -104,5 +125,10 @@ TEST_CASE("Invalid values are handled sensibly", "[Settings]")
         CHECK(settings.getTabSize() == 1);
         CHECK(settings.getMinFoldSize() == 1);
         CHECK(settings.getFoldContext() == 0);
+        CHECK(settings.getBusyTimeout() == 0);
+        CHECK(settings.getMmapSize() == 0);
+        CHECK(settings.getCacheSize() == 100);
+        CHECK(settings.getCoverageDeltaChain() == 0);
+        CHECK(settings.getBuildCacheSize() == 0);
     }
 }
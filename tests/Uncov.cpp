@@ -17,15 +17,23 @@
 #include "Catch/catch.hpp"
 
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/optional.hpp>
 
 #include <cstdlib>
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
+#include "BuildHistory.hpp"
+#include "DB.hpp"
+#include "Repository.hpp"
 #include "Uncov.hpp"
 
 #include "TestUtils.hpp"
 
+static std::string describe(const boost::optional<DBMode> &mode);
+
 TEST_CASE("Help is printed", "[Uncov]")
 {
     StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
@@ -89,3 +97,89 @@ TEST_CASE("Command is executed", "[Uncov]")
                                "-1\n1\n-1\n1\n-1\n");
     CHECK(cerrCapture.get() == std::string());
 }
+
+TEST_CASE("Only commands that store data open database for writing",
+          "[Uncov][DB]")
+{
+    Uncov uncov({ "uncov", "help" });
+
+    for (const std::string alias : { "archive", "gc", "migrate", "new",
+                                     "new-gcovi", "new-json", "recompress" }) {
+        INFO(alias);
+        CHECK(describe(uncov.pickDBMode(alias, false, true)) == "read-write");
+        CHECK(describe(uncov.pickDBMode(alias, false, false)) ==
+              "read-write");
+    }
+
+    for (const std::string alias : { "build", "builds", "changed", "diff",
+                                     "diff-hits", "dirs", "files", "get",
+                                     "missed", "regress", "show" }) {
+        INFO(alias);
+        CHECK(describe(uncov.pickDBMode(alias, false, true)) == "read-only");
+        // Missing database is created by any command.
+        CHECK(describe(uncov.pickDBMode(alias, false, false)) ==
+              "read-write");
+    }
+
+    CHECK_THROWS_AS(uncov.pickDBMode("bla", false, true),
+                    const std::invalid_argument &);
+}
+
+TEST_CASE("Snapshot can only be read", "[Uncov][DB]")
+{
+    Uncov uncov({ "uncov", "help" });
+
+    for (const std::string alias : { "get", "missed", "show" }) {
+        INFO(alias);
+        CHECK(describe(uncov.pickDBMode(alias, true, true)) == "snapshot");
+    }
+    for (const std::string alias : { "archive", "new", "new-gcovi" }) {
+        INFO(alias);
+        CHECK(describe(uncov.pickDBMode(alias, true, true)) == "refused");
+    }
+}
+
+TEST_CASE("Build is shown from a snapshot", "[Uncov][DB]")
+{
+    {
+        // Snapshots aren't upgraded, so make sure schema is up to date.
+        Repository repo("tests/test-repo/subdir");
+        DB db(getDbPath(repo));
+        BuildHistory bh(db);
+    }
+
+    StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
+
+    Uncov show({ "uncov", "--snapshot", "tests/test-repo/_git/",
+                 "show", "@1", "test-file1.cpp" });
+    CHECK(show.run(getSettings()) == EXIT_SUCCESS);
+    CHECK(coutCapture.get() != std::string());
+    CHECK(cerrCapture.get() == std::string());
+
+    Uncov newGcovi({ "uncov", "--snapshot", "tests/test-repo/_git/",
+                     "new-gcovi" });
+    CHECK(newGcovi.run(getSettings()) == EXIT_FAILURE);
+    CHECK(boost::starts_with(cerrCapture.get(),
+                             "Can't modify database snapshot: "));
+}
+
+/**
+ * @brief Formats database mode for comparison.
+ *
+ * @param mode The mode.
+ *
+ * @returns Its name.
+ */
+static std::string
+describe(const boost::optional<DBMode> &mode)
+{
+    if (!mode) {
+        return "refused";
+    }
+    switch (*mode) {
+        case DBMode::ReadWrite: return "read-write";
+        case DBMode::ReadOnly:  return "read-only";
+        case DBMode::Snapshot:  return "snapshot";
+    }
+    return "unknown";
+}
@@ -0,0 +1,462 @@
+// Copyright (C) 2026 xaizek <xaizek@posteo.net>
+//
+// This file is part of uncov.
+//
+// uncov is free software: you can redistribute it and/or modify
+// it under the terms of version 3 of the GNU Affero General Public License as
+// published by the Free Software Foundation.
+//
+// uncov is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with uncov.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Catch/catch.hpp"
+
+#include <zlib.h>
+
+#include <climits>
+#include <cstdint>
+
+#include <chrono>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "coverage_codec.hpp"
+
+#include "TestUtils.hpp"
+
+static std::vector<int> roundTrip(const std::vector<int> &coverage);
+static std::vector<unsigned char> makeLegacy(const std::vector<int> &coverage);
+static std::vector<int> decodeLegacyCopying(const unsigned char blob[],
+                                            std::size_t size);
+static std::vector<int> makeSample(int seed);
+
+TEST_CASE("Empty coverage is encoded", "[coverage_codec]")
+{
+    REQUIRE(roundTrip({}) == vi({}));
+}
+
+TEST_CASE("Hit counts are encoded", "[coverage_codec]")
+{
+    const std::vector<int> coverage = { -1, 0, 1, 2, 127, 128, 65536,
+                                        INT_MAX, INT_MIN, -2 };
+    REQUIRE(roundTrip(coverage) == coverage);
+}
+
+TEST_CASE("Runs of irrelevant and missed lines are encoded",
+          "[coverage_codec]")
+{
+    std::vector<int> coverage(1000, -1);
+    coverage.insert(coverage.end(), 2, 0);
+    coverage.insert(coverage.end(), 3, 0);
+    coverage.push_back(5);
+    coverage.insert(coverage.end(), 300, 0);
+    coverage.insert(coverage.end(), 3, -1);
+
+    const std::vector<unsigned char> blob = encodeCoverage(coverage);
+    REQUIRE(blob.size() < 20U);
+    REQUIRE(decodeCoverage(blob.data(), blob.size()) == coverage);
+}
+
+TEST_CASE("Blob starts with codec byte", "[coverage_codec]")
+{
+    const std::vector<unsigned char> blob = encodeCoverage({ 1, 2, 3 });
+    REQUIRE(blob.front() ==
+            static_cast<unsigned char>(CoverageCodec::VarintRle));
+}
+
+TEST_CASE("Coverage without hit counts is packed by state",
+          "[coverage_codec]")
+{
+    std::vector<int> coverage;
+    for (int i = 0; i < 1001; ++i) {
+        coverage.push_back(i%3 - 1);
+    }
+
+    const std::vector<unsigned char> blob = encodeCoverage(coverage);
+    CHECK(blob.front() == static_cast<unsigned char>(CoverageCodec::State));
+    CHECK(blob.size() == 1U + 2U + 251U);
+    CHECK(decodeCoverage(blob.data(), blob.size()) == coverage);
+
+    coverage.push_back(2);
+    CHECK(encodeCoverage(coverage).front() !=
+          static_cast<unsigned char>(CoverageCodec::State));
+    CHECK(encodeCoverage(dropHitCounts(coverage)).front() ==
+          static_cast<unsigned char>(CoverageCodec::State));
+}
+
+TEST_CASE("Hit counts are dropped", "[coverage_codec]")
+{
+    CHECK(dropHitCounts({ -1, 0, 1, 2, 100 }) == vi({ -1, 0, 1, 1, 1 }));
+}
+
+TEST_CASE("Legacy coverage format is decoded", "[coverage_codec]")
+{
+    // Compressed "-1 0 -1 0 -1 " string.
+    const std::vector<unsigned char> blob = {
+        0x00, 0x00, 0x00, 0x0D, 0x78, 0x9C, 0xD3, 0x35, 0x54, 0x30,
+        0x50, 0xD0, 0x85, 0x12, 0x00, 0x0E, 0xFA, 0x02, 0x1B
+    };
+    REQUIRE(decodeCoverage(blob.data(), blob.size()) ==
+            vi({ -1, 0, -1, 0, -1 }));
+}
+
+TEST_CASE("Large legacy coverage is decoded", "[coverage_codec]")
+{
+    std::vector<int> coverage;
+    for (int i = 0; i < 100000; ++i) {
+        coverage.push_back(i % 7 == 0 ? -1 : i % 11 == 0 ? 0 : i);
+    }
+    coverage.push_back(INT_MIN);
+    coverage.push_back(INT_MAX);
+
+    const std::vector<unsigned char> blob = makeLegacy(coverage);
+    REQUIRE(decodeCoverage(blob.data(), blob.size()) == coverage);
+}
+
+TEST_CASE("Corrupted legacy coverage causes an exception", "[coverage_codec]")
+{
+    std::vector<unsigned char> blob = makeLegacy({ 1, 2, 3 });
+
+    SECTION("Truncated data") {
+        blob.pop_back();
+    }
+    SECTION("Non-numeric data") {
+        blob = makeLegacy({});
+        unsigned long size = compressBound(3U);
+        blob.resize(4U + size);
+        blob[3] = 3U;
+        compress(&blob[4], &size, reinterpret_cast<const Bytef *>("1x2"), 3U);
+        blob.resize(4U + size);
+    }
+
+    REQUIRE_THROWS_AS(decodeCoverage(blob.data(), blob.size()),
+                      const std::runtime_error &);
+}
+
+TEST_CASE("Corrupted coverage causes an exception", "[coverage_codec]")
+{
+    std::vector<unsigned char> blob = encodeCoverage({ 1, 2, 3, 4 });
+
+    SECTION("Truncated data") {
+        blob.pop_back();
+    }
+    SECTION("Extra data") {
+        blob.push_back(0x02);
+    }
+    SECTION("Run past the end") {
+        blob.push_back(0x7D);
+    }
+    SECTION("Huge size") {
+        blob = { blob.front(), 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x02 };
+    }
+
+    REQUIRE_THROWS_AS(decodeCoverage(blob.data(), blob.size()),
+                      const std::runtime_error &);
+}
+
+TEST_CASE("Corrupted state of lines causes an exception", "[coverage_codec]")
+{
+    std::vector<unsigned char> blob = encodeCoverage(std::vector<int>(9, 1));
+    REQUIRE(blob.front() == static_cast<unsigned char>(CoverageCodec::State));
+
+    SECTION("Truncated data") {
+        blob.pop_back();
+    }
+    SECTION("Extra data") {
+        blob.push_back(0x00);
+    }
+    SECTION("Invalid state") {
+        blob.back() = 0x03;
+    }
+
+    REQUIRE_THROWS_AS(decodeCoverage(blob.data(), blob.size()),
+                      const std::runtime_error &);
+}
+
+TEST_CASE("Compressed coverage requires dictionaries", "[coverage_codec]")
+{
+    std::vector<unsigned char> blob = getCoveragePrefix(12345U);
+    blob.push_back(0x00);
+
+    CHECK(blob[0] == static_cast<unsigned char>(CoverageCodec::ZstdDict));
+    REQUIRE_THROWS_AS(decodeCoverage(blob.data(), blob.size()),
+                      const std::runtime_error &);
+
+    CoverageDictionaries dicts([](std::uint32_t /*id*/) {
+        return std::vector<unsigned char>();
+    });
+    REQUIRE_THROWS_AS(decodeCoverage(blob.data(), blob.size(), &dicts),
+                      const std::runtime_error &);
+}
+
+#ifdef WITH_ZSTD
+
+TEST_CASE("Coverage is compressed with a dictionary", "[coverage_codec]")
+{
+    std::vector<std::vector<int>> samples;
+    for (int i = 0; i < 500; ++i) {
+        samples.push_back(makeSample(i));
+    }
+
+    const std::vector<unsigned char> dict =
+        CoverageDictionaries::train(samples, 4096U);
+    const std::uint32_t id = CoverageDictionaries::getId(dict);
+
+    CoverageDictionaries dicts([&](std::uint32_t dictId) {
+        return dictId == id ? dict : std::vector<unsigned char>();
+    });
+    dicts.setActive(id);
+
+    const std::vector<int> coverage = makeSample(1000);
+    const std::vector<unsigned char> plain = encodeCoverage(coverage);
+    const std::vector<unsigned char> blob = encodeCoverage(coverage, &dicts);
+
+    REQUIRE(blob[0] == static_cast<unsigned char>(CoverageCodec::ZstdDict));
+    CHECK(blob.size() < plain.size());
+    CHECK(decodeCoverage(blob.data(), blob.size(), &dicts) == coverage);
+
+    // Short coverage isn't worth compressing.
+    const std::vector<unsigned char> small = encodeCoverage({ 1 }, &dicts);
+    CHECK(small[0] == static_cast<unsigned char>(CoverageCodec::VarintRle));
+
+    // Dictionary is looked up by id recorded in the blob.
+    dicts.setActive(0U);
+    CHECK(decodeCoverage(blob.data(), blob.size(), &dicts) == coverage);
+
+    CoverageDictionaries other([](std::uint32_t /*id*/) {
+        return std::vector<unsigned char>();
+    });
+    REQUIRE_THROWS_AS(decodeCoverage(blob.data(), blob.size(), &other),
+                      const std::runtime_error &);
+}
+
+#else
+
+TEST_CASE("Coverage isn't compressed without zstd", "[coverage_codec]")
+{
+    CHECK_FALSE(CoverageDictionaries::isSupported());
+    REQUIRE_THROWS_AS(CoverageDictionaries::train({ { 1, 2, 3 } }, 4096U),
+                      const std::runtime_error &);
+
+    CoverageDictionaries dicts([](std::uint32_t /*id*/) {
+        return std::vector<unsigned char>(100, 1);
+    });
+    dicts.setActive(12345U);
+
+    const std::vector<int> coverage = makeSample(1);
+    const std::vector<unsigned char> blob = encodeCoverage(coverage, &dicts);
+    CHECK(blob == encodeCoverage(coverage));
+}
+
+#endif
+
+TEST_CASE("Coverage differences are applied", "[coverage_codec]")
+{
+    const std::vector<int> base = { -1, 0, 1, 2, -1, 0 };
+
+    SECTION("Same size")
+    {
+        const std::vector<int> coverage = { -1, 1, 1, 2, -1, 3 };
+        const std::vector<int> delta = diffCoverage(base, coverage);
+        CHECK(delta == vi({ 6, 1, 1, 3, 3 }));
+        CHECK(patchCoverage(base, delta) == coverage);
+    }
+    SECTION("No changes")
+    {
+        CHECK(diffCoverage(base, base) == vi({ 6 }));
+        CHECK(patchCoverage(base, vi({ 6 })) == base);
+    }
+    SECTION("Shrinking")
+    {
+        const std::vector<int> coverage = { -1, 0, 5 };
+        CHECK(patchCoverage(base, diffCoverage(base, coverage)) == coverage);
+    }
+    SECTION("Growing")
+    {
+        const std::vector<int> coverage = { -1, 0, 1, 2, -1, 0, -1, 4 };
+        const std::vector<int> delta = diffCoverage(base, coverage);
+        CHECK(delta == vi({ 8, 7, 4 }));
+        CHECK(patchCoverage(base, delta) == coverage);
+    }
+}
+
+TEST_CASE("Corrupted coverage difference causes an exception",
+          "[coverage_codec]")
+{
+    const std::vector<int> base = { 1, 2, 3 };
+
+    SECTION("Empty")
+    {
+        REQUIRE_THROWS_AS(patchCoverage(base, {}), const std::runtime_error &);
+    }
+    SECTION("Negative size")
+    {
+        REQUIRE_THROWS_AS(patchCoverage(base, { -1 }),
+                          const std::runtime_error &);
+    }
+    SECTION("Incomplete pair")
+    {
+        REQUIRE_THROWS_AS(patchCoverage(base, { 3, 0 }),
+                          const std::runtime_error &);
+    }
+    SECTION("Change past the end")
+    {
+        REQUIRE_THROWS_AS(patchCoverage(base, { 3, 2, 1, 0, 1 }),
+                          const std::runtime_error &);
+    }
+    SECTION("Negative gap")
+    {
+        REQUIRE_THROWS_AS(patchCoverage(base, { 3, -1, 1 }),
+                          const std::runtime_error &);
+    }
+}
+
+// Run explicitly with `tests "[bench]"` to see timings.
+TEST_CASE("Decoding of 100k-line file", "[.][bench][coverage_codec]")
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<int> coverage;
+    for (int i = 0; i < 100000; ++i) {
+        coverage.push_back(i % 50 < 20 ? -1 : i % 50 < 23 ? 0 : i % 13);
+    }
+
+    const std::vector<unsigned char> legacy = makeLegacy(coverage);
+    const std::vector<unsigned char> binary = encodeCoverage(coverage);
+
+    using decodeFunc = std::vector<int> (*)(const unsigned char[],
+                                            std::size_t);
+    auto measure = [&](const std::vector<unsigned char> &blob,
+                       decodeFunc decode) {
+        const int nRuns = 20;
+        std::size_t nDecoded = 0U;
+        const clock::time_point start = clock::now();
+        for (int i = 0; i < nRuns; ++i) {
+            nDecoded += decode(blob.data(), blob.size()).size();
+        }
+        const auto elapsed = clock::now() - start;
+        REQUIRE(nDecoded == nRuns*coverage.size());
+        REQUIRE(decode(blob.data(), blob.size()) == coverage);
+        return std::chrono::duration_cast<std::chrono::microseconds>(elapsed)
+              .count()/nRuns;
+    };
+
+    const decodeFunc decodeDirectly = [](const unsigned char blob[],
+                                         std::size_t size) {
+        return decodeCoverage(blob, size);
+    };
+
+    const auto copying = measure(legacy, &decodeLegacyCopying);
+    const auto streaming = measure(legacy, decodeDirectly);
+    const auto varint = measure(binary, decodeDirectly);
+
+    WARN("legacy format via copies and istringstream: " << copying << "us");
+    WARN("legacy format via streaming inflate: " << streaming << "us");
+    WARN("binary format: " << varint << "us");
+    WARN("blob sizes: " << legacy.size() << " vs. " << binary.size());
+}
+
+/**
+ * @brief Generates coverage that resembles coverage of a real file.
+ *
+ * @param seed Determines contents.
+ *
+ * @returns The coverage.
+ */
+static std::vector<int>
+makeSample(int seed)
+{
+    std::vector<int> coverage;
+    unsigned int state = seed*2654435761U + 1U;
+    const int size = 100 + seed%200;
+    while (static_cast<int>(coverage.size()) < size) {
+        state = state*1103515245U + 12345U;
+        const unsigned int kind = (state >> 16) % 8U;
+        const int hits = (kind < 4U ? -1 : kind < 5U ? 0 : (state >> 8) % 50U);
+        coverage.insert(coverage.end(), 1U + (state >> 24) % 5U, hits);
+    }
+    coverage.resize(size);
+    return coverage;
+}
+
+/**
+ * @brief Encodes and then decodes coverage.
+ *
+ * @param coverage Coverage to process.
+ *
+ * @returns Decoded coverage.
+ */
+static std::vector<int>
+roundTrip(const std::vector<int> &coverage)
+{
+    const std::vector<unsigned char> blob = encodeCoverage(coverage);
+    return decodeCoverage(blob.data(), blob.size());
+}
+
+/**
+ * @brief Encodes coverage in legacy format.
+ *
+ * @param coverage Coverage to encode.
+ *
+ * @returns The blob.
+ */
+static std::vector<unsigned char>
+makeLegacy(const std::vector<int> &coverage)
+{
+    std::ostringstream oss;
+    std::copy(coverage.cbegin(), coverage.cend(),
+              std::ostream_iterator<int>(oss, " "));
+    const std::string str = oss.str();
+
+    unsigned long compressedSize = compressBound(str.length());
+    std::vector<unsigned char> blob(4U + compressedSize);
+
+    blob[0] = str.length() >> 24;
+    blob[1] = str.length() >> 16;
+    blob[2] = str.length() >> 8;
+    blob[3] = str.length();
+
+    REQUIRE(compress(&blob[4], &compressedSize,
+                     reinterpret_cast<const unsigned char *>(str.data()),
+                     str.size()) == Z_OK);
+    blob.resize(4U + compressedSize);
+    return blob;
+}
+
+/**
+ * @brief Decodes coverage in legacy format the way it used to be done.
+ *
+ * Serves as a baseline for benchmarking.
+ *
+ * @param blob Pointer to the beginning of the blob.
+ * @param size Size of the blob.
+ *
+ * @returns Coverage information.
+ */
+static std::vector<int>
+decodeLegacyCopying(const unsigned char blob[], std::size_t size)
+{
+    std::vector<unsigned char> copy(blob, blob + size);
+    unsigned long strSize =
+        (copy[0] << 24) + (copy[1] << 16) + (copy[2] << 8) + copy[3];
+
+    std::string str(strSize, '\0');
+    REQUIRE(uncompress(reinterpret_cast<unsigned char *>(&str[0]), &strSize,
+                       &copy[4], copy.size() - 4U) == Z_OK);
+
+    std::istringstream is(str);
+    std::vector<int> vec;
+    for (int i; is >> i; ) {
+        vec.push_back(i);
+    }
+    return vec;
+}
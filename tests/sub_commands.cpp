@@ -177,6 +177,22 @@ TEST_CASE("Description can be queried", "[subcommands]")
     CHECK_THROWS_AS(cmd->getDescription("wrong"), const std::out_of_range &);
 }
 
+TEST_CASE("Archive requires a build", "[subcommands][archive-subcommand]")
+{
+    Repository repo("tests/test-repo");
+    DB db(getDbPath(repo));
+    BuildHistory bh(db);
+
+    StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
+    CHECK(getCmd("archive")->exec(getSettings(), bh, repo, "archive",
+                                  { }) == EXIT_FAILURE);
+    CHECK(getCmd("archive")->exec(getSettings(), bh, repo, "archive",
+                                  { "--before", "x/" }) == EXIT_FAILURE);
+    CHECK(bh.getBuilds().size() == 3U);
+    CHECK(coutCapture.get() == std::string());
+    CHECK(cerrCapture.get() != std::string());
+}
+
 TEST_CASE("Error on wrong branch", "[subcommands][build-subcommand]")
 {
     Repository repo("tests/test-repo/subdir");
@@ -365,6 +381,25 @@ File: test-file2.cpp, 100.00% (2/2), +100.0000% (+2/-2/0)
     CHECK(cerrCapture.get() == std::string());
 }
 
+TEST_CASE("Diff-hits compares state without hit counts",
+          "[subcommands][diff-subcommand]")
+{
+    Repository repo("tests/test-repo/subdir");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+    DB db(dbPath);
+    BuildHistory bh(db);
+    db.execute("UPDATE builds SET hitcounts = 0 WHERE buildid = 2");
+
+    StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
+    CHECK(getCmd("diff-hits")->exec(getSettings(), bh, repo, "diff-hits",
+                                    { "@1", "@2" }) == EXIT_SUCCESS);
+
+    CHECK(coutCapture.get() != std::string());
+    CHECK(cerrCapture.get() == "Hit counts aren't stored for build #2, "
+                               "comparing state of lines instead\n");
+}
+
 TEST_CASE("Regress detects regression", "[subcommands][regress-subcommand]")
 {
     Repository repo("tests/test-repo/subdir");
@@ -397,6 +432,70 @@ File: test-file1.cpp, 0.00% (0/2), -100.0000% (-2/+2/0)
     CHECK(cerrCapture.get() == std::string());
 }
 
+TEST_CASE("Gc requires a policy", "[subcommands][gc-subcommand]")
+{
+    Repository repo("tests/test-repo");
+    DB db(getDbPath(repo));
+    BuildHistory bh(db);
+
+    StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
+    CHECK(getCmd("gc")->exec(getSettings(), bh, repo, "gc",
+                             { }) == EXIT_FAILURE);
+    CHECK(getCmd("gc")->exec(getSettings(), bh, repo, "gc",
+                             { "--keep-last", "-1" }) == EXIT_FAILURE);
+    CHECK(bh.getBuilds().size() == 3U);
+    CHECK(coutCapture.get() == std::string());
+    CHECK(cerrCapture.get() != std::string());
+}
+
+TEST_CASE("Gc removes builds", "[subcommands][gc-subcommand]")
+{
+    Repository repo("tests/test-repo");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+    DB db(dbPath);
+    BuildHistory bh(db);
+    StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
+
+    SECTION("Dry run doesn't change anything")
+    {
+        CHECK(getCmd("gc")->exec(getSettings(), bh, repo, "gc",
+                                 { "--keep-last", "1",
+                                   "--dry-run" }) == EXIT_SUCCESS);
+        CHECK(bh.getBuilds().size() == 3U);
+        CHECK(coutCapture.get() == "Would remove build #1\n"
+                                   "Would remove build #2\n");
+    }
+
+    SECTION("Last builds are kept")
+    {
+        CHECK(getCmd("gc")->exec(getSettings(), bh, repo, "gc",
+                                 { "--keep-last", "2" }) == EXIT_SUCCESS);
+        REQUIRE(bh.getBuilds().size() == 2U);
+        CHECK(bh.getBuilds().front().getId() == 2);
+        CHECK(bh.getPreviousBuildId(2) == 0);
+    }
+
+    SECTION("Last build is always kept")
+    {
+        CHECK(getCmd("gc")->exec(getSettings(), bh, repo, "gc",
+                                 { "--keep-newer", "1" }) == EXIT_SUCCESS);
+        REQUIRE(bh.getBuilds().size() == 1U);
+        CHECK(bh.getBuilds().front().getId() == 3);
+    }
+
+    SECTION("One build per day is kept")
+    {
+        CHECK(getCmd("gc")->exec(getSettings(), bh, repo, "gc",
+                                 { "--keep-daily-after",
+                                   "30" }) == EXIT_SUCCESS);
+        CHECK(bh.getBuilds().size() < 3U);
+        CHECK(bh.getLastBuildId() == 3);
+    }
+
+    CHECK(cerrCapture.get() == std::string());
+}
+
 TEST_CASE("Invalid arguments for get", "[subcommands][get-subcommand]")
 {
     Repository repo("tests/test-repo/subdir");
@@ -441,6 +540,38 @@ TEST_CASE("Paths to files can be relative inside repository",
     CHECK(cerrCapture.get() == std::string());
 }
 
+TEST_CASE("Migrate updates old data", "[subcommands][migrate-subcommand]")
+{
+    Repository repo("tests/test-repo");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+    DB db(dbPath);
+    BuildHistory bh(db);
+    StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
+
+    SECTION("Status is reported")
+    {
+        CHECK(getCmd("migrate")->exec(getSettings(), bh, repo, "migrate",
+                                      { "--status" }) == EXIT_SUCCESS);
+        CHECK(bh.getMigrations().size() == 4U);
+        CHECK(boost::starts_with(coutCapture.get(), "filemap: 0 / "));
+    }
+
+    SECTION("All updates are done")
+    {
+        CHECK(getCmd("migrate")->exec(getSettings(), bh, repo, "migrate",
+                                      { "--batch-size", "1" }) ==
+              EXIT_SUCCESS);
+        CHECK(bh.getMigrations().empty());
+        CHECK(coutCapture.get() == "filemap: done\n"
+                                   "coverage: done\n"
+                                   "filestats: done\n"
+                                   "dirstats: done\n");
+    }
+
+    CHECK(cerrCapture.get() == std::string());
+}
+
 TEST_CASE("New handles input gracefully", "[subcommands][new-subcommand]")
 {
     Repository repo("tests/test-repo/");
@@ -751,6 +882,47 @@ TEST_CASE("New-json creates new builds", "[subcommands][new-json-subcommand]")
     CHECK(coutCapture.get() != std::string());
 }
 
+TEST_CASE("Recompress changes how coverage is stored",
+          "[subcommands][recompress-subcommand]")
+{
+    Repository repo("tests/test-repo");
+    const std::string dbPath = getDbPath(repo);
+    FileRestorer databaseRestorer(dbPath, dbPath + "_original");
+    DB db(dbPath);
+    BuildHistory bh(db);
+    StreamCapture coutCapture(std::cout), cerrCapture(std::cerr);
+
+    SECTION("Sizes must be positive")
+    {
+        CHECK(getCmd("recompress")->exec(getSettings(), bh, repo,
+                                         "recompress",
+                                         { "--samples", "0" }) ==
+              EXIT_FAILURE);
+        CHECK(coutCapture.get() == std::string());
+        CHECK(cerrCapture.get() != std::string());
+    }
+
+    SECTION("Compression can be disabled")
+    {
+        CHECK(getCmd("recompress")->exec(getSettings(), bh, repo,
+                                         "recompress", { "--no-dict" }) ==
+              EXIT_SUCCESS);
+        CHECK(bh.getMigrations().empty());
+        CHECK(coutCapture.get() == "Removed unused dictionaries: 0\n");
+        CHECK(cerrCapture.get() == std::string());
+    }
+
+#ifndef WITH_ZSTD
+    SECTION("Compression requires zstd")
+    {
+        CHECK(getCmd("recompress")->exec(getSettings(), bh, repo,
+                                         "recompress", {}) == EXIT_FAILURE);
+        CHECK(coutCapture.get() == std::string());
+        CHECK(cerrCapture.get() != std::string());
+    }
+#endif
+}
+
 TEST_CASE("Dirs fails on unknown dir path", "[subcommands][dirs-subcommand]")
 {
     Repository repo("tests/test-repo/subdir");
@@ -41,3 +41,10 @@ TEST_CASE("readFile throws on a nonexisting file", "[utils-fs]")
 {
     CHECK_THROWS_AS(readFile("no-such-file"), const std::runtime_error &);
 }
+
+TEST_CASE("isWritable checks existing files", "[utils-fs]")
+{
+    CHECK(isWritable("tests/test-repo/test-file1.cpp"));
+    CHECK_FALSE(isWritable("tests"));
+    CHECK_FALSE(isWritable("tests/no-such-file"));
+}
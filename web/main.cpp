@@ -1,14 +1,20 @@
+#include <boost/filesystem/operations.hpp>
 #include <boost/program_options.hpp>
 #include <cxxtools/log.h>
 #include <tnt/tntnet.h>
 
+#include <csignal>
 #include <cstdlib>
 
+#include <iostream>
 #include <memory>
+#include <string>
 #include <type_traits>
 
 #include "BuildHistory.hpp"
+#include "BuildHistoryPool.hpp"
 #include "DB.hpp"
+#include "DBProfile.hpp"
 #include "Repository.hpp"
 #include "WebSettings.hpp"
 #include "app.hpp"
@@ -18,9 +24,11 @@
 namespace po = boost::program_options;
 
 static po::variables_map parseOptions(const std::vector<std::string> &args);
+static bool shouldProfileDB();
+static void stopServer(int signal);
 
 Repository *globalRepo;
-BuildHistory *globalBH;
+BuildHistoryPool *globalBHPool;
 Settings *globalSettings;
 
 static po::options_description cmdlineOptions = []() {
@@ -34,7 +42,9 @@ static po::options_description cmdlineOptions = []() {
         ("repo", po::value<std::string>()->default_value("."),
          "path to repository")
         ("port", po::value<int>()->default_value(8000),
-         "port to listen to (8000 by default)");
+         "port to listen to (8000 by default)")
+        ("db-pool-size", po::value<int>()->default_value(4),
+         "number of database connections (4 by default)");
     return opts;
 }();
 
@@ -91,15 +101,29 @@ main(int argc, char *argv[]) try
 
     settings->loadFromFile(dataPath + '/' + getConfigFile());
 
-    DB db(dataPath + '/' + getDatabaseFile());
-    BuildHistory bh(db);
+    // Web-interface never writes to the database.  Missing database is
+    // created to be able to display empty history.
+    const std::string dbPath = dataPath + '/' + getDatabaseFile();
+    if (!boost::filesystem::exists(dbPath)) {
+        DB db(dbPath);
+        BuildHistory bh(db);
+    }
+
+    // Profile is declared first to outlive connections of the pool.
+    DBProfile profile;
+    const bool profileDB = shouldProfileDB();
+    BuildHistoryPool bhPool(dbPath, dataPath + '/' + getArchiveFile(),
+                            dataPath + '/' + getPackFile(), *settings,
+                            varMap["db-pool-size"].as<int>(),
+                            profileDB ? &profile : nullptr);
+    bhPool.configure(*settings);
 
     std::string vhost = varMap["vhost"].as<std::string>();
     std::string ip = varMap["ip"].as<std::string>();
     int port = varMap["port"].as<int>();
 
     globalRepo = &repo;
-    globalBH = &bh;
+    globalBHPool = &bhPool;
     globalSettings = settings.get();
 
     using tnt::Maptarget;
@@ -130,7 +154,18 @@ main(int argc, char *argv[]) try
     app.vMapUrl(vhost, "^/style.css", Maptarget("style.css"));
     app.vMapUrl(vhost, "^/favicon.ico", Maptarget("favicon.ico"));
     app.vMapUrl(vhost, "^/robots.txt", Maptarget("robots.txt"));
+
+    if (profileDB) {
+        // Stop gracefully to get a chance to print the report.
+        std::signal(SIGINT, &stopServer);
+        std::signal(SIGTERM, &stopServer);
+    }
+
     app.run();
+
+    if (profileDB) {
+        profile.print(std::cerr);
+    }
 } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
     return EXIT_FAILURE;
@@ -166,3 +201,28 @@ parseOptions(const std::vector<std::string> &args)
 
     return varMap;
 }
+
+/**
+ * @brief Checks whether profiling of database statements was requested.
+ *
+ * @returns @c true if UNCOV_PROFILE_DB environment variable is set to a
+ *          non-empty value other than "0", @c false otherwise.
+ */
+static bool
+shouldProfileDB()
+{
+    const char *const value = std::getenv("UNCOV_PROFILE_DB");
+    return value != nullptr && *value != '\0' && std::string(value) != "0";
+}
+
+/**
+ * @brief Signal handler that requests the server to stop.
+ *
+ * @param signal Number of the signal.
+ */
+static void
+stopServer(int signal)
+{
+    static_cast<void>(signal);
+    tnt::Tntnet::shutdown();
+}